@@ -0,0 +1,94 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/hash.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey {
+
+    // the crypto++ implementation that SHA2_256 used to call.
+    void BM_SHA256CryptoPP (benchmark::State &state) {
+        bytes b (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (crypto::SHA2_256 (b));
+        state.SetBytesProcessed (state.iterations () * state.range (0));
+    }
+
+    template <sha256::implementation x>
+    void BM_SHA256 (benchmark::State &state) {
+        if (!sha256::available (x)) {
+            state.SkipWithError ("not available on this machine");
+            return;
+        }
+
+        sha256::select (x);
+        bytes b (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (SHA2_256 (b));
+        state.SetBytesProcessed (state.iterations () * state.range (0));
+        sha256::reset ();
+    }
+
+    // a Merkle node and a block header, first through the general
+    // function and then through the kernels for their sizes.
+    void BM_Hash256General (benchmark::State &state) {
+        bytes b (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (Bitcoin::Hash256 (b));
+    }
+
+    void BM_Hash256Node (benchmark::State &state) {
+        bytes b (64);
+        for (auto _ : state) benchmark::DoNotOptimize (sha256::double_hash_64 (b.data ()));
+    }
+
+    void BM_Hash256Header (benchmark::State &state) {
+        bytes b (80);
+        for (auto _ : state) benchmark::DoNotOptimize (sha256::double_hash_80 (b.data ()));
+    }
+
+    // only the nonce changes, as when mining.
+    void BM_Hash256HeaderMidstate (benchmark::State &state) {
+        bytes b (80);
+        std::array<uint32, 8> midstate = sha256::midstate_80 (b.data ());
+        for (auto _ : state) benchmark::DoNotOptimize (sha256::double_hash_80 (midstate, b.data () + 64));
+    }
+
+    // a level of a Merkle tree with the given number of leaves,
+    // which is hashed as a batch of 64 byte messages.
+    template <sha256::implementation x>
+    void BM_SHA256Batch (benchmark::State &state) {
+        if (!sha256::available (x)) {
+            state.SkipWithError ("not available on this machine");
+            return;
+        }
+
+        sha256::select_batch (x);
+        bytes b (64 * state.range (0));
+        std::vector<slice<const byte>> in {};
+        for (int i = 0; i < state.range (0); i++) in.push_back (slice<const byte> {b.data () + 64 * i, 64});
+        std::vector<digest256> out (state.range (0));
+
+        for (auto _ : state) {
+            Bitcoin::Hash256_batch (in, out);
+            benchmark::DoNotOptimize (out.data ());
+        }
+
+        state.SetItemsProcessed (state.iterations () * state.range (0));
+        sha256::reset ();
+    }
+
+    // the size of a block header and then of a large transaction.
+    BENCHMARK (BM_SHA256CryptoPP)->Arg (64)->Arg (80)->Arg (1 << 20);
+    BENCHMARK (BM_SHA256<sha256::implementation::reference>)->Arg (64)->Arg (80)->Arg (1 << 20);
+    BENCHMARK (BM_SHA256<sha256::implementation::x86_shani>)->Arg (64)->Arg (80)->Arg (1 << 20);
+    BENCHMARK (BM_SHA256<sha256::implementation::arm_shani>)->Arg (64)->Arg (80)->Arg (1 << 20);
+    BENCHMARK (BM_Hash256General)->Arg (64)->Arg (80);
+    BENCHMARK (BM_Hash256Node);
+    BENCHMARK (BM_Hash256Header);
+    BENCHMARK (BM_Hash256HeaderMidstate);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::reference>)->Arg (4096);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::x86_shani>)->Arg (4096);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::arm_shani>)->Arg (4096);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::x86_sse41>)->Arg (4096);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::x86_avx2>)->Arg (4096);
+    BENCHMARK (BM_SHA256Batch<sha256::implementation::x86_avx512>)->Arg (4096);
+
+}
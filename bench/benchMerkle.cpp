@@ -0,0 +1,56 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/merkle/tree.hpp>
+#include <gigamonkey/merkle/server.hpp>
+#include <gigamonkey/merkle/flat.hpp>
+#include <benchmark/benchmark.h>
+
+namespace Gigamonkey::Merkle {
+
+    std::vector<digest> bench_leaves (size_t n) {
+        std::vector<digest> leaves (n);
+        for (size_t i = 0; i < n; i++) leaves[i] = Bitcoin::Hash256 (std::to_string (i));
+        return leaves;
+    }
+
+    void BM_MerkleServer (benchmark::State &state) {
+        leaf_digests leaves {};
+        for (const digest &d : bench_leaves (state.range (0))) leaves <<= d;
+        for (auto _ : state) benchmark::DoNotOptimize (server {leaves}.root ());
+        state.SetItemsProcessed (state.iterations () * state.range (0));
+    }
+
+    // the second argument is the number of threads.
+    void BM_FlatTree (benchmark::State &state) {
+        std::vector<digest> leaves = bench_leaves (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (flat_tree {leaves, uint32 (state.range (1))}.root ());
+        state.SetItemsProcessed (state.iterations () * state.range (0));
+    }
+
+    void BM_FlatTreeBranch (benchmark::State &state) {
+        flat_tree t {bench_leaves (state.range (0))};
+        uint32 i = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize (t[i]);
+            i = (i + 7919) % t.width ();
+        }
+    }
+
+    // add a transaction to a block template and get the new coinbase path.
+    void BM_FlatTreeAppend (benchmark::State &state) {
+        flat_tree t {bench_leaves (state.range (0))};
+        digest d = Bitcoin::Hash256 ("new transaction");
+        for (auto _ : state) {
+            t.append (d);
+            benchmark::DoNotOptimize (t.path (0));
+            t.remove_last ();
+        }
+    }
+
+    BENCHMARK (BM_MerkleServer)->Arg (1 << 12)->Arg (1 << 18);
+    BENCHMARK (BM_FlatTree)->Args ({1 << 12, 1})->Args ({1 << 18, 1})->Args ({1 << 18, 0});
+    BENCHMARK (BM_FlatTreeBranch)->Arg (1 << 18);
+    BENCHMARK (BM_FlatTreeAppend)->Arg (1 << 18);
+
+}
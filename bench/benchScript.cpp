@@ -0,0 +1,236 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/interpreter.hpp>
+#include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+// count every allocation so that benchmarks can report allocations per evaluation.
+namespace {
+    std::atomic<std::uint64_t> Allocations {0};
+}
+
+void *operator new (std::size_t size) {
+    Allocations.fetch_add (1, std::memory_order_relaxed);
+    if (void *p = std::malloc (size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc {};
+}
+
+void operator delete (void *p) noexcept {
+    std::free (p);
+}
+
+void operator delete (void *p, std::size_t) noexcept {
+    std::free (p);
+}
+
+namespace Gigamonkey::Bitcoin {
+
+    // a script with lots of small ops.
+    bytes dup_drop_script (int n) {
+        program p {};
+        for (int i = 0; i < n; i++) p = p << instruction {OP_DUP} << instruction {OP_DROP};
+        return compile (p);
+    }
+
+    // a script with lots of pushes.
+    bytes push_drop_script (int n) {
+        program p {};
+        bytes data (32);
+        for (int i = 0; i < n; i++) p = p << instruction::push (data) << instruction::push (data) << instruction {OP_2DROP};
+        return compile (p);
+    }
+
+    // what setup_interpreter used to do before each evaluation: decompile both
+    // scripts, recompile the full program, and then parse every instruction
+    // again as it is run.
+    size_t parse_legacy (const bytes &unlock, const bytes &lock) {
+        bytes script = compile (full (decompile (unlock), decompile (lock), false));
+        size_t n = 0;
+        for (program_counter p {script}; p.Next.size () > 0; ++p) n++;
+        return n;
+    }
+
+    size_t parse_bytecode (const bytes &unlock, const bytes &lock) {
+        bytecode b = full (bytecode {unlock}, bytecode {lock}, false);
+        size_t n = 0;
+        for (bytecode::counter p {b}; !p.done (); ++p) n++;
+        return n;
+    }
+
+    void BM_ParseLegacy (benchmark::State &state) {
+        bytes unlock = compile (instruction {OP_1});
+        bytes lock = dup_drop_script (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (parse_legacy (unlock, lock));
+        state.SetItemsProcessed (state.iterations () * state.range (0) * 2);
+    }
+
+    void BM_ParseBytecode (benchmark::State &state) {
+        bytes unlock = compile (instruction {OP_1});
+        bytes lock = dup_drop_script (state.range (0));
+        for (auto _ : state) benchmark::DoNotOptimize (parse_bytecode (unlock, lock));
+        state.SetItemsProcessed (state.iterations () * state.range (0) * 2);
+    }
+
+    // evaluate the scripts repeatedly and report allocations per evaluation
+    // and the rate of instructions in the scripts. This is the static count,
+    // so instructions in untaken branches or after OP_RETURN are included.
+    template <typename... X>
+    void run_evaluate (benchmark::State &state, const bytes &unlock, const bytes &lock, const X &...x) {
+        // a benchmark of a script that fails would measure the wrong thing.
+        if (result r = evaluate (unlock, lock, x...); !r.verify ()) {
+            std::stringstream ss;
+            ss << "script does not succeed: " << r;
+            state.SkipWithError (ss.str ().c_str ());
+            return;
+        }
+
+        int64 instructions = parse_bytecode (unlock, lock);
+        std::uint64_t allocations = Allocations.load (std::memory_order_relaxed);
+        for (auto _ : state) benchmark::DoNotOptimize (evaluate (unlock, lock, x...));
+        allocations = Allocations.load (std::memory_order_relaxed) - allocations;
+
+        state.SetItemsProcessed (state.iterations () * instructions);
+        state.counters["static ops"] = benchmark::Counter (double (state.iterations () * instructions), benchmark::Counter::kIsRate);
+        state.counters["allocations"] = benchmark::Counter (double (allocations), benchmark::Counter::kAvgIterations);
+    }
+
+    // limits large enough for scripts with big elements and numbers.
+    script_config consensus () {
+        return script_config {genesis_profile (), true};
+    }
+
+    void BM_EvaluateDupDrop (benchmark::State &state) {
+        run_evaluate (state, compile (instruction {OP_1}), dup_drop_script (state.range (0)), script_config {});
+    }
+
+    void BM_EvaluatePushDrop (benchmark::State &state) {
+        run_evaluate (state, compile (instruction {OP_1}), push_drop_script (state.range (0)), script_config {});
+    }
+
+    // signatures are not checked since there is no redemption document,
+    // so this measures everything the interpreter does around them.
+    void BM_EvaluateP2PKH (benchmark::State &state) {
+        bytes pubkey (33);
+        pubkey[0] = 0x02;
+        bytes sig (71);
+        bytes unlock = compile (program {instruction::push (sig), instruction::push (pubkey)});
+        bytes lock = pay_to_address::script (Hash160 (pubkey));
+        run_evaluate (state, unlock, lock, script_config {state.range (0) ? genesis_profile () : flag {}});
+    }
+
+    void BM_EvaluateCat (benchmark::State &state) {
+        bytes data (16);
+        program p {};
+        for (int i = 0; i < state.range (0); i++) p = p << instruction::push (data) << instruction {OP_CAT};
+        run_evaluate (state, compile (instruction::push (data)), compile (p), script_config {});
+    }
+
+    // a transaction with one input to sign.
+    incomplete::transaction bench_transaction () {
+        return incomplete::transaction {
+            {incomplete::input {
+                outpoint {digest256 {uint256 {1}}, 0}, 0xffffffff}},
+            {output {1, pay_to_address::script (digest160 {uint160 {2}})}}, 0};
+    }
+
+    // a spend of pay to address with a real signature. Before genesis
+    // the signature uses the original sighash algorithm.
+    void BM_EvaluateSignedP2PKH (benchmark::State &state) {
+        bool genesis = state.range (0);
+        incomplete::transaction tx = bench_transaction ();
+        redemption_document doc {tx, 0, satoshi {1000}};
+
+        secp256k1::secret key {uint256 {123456}};
+        secp256k1::pubkey pub = key.to_public ();
+        bytes lock = pay_to_address::script (Hash160 (pub));
+        signature sig = signature::sign (key, directive (sighash::all, false, genesis),
+            sighash::document {tx, 0, satoshi {1000}, decompile (lock)});
+        bytes unlock = compile (program {push_data (sig), push_data (pub)});
+
+        run_evaluate (state, unlock, lock, doc, script_config {genesis ? genesis_profile () : flag {}});
+    }
+
+    // a 15 of 15 multisig script, which checks 15 signatures.
+    void BM_EvaluateMultisig (benchmark::State &state) {
+        incomplete::transaction tx = bench_transaction ();
+        redemption_document doc {tx, 0, satoshi {1000}};
+
+        std::vector<secp256k1::secret> keys;
+        program lock_program {OP_15};
+        for (int i = 1; i <= 15; i++) {
+            keys.push_back (secp256k1::secret {uint256 (i)});
+            lock_program <<= push_data (keys.back ().to_public ());
+        }
+
+        lock_program <<= OP_15;
+        lock_program <<= OP_CHECKMULTISIG;
+        bytes lock = compile (lock_program);
+
+        sighash::document d {tx, 0, satoshi {1000}, decompile (lock)};
+        program unlock {OP_0};
+        for (const secp256k1::secret &k : keys) unlock <<= push_data (signature::sign (k, directive (sighash::all), d));
+
+        run_evaluate (state, compile (unlock), lock, doc, script_config {});
+    }
+
+    // join and split an element of one megabyte over and over.
+    void BM_EvaluateCatSplit (benchmark::State &state) {
+        const int size = 1 << 20;
+        bytes data (size);
+        std::fill (data.begin (), data.end (), 0x01);
+        program p {};
+        for (int i = 0; i < state.range (0); i++)
+            p = p << instruction {OP_DUP} << instruction {OP_CAT} << push_data (size) << instruction {OP_SPLIT} << instruction {OP_DROP};
+        p = p << instruction {OP_DROP} << instruction {OP_1};
+        run_evaluate (state, compile (instruction::push (data)), compile (p), consensus ());
+    }
+
+    // multiply numbers of the given size in bytes.
+    void BM_EvaluateBigMul (benchmark::State &state) {
+        bytes x (state.range (0));
+        std::fill (x.begin (), x.end (), 0xab);
+        // positive and minimally encoded.
+        x[x.size () - 1] = 0x3f;
+        run_evaluate (state, compile (instruction::push (x)),
+            compile (program {instruction::push (x), instruction {OP_MUL}}), consensus ());
+    }
+
+    // IF chains nested to the given depth.
+    void BM_EvaluateNestedIf (benchmark::State &state) {
+        program p {};
+        for (int i = 0; i < state.range (0); i++) p = p << instruction {OP_1} << instruction {OP_IF};
+        p = p << instruction {OP_1};
+        for (int i = 0; i < state.range (0); i++) p = p << instruction {OP_ENDIF};
+        run_evaluate (state, compile (instruction {OP_1}), compile (p), consensus ());
+    }
+
+    // a data output with pushes of the given size. After genesis,
+    // OP_RETURN ends the script without running the rest.
+    void BM_EvaluateOpReturn (benchmark::State &state) {
+        bytes data (state.range (0));
+        std::fill (data.begin (), data.end (), 0x61);
+        program p {OP_RETURN};
+        for (int i = 0; i < 4; i++) p = p << instruction::push (data);
+        run_evaluate (state, compile (instruction {OP_1}), compile (p), consensus ());
+    }
+
+    BENCHMARK (BM_ParseLegacy)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_ParseBytecode)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_EvaluateDupDrop)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_EvaluatePushDrop)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_EvaluateP2PKH)->Arg (0)->Arg (1);
+    BENCHMARK (BM_EvaluateCat)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_EvaluateSignedP2PKH)->Arg (0)->Arg (1);
+    BENCHMARK (BM_EvaluateMultisig);
+    BENCHMARK (BM_EvaluateCatSplit)->Arg (1)->Arg (16);
+    BENCHMARK (BM_EvaluateBigMul)->Arg (32)->Arg (1024)->Arg (16384);
+    BENCHMARK (BM_EvaluateNestedIf)->Arg (16)->Arg (256)->Arg (4096);
+    BENCHMARK (BM_EvaluateOpReturn)->Arg (1024)->Arg (1 << 16)->Arg (1 << 20);
+
+}
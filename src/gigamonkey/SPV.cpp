@@ -3,6 +3,8 @@
 
 #include <gigamonkey/SPV.hpp>
 #include <gigamonkey/script/interpreter.hpp>
+#include <gigamonkey/script/standard.hpp>
+#include <gigamonkey/script/signature_batch.hpp>
 
 namespace Gigamonkey::Bitcoin {
     
@@ -110,14 +112,32 @@ namespace Gigamonkey::SPV {
 
     namespace {
 
+        // an input whose script is valid if the signatures put off until later are.
+        struct evaluated_input {
+            Bitcoin::TXID TXID;
+            uint32 InputIndex;
+            Bitcoin::outpoint Reference;
+            bytes Unlock;
+            Bitcoin::output Prevout;
+            Bitcoin::script_config Config;
+        };
+
+        // the signatures of every script in the proof are checked together at the end.
+        struct validation {
+            Bitcoin::script_cache *Cache;
+            Bitcoin::signature_batch Signatures;
+            std::vector<evaluated_input> Evaluated;
+        };
+
         bool check_sub_proof (
             set<Bitcoin::TXID> &checked,
             const Bitcoin::transaction &tx,
             proof::map map,
             database &d,
-            time_limit genesis_upgrade_time);
+            time_limit genesis_upgrade_time,
+            validation &v);
 
-        bool proof_validate (const proof &u, database &d, time_limit genesis_upgrade_time = time_limit::negative_infinity ()) {
+        bool proof_validate (const proof &u, database &d, time_limit genesis_upgrade_time, Bitcoin::script_cache *cache) {
 
             //check that all txs are unique.
             auto pp = u.Payment;
@@ -130,10 +150,17 @@ namespace Gigamonkey::SPV {
             // keep track of transactions we have checked already.
             set<Bitcoin::TXID> checked;
 
+            validation v {cache, {}, {}};
+
             // we check each transaction in the payment, which involves
             // checking antecedents and their antecedents and so on.
             for (const Bitcoin::transaction &tx : u.Payment)
-                if (!check_sub_proof (checked, tx, u.Proof, d, genesis_upgrade_time)) return false;
+                if (!check_sub_proof (checked, tx, u.Proof, d, genesis_upgrade_time, v)) return false;
+
+            if (bool (v.Signatures.check ())) return false;
+
+            if (cache != nullptr) for (const evaluated_input &e : v.Evaluated)
+                cache->insert (e.TXID, e.InputIndex, e.Reference, e.Unlock, e.Prevout, e.Config);
 
             return true;
         }
@@ -143,13 +170,16 @@ namespace Gigamonkey::SPV {
             const Bitcoin::transaction &tx,
             proof::map map,
             database &d,
-            time_limit genesis_upgrade_time) {
+            time_limit genesis_upgrade_time,
+            validation &v) {
 
             uint32 input_index = 0;
             Bitcoin::satoshi spent = 0;
 
             // for checking scripts.
             Bitcoin::incomplete::transaction incomplete {tx};
+            Bitcoin::sighash::precomputed pre {incomplete};
+            Bitcoin::TXID txid = tx.id ();
 
             for (const Bitcoin::input &in : tx.Inputs) {
                 const auto *v = map.contains (in.Reference.Digest);
@@ -168,7 +198,7 @@ namespace Gigamonkey::SPV {
 
                         execution_time = time_limit {conf.Header.Timestamp};
                     } else {
-                        if (!check_sub_proof (checked, antecedent.Transaction, antecedent.Proof.get<proof::map> (), d, genesis_upgrade_time))
+                        if (!check_sub_proof (checked, antecedent.Transaction, antecedent.Proof.get<proof::map> (), d, genesis_upgrade_time, v))
                             return {};
                         checked = checked.insert (in.Reference.Digest);
 
@@ -183,17 +213,20 @@ namespace Gigamonkey::SPV {
 
                 spent += prevout.Value;
 
+                Bitcoin::script_config conf = genesis_upgrade_time > execution_time ?
+                    Bitcoin::script_config {Bitcoin::pre_genesis_profile ()}:
+                    Bitcoin::script_config {Bitcoin::genesis_profile ()};
+
+                conf.DeferSignatures = true;
+                conf.SignatureBatch = &v.Signatures;
+
                 // check scripts
-                if (!bool (
-                    Bitcoin::evaluate (
-                        in.Script, prevout.Script,
-                        Bitcoin::redemption_document {incomplete, input_index, prevout.Value},
-                        genesis_upgrade_time > execution_time ?
-                            Bitcoin::script_config {Bitcoin::pre_genesis_profile ()}:
-                            Bitcoin::script_config {Bitcoin::genesis_profile ()}
-                        )
-                    )
-                ) return false;
+                if (v.Cache == nullptr || !v.Cache->contains (txid, input_index, in.Reference, in.Script, prevout, conf)) {
+                    if (!bool (Bitcoin::evaluate_standard (in.Script, prevout.Script,
+                        Bitcoin::redemption_document {incomplete, input_index, prevout.Value, &pre}, conf))) return false;
+
+                    if (v.Cache != nullptr) v.Evaluated.push_back (evaluated_input {txid, input_index, in.Reference, in.Script, prevout, conf});
+                }
 
                 input_index++;
             }
@@ -203,8 +236,8 @@ namespace Gigamonkey::SPV {
     }
 
     // check valid and check that all headers are in our database.
-    bool proof::validate (SPV::database &d, time_limit genesis_upgrade_time) const {
-        return proof_validate (*this, d, genesis_upgrade_time);
+    bool proof::validate (SPV::database &d, time_limit genesis_upgrade_time, Bitcoin::script_cache *cache) const {
+        return proof_validate (*this, d, genesis_upgrade_time, cache);
     }
 
     namespace {
@@ -410,6 +410,7 @@ namespace Gigamonkey::Boost {
         Bitcoin::satoshi val = value ();
 
         incomplete::transaction incomplete {1, incomplete_inputs, outs, 0};
+        sighash::precomputed pre {incomplete};
         pubkey pk = sk.to_public ();
         Boost::type boost_type = boost_script.Type;
         bool category_mask = boost_script.UseGeneralPurposeBits;
@@ -417,11 +418,11 @@ namespace Gigamonkey::Boost {
         uint32 index = 0;
         
         return bytes (transaction {1, data::map_thread (
-            [&sk, &script, &incomplete, &pk, &solution, boost_type, category_mask, &index](
+            [&sk, &script, &incomplete, &pre, &pk, &solution, boost_type, category_mask, &index](
                 const incomplete::input &i, 
                 const prevout &prev) -> input {
                 return input {i.Reference, input_script {
-                    sk.sign (sighash::document {incomplete, index++, prev.Value, decompile (script)}, directive (sighash::all)),
+                    sk.sign (sighash::document {incomplete, index++, prev.Value, decompile (script), &pre}, directive (sighash::all)),
                 pk, solution, boost_type, category_mask}.write (), i.Sequence};
             }, incomplete_inputs, Prevouts.values ()), outs, 0});
         
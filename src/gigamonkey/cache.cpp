@@ -0,0 +1,75 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/cache.hpp>
+#include <random>
+
+namespace Gigamonkey {
+
+    salted_cache::salted_cache (size_t max_bytes) : Salt {}, Sets {0}, Shards {}, Hits {0}, Misses {0} {
+        std::random_device r;
+        for (byte &b : Salt) b = static_cast<byte> (r ());
+
+        Sets = std::max (max_bytes / (sizeof (entry) * WAYS * SHARDS), size_t {1});
+        for (shard &s : Shards) {
+            s.Entries.resize (Sets * WAYS, entry {digest256 {}, 0});
+            s.Clock = 0;
+        }
+    }
+
+    salted_cache::shard &salted_cache::shard_of (const digest256 &key) {
+        return Shards[key[0] % SHARDS];
+    }
+
+    size_t salted_cache::set_of (const digest256 &key) const {
+        uint64 n = 0;
+        for (int i = 1; i < 9; i++) n = (n << 8) | key[i];
+        return n % Sets;
+    }
+
+    bool salted_cache::contains (const digest256 &k) {
+        shard &s = shard_of (k);
+        entry *set = s.Entries.data () + set_of (k) * WAYS;
+
+        {
+            std::lock_guard<std::mutex> lock {s.Mutex};
+            for (size_t i = 0; i < WAYS; i++) if (set[i].Used != 0 && set[i].Key == k) {
+                set[i].Used = ++s.Clock;
+                Hits.fetch_add (1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        Misses.fetch_add (1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void salted_cache::insert (const digest256 &k) {
+        shard &s = shard_of (k);
+        entry *set = s.Entries.data () + set_of (k) * WAYS;
+
+        std::lock_guard<std::mutex> lock {s.Mutex};
+        entry *oldest = set;
+        for (size_t i = 0; i < WAYS; i++) {
+            if (set[i].Used != 0 && set[i].Key == k) {
+                set[i].Used = ++s.Clock;
+                return;
+            }
+
+            if (set[i].Used < oldest->Used) oldest = set + i;
+        }
+
+        *oldest = entry {k, ++s.Clock};
+    }
+
+    void salted_cache::clear () {
+        for (shard &s : Shards) {
+            std::lock_guard<std::mutex> lock {s.Mutex};
+            for (entry &e : s.Entries) e.Used = 0;
+        }
+
+        Hits.store (0, std::memory_order_relaxed);
+        Misses.store (0, std::memory_order_relaxed);
+    }
+
+}
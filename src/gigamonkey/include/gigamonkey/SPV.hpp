@@ -93,7 +93,9 @@ namespace Gigamonkey::SPV {
 
         // check valid and check that all headers are in our database.
         // and check all scripts for txs that have no merkle proof.
-        bool validate (database &, time_limit genesis_upgrade_time = time_limit::negative_infinity ()) const;
+        // Inputs that are found in the cache are not evaluated again.
+        bool validate (database &, time_limit genesis_upgrade_time = time_limit::negative_infinity (),
+            Bitcoin::script_cache * = nullptr) const;
 
         explicit operator list<extended::transaction> () const;
 
@@ -0,0 +1,84 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_CACHE
+#define GIGAMONKEY_CACHE
+
+#include <gigamonkey/hash.hpp>
+#include <atomic>
+#include <mutex>
+
+namespace Gigamonkey {
+
+    // A set of digests that uses a fixed amount of memory, for remembering
+    // things that have been checked already. Keys should be computed with
+    // a hash that begins with Salt, so that nobody can choose keys that collide.
+    // When the cache is full, the least recently used entry among a small set
+    // of candidates is replaced. The cache is safe to use from several threads
+    // at once.
+    struct salted_cache {
+        constexpr static size_t DEFAULT_SIZE = 32 * 1024 * 1024;
+
+        // a cache using about max_bytes of memory.
+        explicit salted_cache (size_t max_bytes = DEFAULT_SIZE);
+
+        bool contains (const digest256 &key);
+        void insert (const digest256 &key);
+
+        // number of entries that can be stored.
+        size_t capacity () const;
+
+        uint64 hits () const;
+        uint64 misses () const;
+
+        void clear ();
+
+    protected:
+        // random bytes chosen when the cache is constructed.
+        digest256 Salt;
+
+    private:
+        struct entry {
+            digest256 Key;
+            // when the entry was last used; 0 for an empty entry.
+            uint64 Used;
+        };
+
+        // entries that may hold a given key. Entries are
+        // evicted from a set in least recently used order.
+        constexpr static size_t WAYS = 8;
+
+        // sets are divided among shards that are locked separately.
+        constexpr static size_t SHARDS = 16;
+
+        struct shard {
+            std::mutex Mutex;
+            std::vector<entry> Entries;
+            uint64 Clock;
+        };
+
+        size_t Sets;
+        std::array<shard, SHARDS> Shards;
+
+        std::atomic<uint64> Hits;
+        std::atomic<uint64> Misses;
+
+        shard &shard_of (const digest256 &key);
+        size_t set_of (const digest256 &key) const;
+    };
+
+    size_t inline salted_cache::capacity () const {
+        return Sets * WAYS * SHARDS;
+    }
+
+    uint64 inline salted_cache::hits () const {
+        return Hits.load (std::memory_order_relaxed);
+    }
+
+    uint64 inline salted_cache::misses () const {
+        return Misses.load (std::memory_order_relaxed);
+    }
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 #define GIGAMONKEY_HASH
 
 #include "types.hpp"
+#include "sha256.hpp"
 #include <data/crypto/hash.hpp>
 
 namespace Gigamonkey {
@@ -51,6 +52,11 @@ namespace Gigamonkey {
     digest160 RIPEMD_160 (string_view);
 
     digest256 double_SHA2_256 (slice<const byte> b);
+
+    // hash many messages at once, which is fastest when they
+    // all have the same length. out must be the same size as in.
+    void SHA2_256_batch (std::span<const slice<const byte>> in, std::span<digest256> out);
+    void double_SHA2_256_batch (std::span<const slice<const byte>> in, std::span<digest256> out);
 }
     
 namespace Gigamonkey::Bitcoin {
@@ -66,6 +72,10 @@ namespace Gigamonkey::Bitcoin {
 
     digest160 Hash160 (string_view b);
     digest256 Hash256 (string_view b);
+
+    void inline Hash256_batch (std::span<const slice<const byte>> in, std::span<digest256> out) {
+        double_SHA2_256_batch (in, out);
+    }
         
     digest160 inline address_hash (slice<const byte> b) {
         return Hash160 (b);
@@ -102,7 +112,15 @@ namespace Gigamonkey::Bitcoin {
 namespace Gigamonkey {
 
     digest256 inline double_SHA2_256 (slice<const byte> b) {
-        return crypto::SHA2_256 (SHA2_256 (b));
+        return sha256::double_hash (b);
+    }
+
+    void inline SHA2_256_batch (std::span<const slice<const byte>> in, std::span<digest256> out) {
+        sha256::hash (in, out);
+    }
+
+    void inline double_SHA2_256_batch (std::span<const slice<const byte>> in, std::span<digest256> out) {
+        sha256::double_hash (in, out);
     }
 
     template <size_t size>
@@ -133,7 +151,7 @@ namespace Gigamonkey {
     }
 
     digest256 inline SHA2_256 (slice<const byte> b) {
-        return crypto::SHA2_256 (b);
+        return sha256::hash (b);
     }
 
     digest160 inline SHA1 (slice<const byte> b) {
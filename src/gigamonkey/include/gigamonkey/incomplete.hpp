@@ -5,6 +5,7 @@
 #define GIGAMONKEY_INCOMPLETE
 
 #include <gigamonkey/timechain.hpp>
+#include <atomic>
 
 // incomplete types are used to construct the signature hash in Bitcoin transactions. 
 // this is necessary because the input script is not known before it is created.
@@ -56,11 +57,17 @@ namespace Gigamonkey::Bitcoin::incomplete {
         const digest256 &hash_sequence ();
         const digest256 &hash_outputs ();
 
+        // values are computed when they are first needed. Several threads
+        // may do this at once; only the first value to be stored is kept.
+        // A copy of a transaction starts with nothing cached.
         struct cached {
+            cached () {}
+            cached (const cached &) {}
+
             ~cached () {
-                delete HashPrevouts;
-                delete HashSequence;
-                delete HashOutputs;
+                delete HashPrevouts.load ();
+                delete HashSequence.load ();
+                delete HashOutputs.load ();
             }
 
             static const digest256 &zero () {
@@ -68,9 +75,11 @@ namespace Gigamonkey::Bitcoin::incomplete {
                 return Zero;
             }
 
-            digest256 *HashPrevouts {nullptr};
-            digest256 *HashSequence {nullptr};
-            digest256 *HashOutputs {nullptr};
+            template <typename F> static const digest256 &get (std::atomic<digest256 *> &, F compute);
+
+            std::atomic<digest256 *> HashPrevouts {nullptr};
+            std::atomic<digest256 *> HashSequence {nullptr};
+            std::atomic<digest256 *> HashOutputs {nullptr};
         };
 
     private:
@@ -80,6 +89,17 @@ namespace Gigamonkey::Bitcoin::incomplete {
     std::ostream &operator << (std::ostream &, const input &);
     std::ostream &operator << (std::ostream &, const transaction &);
     
+    template <typename F> const digest256 inline &transaction::cached::get (std::atomic<digest256 *> &x, F compute) {
+        digest256 *d = x.load (std::memory_order_acquire);
+        if (d != nullptr) return *d;
+
+        digest256 *n = new digest256 {compute ()};
+        if (x.compare_exchange_strong (d, n, std::memory_order_acq_rel)) return *n;
+
+        delete n;
+        return *d;
+    }
+
     std::ostream inline &operator << (std::ostream &o, const input &i) {
         return o << "input {" << i.Reference << ", ___, " << i.Sequence << "}";
     }
@@ -45,6 +45,11 @@ namespace Gigamonkey::Merkle {
 
         digest256 root () const;
 
+        // the roots of many BUMPs, computed together so that each level
+        // of all of them is hashed in one batch. The root of an invalid
+        // BUMP is an invalid digest.
+        static std::vector<digest256> roots (std::span<const BUMP>);
+
         byte depth () const;
 
         // how big will this be in the binary representation?
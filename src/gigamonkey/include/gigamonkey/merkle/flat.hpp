@@ -0,0 +1,88 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_MERKLE_FLAT
+#define GIGAMONKEY_MERKLE_FLAT
+
+#include <gigamonkey/merkle/proof.hpp>
+
+namespace Gigamonkey::Merkle {
+
+    struct tree;
+    struct dual;
+    class server;
+
+    // a Merkle tree stored as a vector of digests for each level, starting
+    // with the leaves and ending with the root. The last digest in a level
+    // with an odd number of them is paired with itself to make the next level.
+    // Each level is hashed in batches, on several threads for big trees.
+    //
+    // Leaves can be added, replaced, and removed from the end, which only
+    // rehashes the digests above the leaf. This is for a block template that
+    // grows as transactions come in, with the coinbase at index 0.
+    struct flat_tree final {
+        std::vector<std::vector<digest>> Levels;
+
+        flat_tree () : Levels {} {}
+
+        // big trees are hashed on the shared thread_pool. threads = 0 means every
+        // thread in it.
+        explicit flat_tree (std::vector<digest> leaves, uint32 threads = 0);
+        explicit flat_tree (leaf_digests, uint32 threads = 0);
+
+        explicit flat_tree (const tree &);
+        explicit flat_tree (const server &);
+
+        // a dual can only be made into a flat tree if it has every leaf.
+        // Otherwise the result is empty.
+        explicit flat_tree (const dual &);
+
+        uint32 width () const;
+        uint32 height () const;
+
+        digest root () const;
+
+        bool valid () const;
+
+        // the proof for the leaf at index i, or an invalid proof if there is none.
+        proof operator [] (uint32 i) const;
+
+        // the path for the leaf at index i. path (0) is the coinbase path,
+        // which does not depend on the coinbase. Throws std::out_of_range
+        // if there is no leaf at i.
+        Merkle::path path (uint32 i) const;
+
+        // these do one hash for each level of the tree. replace and
+        // remove_last throw std::out_of_range if there is no such leaf.
+        flat_tree &append (const digest &);
+        flat_tree &replace (uint32 i, const digest &);
+        flat_tree &remove_last ();
+
+        list<proof> proofs () const;
+
+        explicit operator tree () const;
+        explicit operator server () const;
+        explicit operator dual () const;
+
+        bool operator == (const flat_tree &) const = default;
+
+    private:
+        // recompute the digests above the leaf at index i.
+        void rehash (uint32 i);
+    };
+
+    inline uint32 flat_tree::width () const {
+        return Levels.size () == 0 ? 0 : Levels[0].size ();
+    }
+
+    inline uint32 flat_tree::height () const {
+        return Levels.size ();
+    }
+
+    inline digest flat_tree::root () const {
+        return Levels.size () == 0 ? digest {} : Levels.back ()[0];
+    }
+
+}
+
+#endif
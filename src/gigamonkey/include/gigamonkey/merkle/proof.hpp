@@ -12,8 +12,14 @@ namespace Gigamonkey::Merkle {
     
     // the function that is used to compute successive nodes in the Merkle tree. 
     inline digest hash_concatinated (const digest &a, const digest &b) {
-        return Bitcoin::Hash256 (write (64, a, b));
+        std::array<byte, 64> x;
+        std::copy (a.begin (), a.end (), x.data ());
+        std::copy (b.begin (), b.end (), x.data () + 32);
+        return sha256::double_hash_64 (x.data ());
     }
+
+    // hash many concatinated pairs at once. out must be the same size as pairs.
+    void hash_concatinated (std::span<const std::array<byte, 64>> pairs, std::span<digest> out);
     
     // all hashes for the leaves of a given tree in order starting from zero.
     using leaf_digests = list<digest>;
@@ -48,6 +54,12 @@ namespace Gigamonkey::Merkle {
     std::weak_ordering operator <=> (const branch &a, const branch &b);
     std::ostream &operator << (std::ostream &o, const branch &p);
     
+    // check many branches against one root. Each node above the leaves is
+    // computed once even if it is in several branches, and the nodes on
+    // each level are hashed together. Returns the positions of the branches
+    // that do not lead to the root.
+    list<uint32> failed (std::span<const branch>, const digest &root);
+    
     // proof has a branch and the root hash. 
     struct proof;
     
@@ -9,13 +9,28 @@
 namespace Gigamonkey::Merkle {
     
     struct tree;
+    struct flat_tree;
+    struct BUMP;
     
     // for serving branches. Would be on a miner's computer. 
     class server final {
         cross<digest> Digests;
-        data::map<digest, uint32> Indices;
+
+        // an open-addressing hash table from leaf digests to their
+        // indices plus one, so that zero means an empty slot.
+        std::vector<uint32> Index;
+
+        // a random key for the hash of the table. Txids can be ground
+        // to collide in any bits that we would use without it.
+        std::array<uint64, 5> Seed;
         
-        server () : Digests {}, Indices {}, Width {0}, Height {0} {}
+        server () : Digests {}, Index {}, Seed {}, Width {0}, Height {0} {}
+        friend struct flat_tree;
+
+        void make_index ();
+
+        // the index of a leaf plus one, or zero if it is not in the tree.
+        uint32 find (const digest &) const;
         
     public:
         uint32 Width;
@@ -31,6 +46,12 @@ namespace Gigamonkey::Merkle {
         list<proof> proofs () const;
         
         proof operator [] (const digest &d) const;
+
+        // proofs for many leaves at once, read from the tree a level at a
+        // time. Nodes that the proofs have in common appear once and nodes
+        // that can be computed from others are left out. The result is
+        // invalid if any of the digests is not in the tree.
+        BUMP prove (uint64 block_height, std::span<const digest>) const;
         
         bool operator == (const server &s) const;
     };
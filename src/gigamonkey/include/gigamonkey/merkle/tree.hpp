@@ -10,6 +10,7 @@ namespace Gigamonkey::Merkle {
     
     struct dual;
     class server;
+    struct flat_tree;
     
     struct tree final : data::tree<digest> {
         uint32 Width;
@@ -32,6 +33,7 @@ namespace Gigamonkey::Merkle {
     private:
         tree (data::tree<digest> t, uint32 w, uint32 h) : data::tree<digest> {t}, Width {w}, Height {h} {}
         friend class server;
+        friend struct flat_tree;
     };
     
     inline digest root (const tree t) {
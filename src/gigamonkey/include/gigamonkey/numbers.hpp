@@ -24,6 +24,14 @@ namespace Gigamonkey::Bitcoin {
 
     const integer &read_integer (const bytes &span, bool RequireMinimal, const size_t nMaxNumSize = MAXIMUM_ELEMENT_SIZE);
 
+    // Almost all numbers in scripts fit in 64 bits, so we can do arithmetic
+    // on them without using integer. read_int64 returns false if the number
+    // is longer than 8 bytes. It does not check for minimal encoding.
+    bool read_int64 (byte_slice, int64 &);
+
+    // write a number in minimal form, which takes up to 9 bytes.
+    byte_slice write_int64 (int64, std::array<byte, 9> &);
+
     // concatinate, implements OP_CAT
     integer cat (byte_slice, byte_slice);
     data::string cat (string_view, string_view);
@@ -155,6 +163,37 @@ namespace Gigamonkey::Bitcoin {
         return static_cast<const integer &> (span);
     }
 
+    bool inline read_int64 (byte_slice b, int64 &x) {
+        size_t n = b.size ();
+        if (n > 8) return false;
+
+        uint64 u = 0;
+        for (size_t i = 0; i < n; i++) u |= uint64 (b[i]) << (8 * i);
+
+        // the magnitude is less than 2^63 so this can't overflow.
+        uint64 sign = n == 0 ? 0 : uint64 (0x80) << (8 * (n - 1));
+        x = u & sign ? -int64 (u & ~sign) : int64 (u);
+        return true;
+    }
+
+    byte_slice inline write_int64 (int64 x, std::array<byte, 9> &b) {
+        bool negative = x < 0;
+        uint64 u = negative ? uint64 (0) - uint64 (x) : uint64 (x);
+
+        size_t n = 0;
+        while (u > 0) {
+            b[n++] = byte (u & 0xff);
+            u >>= 8;
+        }
+
+        if (n > 0) {
+            if (b[n - 1] & 0x80) b[n++] = negative ? 0x80 : 0x00;
+            else if (negative) b[n - 1] |= 0x80;
+        }
+
+        return byte_slice {b.data (), n};
+    }
+
     bool inline is_minimal_number (byte_slice span) {
         return data::arithmetic::is_minimal<data::endian::little, data::arithmetic::negativity::BC, byte> (span);
     }
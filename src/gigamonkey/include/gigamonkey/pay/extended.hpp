@@ -6,6 +6,7 @@
 
 #include <gigamonkey/incomplete.hpp>
 #include <gigamonkey/script.hpp>
+#include <gigamonkey/script/cache.hpp>
 
 // the format that is returned when we construct a new transaction is described in
 // https://bitcoin-sv.github.io/arc/#/BIP-239
@@ -55,11 +56,25 @@ namespace Gigamonkey::extended {
         // evaluate script without signature operations.
         Bitcoin::result evaluate (Bitcoin::flag flags = Bitcoin::genesis_profile ());
 
-        // Evaluate script with real signature operations.
+        // Evaluate script with real signature operations. If the transaction
+        // has several inputs, pass the same precomputed data for each so that
+        // it is only computed once.
         Bitcoin::result evaluate (
             Bitcoin::incomplete::transaction &,
             uint32 input_index,
-            Bitcoin::flag flags = Bitcoin::genesis_profile ()) const;
+            Bitcoin::flag flags = Bitcoin::genesis_profile (),
+            const Bitcoin::sighash::precomputed * = nullptr) const;
+
+        // The script is not run if the cache says that it is valid. spending
+        // is a digest of the incomplete transaction, such as Hash256 (bytes (tx)),
+        // which should be computed once for all the inputs of the transaction.
+        Bitcoin::result evaluate (
+            Bitcoin::incomplete::transaction &,
+            uint32 input_index,
+            Bitcoin::script_cache &,
+            const digest256 &spending,
+            Bitcoin::flag flags = Bitcoin::genesis_profile (),
+            const Bitcoin::sighash::precomputed * = nullptr) const;
 
     };
 
@@ -154,11 +169,6 @@ namespace Gigamonkey::extended {
         return Bitcoin::evaluate (this->Script, Prevout.Script, flags);
     }
 
-    Bitcoin::result inline input::evaluate (Bitcoin::incomplete::transaction &tx, uint32 input_index, Bitcoin::flag flags) const {
-        return Bitcoin::evaluate (this->Script, Prevout.Script,
-            Bitcoin::redemption_document {tx, input_index, Prevout.Value}, flags);
-    }
-
     bytes inline input::write () const {
         return bytes (*this);
     }
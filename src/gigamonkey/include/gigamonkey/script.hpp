@@ -66,8 +66,12 @@ namespace Gigamonkey::Bitcoin {
 
         satoshi RedeemedValue;
 
-        redemption_document (incomplete::transaction &tx, index x, satoshi v):
-            Transaction {tx}, InputIndex {x}, RedeemedValue {v} {}
+        // if provided, must have been computed from Transaction. It can be
+        // shared by the documents for every input of the transaction.
+        const sighash::precomputed *Precomputed;
+
+        redemption_document (incomplete::transaction &tx, index x, satoshi v, const sighash::precomputed *p = nullptr):
+            Transaction {tx}, InputIndex {x}, RedeemedValue {v}, Precomputed {p} {}
         
         // holdovers from Bitcoin Core. 
         bool check_locktime (const uint32_little &) const;
@@ -75,7 +79,14 @@ namespace Gigamonkey::Bitcoin {
     };
 
     // the signature verification algorithm used by the script interpreter.
-    result verify_signature (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc, flag flags);
+    // If a cache is provided, it is checked before the signature is
+    // verified and the signature is added to it if it is valid.
+    result verify_signature (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc, flag flags,
+        signature_cache * = nullptr);
+
+    // the checks on the format of the signature and public key that
+    // verify_signature makes before it checks the signature itself.
+    ScriptError check_signature_encoding (slice<const byte> sig, slice<const byte> pub, flag flags);
 
     // depricated script type that is supported for backwards compatibilty.
     bool is_P2SH (slice<const byte>);
@@ -0,0 +1,217 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_BYTECODE
+#define GIGAMONKEY_SCRIPT_BYTECODE
+
+#include <gigamonkey/script/instruction.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // A script that has been decoded once into a flat array of operations
+    // so that the machine can run it without parsing it again on every step.
+    struct bytecode {
+
+        // op codes are sorted into a few classes that are
+        // handled differently by the machine.
+        enum class op_class : byte {
+            // OP_0 through OP_PUSHDATA4
+            push_data,
+            // OP_1NEGATE and OP_1 through OP_16
+            push_value,
+            // OP_IF, OP_NOTIF, OP_ELSE, OP_ENDIF
+            conditional,
+            code_separator,
+            other
+        };
+
+        static op_class classify (op);
+
+        struct operation {
+            op Op;
+            op_class Class;
+
+            // start of the instruction in the script.
+            uint32 Begin;
+
+            // start of the push data, if any.
+            uint32 Data;
+
+            // end of the instruction.
+            uint32 End;
+
+            // for OP_IF, OP_NOTIF and OP_ELSE, the index of the matching
+            // OP_ELSE or OP_ENDIF, or the number of operations if there
+            // is no match. For everything else, the next index.
+            uint32 Jump;
+
+            // number of operations before this one that count
+            // toward the limit on operations per script.
+            uint32 Count;
+
+            // for OP_IF, OP_NOTIF and OP_ELSE, whether the branch up to Jump
+            // can be passed over in one step when it is not executed. This is
+            // not true if the branch contains anything that could cause an
+            // error when not executed, such as OP_VERIF or a repeated OP_ELSE.
+            bool Skip;
+        };
+
+        bytes Script;
+        std::vector<operation> Operations;
+
+        bytecode () : Script {}, Operations {} {}
+
+        // throws invalid_program under the same conditions as decompile.
+        explicit bytecode (slice<const byte>);
+
+        size_t size () const;
+
+        slice<const byte> code (const operation &) const;
+        slice<const byte> push_data (const operation &) const;
+
+        // a position in a bytecode, which also tracks the
+        // last code separator for signature operations.
+        struct counter;
+
+    private:
+        // recompute jump targets after operations have been added.
+        void link ();
+
+        friend bytecode full (const bytecode &unlock, const bytecode &lock, bool support_p2sh);
+    };
+
+    // make the full program from the two scripts, as with full for program.
+    bytecode full (const bytecode &unlock, const bytecode &lock, bool support_p2sh);
+
+    bool is_push (const bytecode &);
+
+    bool is_P2SH (const bytecode &);
+
+    // check flags that can be checked without running the program.
+    ScriptError pre_verify (const bytecode &, flag flags);
+
+    program decompile (const bytecode &);
+
+    struct bytecode::counter {
+        const bytecode *Code;
+
+        // if the counter shares ownership of the bytecode, large
+        // pushes can refer to the script instead of copying it.
+        ptr<const bytecode> Owner;
+
+        // index of the next operation.
+        uint32 Index;
+
+        // position in the script following the last
+        // OP_CODESEPARATOR that was executed.
+        uint32 LastCodeSeparator;
+
+        counter () : Code {nullptr}, Owner {}, Index {0}, LastCodeSeparator {0} {}
+        counter (const bytecode &b) : Code {&b}, Owner {}, Index {0}, LastCodeSeparator {0} {}
+        counter (ptr<const bytecode> b) : Code {b.get ()}, Owner {b}, Index {0}, LastCodeSeparator {0} {}
+
+        bool done () const;
+
+        const operation &operator * () const;
+        const operation *operator -> () const;
+
+        slice<const byte> push_data () const;
+
+        // the script, if it is owned by the counter.
+        ptr<const bytes> script () const;
+
+        // the part of the script that will be signed.
+        slice<const byte> script_code () const;
+        flat_program to_last_code_separator () const;
+
+        // everything that has not yet been run.
+        slice<const byte> unread () const;
+
+        counter &operator ++ ();
+
+        // go to the matching OP_ELSE or OP_ENDIF and return the number
+        // of operations passed over that count toward the op limit.
+        uint32 skip ();
+    };
+
+    bytecode::op_class inline bytecode::classify (op o) {
+        if (o <= OP_PUSHDATA4) return op_class::push_data;
+        if (o == OP_1NEGATE || (o >= OP_1 && o <= OP_16)) return op_class::push_value;
+        if (o == OP_IF || o == OP_NOTIF || o == OP_ELSE || o == OP_ENDIF) return op_class::conditional;
+        if (o == OP_CODESEPARATOR) return op_class::code_separator;
+        return op_class::other;
+    }
+
+    size_t inline bytecode::size () const {
+        return Operations.size ();
+    }
+
+    slice<const byte> inline bytecode::code (const operation &x) const {
+        return slice<const byte> {Script.data () + x.Begin, size_t (x.End - x.Begin)};
+    }
+
+    slice<const byte> inline bytecode::push_data (const operation &x) const {
+        return slice<const byte> {Script.data () + x.Data, size_t (x.End - x.Data)};
+    }
+
+    bool inline is_P2SH (const bytecode &b) {
+        return is_P2SH (slice<const byte> (b.Script));
+    }
+
+    bool inline is_push (const bytecode &b) {
+        for (const bytecode::operation &x : b.Operations) if (!is_push (x.Op)) return false;
+        return true;
+    }
+
+    program inline decompile (const bytecode &b) {
+        return decompile (slice<const byte> (b.Script));
+    }
+
+    bool inline bytecode::counter::done () const {
+        return Index >= Code->Operations.size ();
+    }
+
+    const bytecode::operation inline &bytecode::counter::operator * () const {
+        return Code->Operations[Index];
+    }
+
+    const bytecode::operation inline *bytecode::counter::operator -> () const {
+        return &Code->Operations[Index];
+    }
+
+    slice<const byte> inline bytecode::counter::push_data () const {
+        return Code->push_data (Code->Operations[Index]);
+    }
+
+    ptr<const bytes> inline bytecode::counter::script () const {
+        if (Owner == nullptr) return nullptr;
+        return ptr<const bytes> {Owner, &Owner->Script};
+    }
+
+    slice<const byte> inline bytecode::counter::script_code () const {
+        return slice<const byte> {Code->Script.data () + LastCodeSeparator, Code->Script.size () - LastCodeSeparator};
+    }
+
+    flat_program inline bytecode::counter::to_last_code_separator () const {
+        return flat_program {script_code ()};
+    }
+
+    slice<const byte> inline bytecode::counter::unread () const {
+        size_t begin = done () ? Code->Script.size () : Code->Operations[Index].Begin;
+        return slice<const byte> {Code->Script.data () + begin, Code->Script.size () - begin};
+    }
+
+    bytecode::counter inline &bytecode::counter::operator ++ () {
+        Index++;
+        return *this;
+    }
+
+    uint32 inline bytecode::counter::skip () {
+        const operation &x = Code->Operations[Index];
+        uint32 n = Code->Operations[x.Jump].Count - x.Count - 1;
+        Index = x.Jump;
+        return n;
+    }
+}
+
+#endif
@@ -0,0 +1,52 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_CACHE
+#define GIGAMONKEY_SCRIPT_CACHE
+
+#include <gigamonkey/cache.hpp>
+#include <gigamonkey/timechain.hpp>
+#include <gigamonkey/script/config.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // A cache of inputs whose scripts have been evaluated successfully, so
+    // that an input that is checked again under the same script_config (when
+    // an SPV proof is checked again after the payment is confirmed, or when
+    // BEEF payloads share ancestors) need not be evaluated again.
+    //
+    // Entries are keyed by a salted hash of a digest of the spending
+    // transaction, the input index and outpoint, the unlocking script,
+    // the output that is redeemed, and the script_config.
+    struct script_cache : salted_cache {
+        explicit script_cache (size_t max_bytes = DEFAULT_SIZE) : salted_cache {max_bytes} {}
+
+        // tx is a digest that commits to the spending transaction, such as its txid.
+        bool contains (const digest256 &tx, uint32 input_index, const outpoint &,
+            slice<const byte> unlock, const output &prevout, const script_config &);
+
+        // remember that an input is valid.
+        void insert (const digest256 &tx, uint32 input_index, const outpoint &,
+            slice<const byte> unlock, const output &prevout, const script_config &);
+
+        // a cache shared by the whole program.
+        static script_cache &global ();
+
+    private:
+        digest256 key (const digest256 &tx, uint32 input_index, const outpoint &,
+            slice<const byte> unlock, const output &prevout, const script_config &) const;
+    };
+
+    bool inline script_cache::contains (const digest256 &tx, uint32 input_index, const outpoint &o,
+        slice<const byte> unlock, const output &prevout, const script_config &conf) {
+        return salted_cache::contains (key (tx, input_index, o, unlock, prevout, conf));
+    }
+
+    void inline script_cache::insert (const digest256 &tx, uint32 input_index, const outpoint &o,
+        slice<const byte> unlock, const output &prevout, const script_config &conf) {
+        salted_cache::insert (key (tx, input_index, o, unlock, prevout, conf));
+    }
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_CLASSIFIER
+#define GIGAMONKEY_SCRIPT_CLASSIFIER
+
+#include <gigamonkey/script/instruction.hpp>
+
+namespace Gigamonkey {
+
+    // A set of script templates compiled into a single deterministic automaton
+    // that reads a script one instruction at a time. A script is classified in
+    // one pass, without exceptions or allocations, no matter how many templates
+    // there are. Use this instead of pattern when many scripts must be checked
+    // against many templates, such as every output in a block.
+    struct script_classifier {
+        constexpr static uint32 MAX_TEMPLATES = 16;
+        constexpr static uint32 MAX_FIELDS = 8;
+
+        // an element of a template.
+        struct token;
+
+        // a template is a sequence of tokens.
+        using script_template = std::vector<token>;
+
+        // the result of classifying a script.
+        struct match;
+
+        // throws std::invalid_argument if there are too many templates or
+        // fields or if a template is ambiguous, meaning that one instruction
+        // could be matched by more than one of its tokens.
+        explicit script_classifier (const std::vector<script_template> &);
+
+        match classify (slice<const byte>) const;
+
+        // ids of the templates in the standard classifier.
+        enum standard_template : int32 {
+            // fields: address.
+            pay_to_address,
+            // fields: script hash.
+            pay_to_script_hash,
+            // fields: pubkey.
+            pay_to_pubkey,
+            // fields: m, the pubkey pushes, n.
+            multisig,
+            // fields: everything after OP_RETURN.
+            op_return,
+            // fields: miner pubkey hash (empty for a bounty), category, content,
+            // target, tag, user nonce, additional data.
+            boost_pow,
+            boost_pow_asicboost
+        };
+
+        static const script_classifier &standard ();
+
+    private:
+        struct capture {
+            uint16 Template;
+            uint16 Field;
+            // index into Accepts.
+            uint32 Token;
+            bool Repeated;
+        };
+
+        struct rest {
+            uint16 Template;
+            int16 Field;
+        };
+
+        struct state {
+            int32 Accept;
+            uint32 CapturesBegin;
+            uint32 CapturesEnd;
+            uint32 RestBegin;
+            uint32 RestEnd;
+        };
+
+        // pushes of the same size are distinguished if
+        // a template looks for particular data.
+        struct push_class {
+            uint32 Size;
+            // empty if any data of this size belongs to this class.
+            bytes Data;
+            uint32 Symbol;
+        };
+
+        uint32 Templates;
+        std::vector<uint32> Fields;
+
+        // symbols below 256 are op codes that do not push data.
+        // after that come push classes and then other pushes.
+        uint32 Symbols;
+        std::vector<push_class> Classes;
+        uint32 OtherPush;
+
+        // state 0 matches nothing and state 1 is the start.
+        std::vector<state> States;
+        std::vector<uint16> Next;
+        std::vector<capture> Captures;
+        std::vector<rest> Rests;
+
+        // for each capturing token, whether it accepts each symbol.
+        std::vector<bool> Accepts;
+
+        uint32 symbol (slice<const byte> data) const;
+    };
+
+    struct script_classifier::token {
+        enum class kind : byte {op, small_int, push, push_size, push_data, pubkey, code, rest};
+
+        kind Kind;
+        Bitcoin::op Op;
+        uint32 Size;
+        bytes Data;
+        bool Optional;
+        bool Repeated;
+        bool Capture;
+
+        // match an op code that does not push data, or OP_0.
+        token (Bitcoin::op);
+
+        // match a program exactly.
+        token (Bitcoin::program p) : token {code (Bitcoin::compile (p))} {}
+
+        // match an op code from OP_1 to OP_16. Captured.
+        static token small_int ();
+
+        // match any push, including OP_0, OP_1NEGATE and OP_1 to OP_16. Captured.
+        static token push ();
+
+        // match a push of the given size. Captured.
+        static token push_size (uint32);
+
+        // match a push of the given data.
+        static token push_data (slice<const byte>);
+
+        // match a push of 33 or 65 bytes. Captured.
+        static token pubkey ();
+
+        // match a compiled script fragment exactly.
+        static token code (slice<const byte>);
+
+        // match the rest of the script, whether or not it is
+        // a valid program. Captured. Must be the last token.
+        static token rest ();
+
+        token optional () const;
+
+        // match one or more times.
+        token repeated () const;
+
+    private:
+        token (kind k, uint32 size, bytes data, bool capture) :
+            Kind {k}, Op {Bitcoin::OP_INVALIDOPCODE}, Size {size}, Data {data},
+            Optional {false}, Repeated {false}, Capture {capture} {}
+    };
+
+    struct script_classifier::match {
+        // the index of the matching template or -1 if there is none.
+        // if more than one template matches, the lowest index is chosen.
+        int32 Template;
+
+        // captured fields in the order in which they appear in the template.
+        // For a push, the field is the data pushed. A field that was skipped
+        // because it is optional is empty. A repeated field includes the
+        // whole part of the script that was matched, including op codes.
+        std::array<slice<const byte>, MAX_FIELDS> Fields;
+
+        explicit operator bool () const {
+            return Template >= 0;
+        }
+    };
+
+    inline script_classifier::token::token (Bitcoin::op o) :
+        token {kind::op, 0, bytes {}, false} {
+        Op = o;
+    }
+
+    script_classifier::token inline script_classifier::token::small_int () {
+        return token {kind::small_int, 0, bytes {}, true};
+    }
+
+    script_classifier::token inline script_classifier::token::push () {
+        return token {kind::push, 0, bytes {}, true};
+    }
+
+    script_classifier::token inline script_classifier::token::push_size (uint32 size) {
+        return token {kind::push_size, size, bytes {}, true};
+    }
+
+    script_classifier::token inline script_classifier::token::push_data (slice<const byte> data) {
+        return token {kind::push_data, 0, bytes (data), false};
+    }
+
+    script_classifier::token inline script_classifier::token::pubkey () {
+        return token {kind::pubkey, 0, bytes {}, true};
+    }
+
+    script_classifier::token inline script_classifier::token::code (slice<const byte> data) {
+        return token {kind::code, 0, bytes (data), false};
+    }
+
+    script_classifier::token inline script_classifier::token::rest () {
+        return token {kind::rest, 0, bytes {}, true};
+    }
+
+    script_classifier::token inline script_classifier::token::optional () const {
+        token t = *this;
+        t.Optional = true;
+        return t;
+    }
+
+    script_classifier::token inline script_classifier::token::repeated () const {
+        token t = *this;
+        t.Repeated = true;
+        return t;
+    }
+
+}
+
+#endif
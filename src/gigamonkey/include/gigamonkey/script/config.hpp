@@ -17,6 +17,9 @@ static_assert (sizeof (void*) >= 8, "32 bit systems are not supported");
 
 namespace Gigamonkey::Bitcoin {
 
+    struct signature_cache;
+    struct signature_batch;
+
     // note: these flags do not perfectly correspond to the flags used in Bitcoin Core software.
     enum class flag : uint32 {
         VERIFY_NONE = 0,
@@ -188,6 +191,24 @@ namespace Gigamonkey::Bitcoin {
         uint64 MaxScriptNumLength;
         uint64 MaxScriptSize;
 
+        // record statistics about each operation run. This has no effect unless
+        // gigamonkey was built with GIGAMONKEY_SCRIPT_PROFILE. See profile.hpp.
+        bool Profile {false};
+
+        // if set, signatures are looked up here before they are checked
+        // and valid signatures are added. See signature_cache.hpp.
+        signature_cache *SignatureCache {nullptr};
+
+        // check signatures whose result is only needed to decide whether the
+        // script fails all together at the end, on several threads. The result
+        // is the same as if each signature had been checked when it was reached.
+        bool DeferSignatures {false};
+
+        // if set along with DeferSignatures, the deferred signatures of a script
+        // that succeeds are added here to be checked later, so that the signatures
+        // of many inputs are checked together. See signature_batch.hpp.
+        signature_batch *SignatureBatch {nullptr};
+
         // if the flags state that the utxo is before genesis, then
         // consensus doesn't matter.
         script_config (flag flags = genesis_profile (), bool consensus = false);
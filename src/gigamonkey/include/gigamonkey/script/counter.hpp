@@ -24,7 +24,7 @@ namespace Gigamonkey::Bitcoin {
 
         // the script code is the part of the script that gets signed.
         // normally this will be the locking script.
-        program to_last_code_separator () const;
+        flat_program to_last_code_separator () const;
 
         // pre-increment;
         program_counter &operator ++ () {
@@ -53,8 +53,8 @@ namespace Gigamonkey::Bitcoin {
             Next.size () > 0 && Next[0] == OP_CODESEPARATOR ? next_counter : LastCodeSeparator};
     }
 
-    program inline program_counter::to_last_code_separator () const {
-        return decompile (slice<const byte> {Script.data () + LastCodeSeparator, Script.size () - LastCodeSeparator});
+    flat_program inline program_counter::to_last_code_separator () const {
+        return flat_program {slice<const byte> {Script.data () + LastCodeSeparator, Script.size () - LastCodeSeparator}};
     }
 
     inline program_counter::program_counter (slice<const byte> n, slice<const byte> s, size_t c, size_t l) :
@@ -24,7 +24,29 @@ namespace Gigamonkey::Bitcoin {
         return o <= OP_PUSHDATA4;
     }
     
+    // The following functions read a script one instruction at a time
+    // without decompiling it, so they do not allocate or throw.
+
+    // the error that decompile would throw, or SCRIPT_ERR_OK.
+    ScriptError verify_script (slice<const byte>);
+
+    bool inline well_formed (slice<const byte> b) {
+        return verify_script (b) == SCRIPT_ERR_OK;
+    }
+
+    // well formed and consisting only of pushes.
+    bool is_push (slice<const byte>);
+
+    // well formed and every push is minimal.
     bool is_minimal_script (slice<const byte>);
+
+    // the same as pre_verify (decompile (b), flags) except that
+    // the error is returned if the script cannot be decompiled.
+    ScriptError pre_verify (slice<const byte> b, flag flags);
+
+    // 1 for each OP_CHECKSIG and 20 for each OP_CHECKMULTISIG, including
+    // the VERIFY variants. Counting stops if the script is malformed.
+    uint64 sigops (slice<const byte>);
     
     // ASM is a standard human format for Bitcoin scripts that is unique only if the script is minimally encoded. 
     string ASM (slice<const byte>);
@@ -49,6 +71,9 @@ namespace Gigamonkey::Bitcoin {
     instruction push_data (const boost::endian::endian_arithmetic<Order, T, n_bits, Align> &x);
     
     bool is_minimal_instruction (const instruction &);
+
+    // whether the given data is pushed in the smallest way possible with the given op code.
+    bool is_minimal_push (op, slice<const byte> data);
     
     // Representation of a Bitcoin script instruction, which is either an op code
     // by itself or an op code for pushing data to the stack along with data. 
@@ -96,17 +121,71 @@ namespace Gigamonkey::Bitcoin {
     // check flags that can be checked without running the program.
     ScriptError pre_verify (program, flag flags);
 
+    // A program stored as one compiled script along with the position of
+    // each instruction. Instructions can be read by index and a range of
+    // them can be taken without copying, since the script is shared.
+    struct flat_program {
+        flat_program () : Script {}, Offsets {}, Begin {0}, End {0} {}
+
+        // throws invalid_program under the same conditions as decompile.
+        explicit flat_program (slice<const byte>);
+        explicit flat_program (program);
+
+        explicit operator program () const;
+
+        size_t size () const;
+        bool empty () const;
+
+        instruction operator [] (size_t) const;
+
+        // these do not copy the instruction.
+        op op_code (size_t) const;
+        slice<const byte> push_data (size_t) const;
+
+        // the compiled instruction.
+        slice<const byte> code (size_t) const;
+
+        // the compiled program.
+        slice<const byte> script () const;
+
+        // the instructions from begin up to end.
+        flat_program range (size_t begin, size_t end) const;
+        flat_program drop (size_t) const;
+
+        bool operator == (const flat_program &) const;
+
+    private:
+        ptr<const bytes> Script;
+
+        // the position of each instruction in Script followed by the end of the last.
+        ptr<const std::vector<uint32>> Offsets;
+
+        // the range of Offsets that belongs to this program.
+        uint32 Begin;
+        uint32 End;
+
+        flat_program (ptr<const bytes> script, ptr<const std::vector<uint32>> offsets, uint32 begin, uint32 end) :
+            Script {script}, Offsets {offsets}, Begin {begin}, End {end} {}
+
+        friend struct flat_writer;
+    };
+
     // delete the script up to and including the last instance of OP_CODESEPARATOR.
     // if no OP_CODESEPARATOR is found, nothing is removed.
     // this function is needed for correctly checking and generating signatures.
-    program remove_after_last_code_separator (slice<const byte>);
+    flat_program remove_after_last_code_separator (slice<const byte>);
 
     // used in the original sighash algorithm to remove instances of the same
     // signature that might have been used previously in the script.
     program find_and_delete (program script_code, const instruction &sig);
+    flat_program find_and_delete (const flat_program &script_code, const instruction &sig);
 
     // make the full program from the two scripts.
     program full (const program unlock, const program lock, bool support_p2sh);
+    flat_program full (const flat_program &unlock, const flat_program &lock, bool support_p2sh);
+
+    // append an instruction.
+    flat_program operator << (const flat_program &, const instruction &);
 
     // pay to script hash only applies to scripts that were created before genesis.
     bool is_P2SH (const program p);
@@ -119,6 +198,8 @@ namespace Gigamonkey::Bitcoin {
 
     bytes compile (instruction i);
 
+    bytes compile (const flat_program &);
+
     program decompile (slice<const byte>);
 
     // thrown if you try to decompile an invalid program.
@@ -202,9 +283,58 @@ namespace Gigamonkey::Bitcoin {
         return push_data (slice<const byte> (x));
     }
 
-    bool inline is_minimal_script (slice<const byte> b) {
-        for (const instruction &i : decompile (b)) if (!is_minimal_instruction (i)) return false;
-        return true;
+
+    bytes inline compile (const flat_program &p) {
+        return bytes (p.script ());
+    }
+
+    size_t inline flat_program::size () const {
+        return End - Begin;
+    }
+
+    bool inline flat_program::empty () const {
+        return End == Begin;
+    }
+
+    instruction inline flat_program::operator [] (size_t i) const {
+        return instruction::read (code (i));
+    }
+
+    op inline flat_program::op_code (size_t i) const {
+        return op ((*Script)[(*Offsets)[Begin + i]]);
+    }
+
+    slice<const byte> inline flat_program::code (size_t i) const {
+        uint32 begin = (*Offsets)[Begin + i];
+        return slice<const byte> {Script->data () + begin, size_t ((*Offsets)[Begin + i + 1] - begin)};
+    }
+
+    slice<const byte> inline flat_program::push_data (size_t i) const {
+        op o = op_code (i);
+        if (!is_push_data (o)) return {};
+        size_t header = o <= OP_PUSHSIZE75 ? 1 : o == OP_PUSHDATA1 ? 2 : o == OP_PUSHDATA2 ? 3 : 5;
+        return code (i).drop (header);
+    }
+
+    slice<const byte> inline flat_program::script () const {
+        if (empty ()) return {};
+        uint32 begin = (*Offsets)[Begin];
+        return slice<const byte> {Script->data () + begin, size_t ((*Offsets)[End] - begin)};
+    }
+
+    flat_program inline flat_program::range (size_t begin, size_t end) const {
+        if (begin > end || end > size ()) throw std::out_of_range {"flat_program::range"};
+        return flat_program {Script, Offsets, uint32 (Begin + begin), uint32 (Begin + end)};
+    }
+
+    flat_program inline flat_program::drop (size_t n) const {
+        return n >= size () ? flat_program {} : range (n, size ());
+    }
+
+    bool inline flat_program::operator == (const flat_program &p) const {
+        slice<const byte> a = script ();
+        slice<const byte> b = p.script ();
+        return a.size () == b.size () && std::equal (a.begin (), a.end (), b.begin ());
     }
 }
 
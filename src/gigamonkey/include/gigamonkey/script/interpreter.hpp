@@ -11,9 +11,16 @@ namespace Gigamonkey::Bitcoin {
     // a Bitcoin script interpreter that can be advanced step-by-step.
     struct interpreter {
 
-        machine Machine;
-        bytes Script;
-        program_counter Counter;
+        bool Halt;
+        result Result;
+
+        // the kind of machine is chosen once, according to
+        // whether genesis stack limits are enabled.
+        std::variant<machine<true>, machine<false>> Machine;
+
+        // the full program, decoded once before it is run.
+        ptr<bytecode> Code;
+        bytecode::counter Counter;
 
         // If the redemption document is not provided, all signature operations will succeed.
         interpreter (const script &unlock, const script &lock, const redemption_document &doc, const script_config & = {});
@@ -41,8 +48,36 @@ namespace Gigamonkey::Bitcoin {
         return interpreter (unlock, lock, conf).run ();
     }
 
+    // a lock script that has been decoded and checked once so
+    // that many unlock scripts can be evaluated against it.
+    struct lock_script {
+        script Script;
+
+        // null if the script could not be decoded.
+        ptr<const bytecode> Code;
+
+        // the flags that Verified was computed with.
+        flag Flags;
+
+        // the result of pre_verify for the lock script
+        // as it appears after an unlock script.
+        ScriptError Verified;
+
+        explicit lock_script (const script &, const script_config & = {});
+    };
+
+    // evaluate many unlock scripts against the same lock script. The results
+    // are the same as for evaluate. Unlock scripts that contain only pushes,
+    // which is required by policy, are run directly ahead of the lock script
+    // without building the full program, and pushes that begin all of them
+    // are only run once.
+    std::vector<result> evaluate_batch (const std::vector<script> &unlocks, const lock_script &,
+        const redemption_document &, const script_config & = {});
+
+    std::vector<result> evaluate_batch (const std::vector<script> &unlocks, const lock_script &, const script_config & = {});
+
     program inline interpreter::unread () const {
-        return decompile (byte_slice {Counter.Script}.drop (Counter.Counter));
+        return decompile (Counter.unread ());
     }
 
 }
@@ -7,15 +7,16 @@
 #include <gigamonkey/script.hpp>
 #include <gigamonkey/script/stack.hpp>
 #include <gigamonkey/script/counter.hpp>
+#include <gigamonkey/script/bytecode.hpp>
 #include <gigamonkey/script/config.hpp>
+#include <gigamonkey/script/signature_batch.hpp>
 
 namespace Gigamonkey::Bitcoin {
 
     // a Bitcoin script interpreter that can be advanced step-by-step.
-    struct machine {
-
-        bool Halt;
-        result Result;
+    // genesis determines which stack limits are used. It is a template
+    // parameter so that stack operations need no virtual calls.
+    template <bool genesis> struct machine {
 
         script_config Config;
 
@@ -24,26 +25,67 @@ namespace Gigamonkey::Bitcoin {
             
         maybe<redemption_document> Document;
             
-        ptr<two_stack> Stack;
+        limited_two_stack<genesis> Stack;
             
         cross<bool> Exec;
         cross<bool> Else;
 
+        // number of false values in Exec, so that we
+        // know in one step whether an op is executed.
+        size_t NotExecuted;
+
         long OpCount;
 
+        // signature checks that have been put off until the end
+        // of the script. Used if Config.DeferSignatures is set.
+        signature_batch Deferred;
+
         bool increment_operation ();
+
+        // called when we enter a branch that is not executed.
+        maybe<result> skip (bytecode::counter &Counter);
         uint64 max_pubkeys_per_multisig () const;
 
-        maybe<result> step (const program_counter &Counter);
+        // run the next operation and advance the counter. If gigamonkey is
+        // built with GIGAMONKEY_SCRIPT_PROFILE and Config.Profile is set,
+        // statistics about the operation are recorded in profile. If
+        // Config.DeferSignatures is set, see Deferred.
+        maybe<result> step (bytecode::counter &Counter);
+
+        // step without profiling.
+        maybe<result> execute (bytecode::counter &Counter);
+
+        // step without deferred signatures.
+        maybe<result> measure (bytecode::counter &Counter);
 
-        machine (maybe<redemption_document> doc = {}, const script_config &conf = {}):
-            machine (enable_genesis_stack (conf.Flags) ?
-                std::static_pointer_cast<two_stack> (std::make_shared<limited_two_stack<true>> (conf.MaxStackMemoryUsage)) :
-                std::static_pointer_cast<two_stack> (std::make_shared<limited_two_stack<false>> ()), doc, conf) {}
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+        maybe<result> profile_step (bytecode::counter &Counter);
+#endif
+
+        // step, and when the script is done, check any deferred signatures
+        // and correct the result if one is invalid. If Config.SignatureBatch
+        // is set and the script succeeds, the signatures are moved there instead.
+        maybe<result> deferred_step (bytecode::counter &Counter);
+
+        // the failure of the first deferred signature that is invalid.
+        maybe<result> check_deferred ();
 
-        machine (ptr<two_stack>, maybe<redemption_document> doc = {}, const script_config & = {});
+        // whether a signature check can be deferred. This is true when the
+        // script will stop if it is invalid or when the result is left as
+        // the final result of the script.
+        bool deferrable (op, const bytecode::counter &) const;
+
+        machine (maybe<redemption_document> doc = {}, const script_config & = {});
+
+        // a copy of this machine that can be run separately. Large stack
+        // elements are shared between the two rather than copied.
+        machine snapshot ();
     };
 
+    // step is defined in machine.cpp for both modes.
+    extern template struct machine<true>;
+    extern template struct machine<false>;
+
 }
 
 
@@ -0,0 +1,86 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_PROFILE_HPP
+#define GIGAMONKEY_SCRIPT_PROFILE_HPP
+
+#include <gigamonkey/types.hpp>
+#include <gigamonkey/script/opcodes.h>
+#include <data/net/JSON.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // Statistics about the operations run by the script machine.
+    //
+    // Nothing is recorded unless gigamonkey is built with the CMake option
+    // GIGAMONKEY_SCRIPT_PROFILE and the script_config has Profile set.
+    // Without the build option, the machine contains no profiling code.
+    //
+    // Statistics are recorded separately on each thread and
+    // are added together when they are read with total.
+    struct profile {
+        struct opcode {
+            uint64 Count;
+            uint64 Nanoseconds;
+
+            // an estimate of the data handled by the op: the size of its
+            // push data plus the sizes of the top element before and after.
+            uint64 Bytes;
+        };
+
+        std::array<opcode, 256> Opcodes;
+
+        // number of scripts that ran to the end.
+        uint64 Scripts;
+
+        // signature checks, where a multisig counts as the number of keys.
+        uint64 SigOps;
+
+        // ops in branches that were not executed. These are
+        // not counted with the op codes that were run.
+        uint64 Skipped;
+
+        // largest number of elements and of bytes on both stacks together.
+        uint64 MaxStackElements;
+        uint64 MaxStackBytes;
+
+        profile ();
+
+        // combine statistics from another thread.
+        profile &operator += (const profile &);
+
+        bool operator == (const profile &) const;
+
+        // a structured report containing only the op codes that were run.
+        data::JSON report () const;
+
+        // statistics recorded on this thread.
+        static profile local ();
+
+        // statistics recorded on all threads, including threads that have exited.
+        static profile total ();
+
+        // forget everything that has been recorded on all threads.
+        static void reset ();
+
+        // called by the machine.
+        static void record (op, uint64 nanoseconds, uint64 bytes);
+        static void record_stack (uint64 elements, uint64 bytes);
+        static void record_sigops (uint64);
+        static void record_skipped ();
+        static void record_script ();
+    };
+
+    bool inline profile::operator == (const profile &p) const {
+        for (int i = 0; i < 256; i++)
+            if (Opcodes[i].Count != p.Opcodes[i].Count ||
+                Opcodes[i].Nanoseconds != p.Opcodes[i].Nanoseconds ||
+                Opcodes[i].Bytes != p.Opcodes[i].Bytes) return false;
+
+        return Scripts == p.Scripts && SigOps == p.SigOps && Skipped == p.Skipped &&
+            MaxStackElements == p.MaxStackElements && MaxStackBytes == p.MaxStackBytes;
+    }
+
+}
+
+#endif
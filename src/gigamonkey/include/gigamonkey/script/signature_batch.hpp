@@ -0,0 +1,65 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_SIGNATURE_BATCH
+#define GIGAMONKEY_SCRIPT_SIGNATURE_BATCH
+
+#include <gigamonkey/script.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // Signature checks that have been put off so that they can be verified
+    // together on the threads of thread_pool::global (). The script machine
+    // keeps one for each script when script_config::DeferSignatures is set.
+    //
+    // To check the signatures of all the inputs of a transaction together,
+    // set script_config::SignatureBatch as well. A script whose only problem
+    // could be an invalid deferred signature then returns success and leaves
+    // its signatures in the batch, so none of those scripts are known to be
+    // valid until check has been called. A batch should be used by one thread.
+    struct signature_batch {
+        struct job {
+            digest256 Digest;
+            bytes Pubkey;
+            bytes Signature;
+
+            // the result of the script if the signature is invalid.
+            result Failure;
+
+            // the input whose script the signature is from.
+            uint32 InputIndex;
+        };
+
+        std::vector<job> Jobs;
+
+        signature_batch () : Jobs {} {}
+
+        size_t size () const;
+        bool empty () const;
+
+        // check the format of a signature and add it unless it is in the cache.
+        // failure is the result of the script if the signature is invalid.
+        // Returns an error if the format is wrong and true otherwise.
+        result add (slice<const byte> sig, slice<const byte> pub, const sighash::document &,
+            flag, signature_cache *, const result &failure, uint32 input_index);
+
+        // move the jobs from another batch to the end of this one.
+        signature_batch &operator += (signature_batch &&);
+
+        // verify all the signatures and empty the batch. Valid signatures
+        // are added to the cache if one is provided. If any is invalid,
+        // the first invalid job in the batch is returned.
+        maybe<job> check (signature_cache * = nullptr, uint32 threads = 0);
+    };
+
+    size_t inline signature_batch::size () const {
+        return Jobs.size ();
+    }
+
+    bool inline signature_batch::empty () const {
+        return Jobs.empty ();
+    }
+
+}
+
+#endif
@@ -36,54 +36,142 @@ namespace Gigamonkey::Bitcoin {
     // estimate of the amount of memory used by the stack.
     template <bool genesis> struct limited_two_stack;
 
+    // An element of the stack. Small elements are always kept in one buffer.
+    // Large elements may instead be made of pieces of buffers that are shared
+    // with other elements or with the script, so that copying, splitting and
+    // concatenating them does not copy their data. An element is flattened
+    // into one buffer when an operation needs its bytes.
+    struct element {
+        // part of a buffer that may be shared.
+        struct piece {
+            ptr<const bytes> Buffer;
+            size_t Begin;
+            size_t Size;
+        };
+
+        // elements smaller than this are always flat.
+        static constexpr size_t LARGE_ELEMENT_SIZE = 1024;
+
+        // an element with more pieces than this is flattened.
+        static constexpr size_t MAX_PIECES = 256;
+
+        element () : Value {}, Pieces {}, Size {0} {}
+        element (integer &&x) : Value {std::move (x)}, Pieces {}, Size {0} {}
+        element (std::vector<piece> &&p, size_t size) : Value {}, Pieces {std::move (p)}, Size {size} {}
+
+        size_t size () const;
+        bool flat () const;
+
+        // copy the pieces into one buffer if necessary.
+        integer &flatten ();
+        const integer &flatten () const;
+
+        // copy bytes from begin to begin + size into out.
+        void read (size_t begin, size_t size, byte *out) const;
+
+        // pieces covering the bytes from begin to begin + size. A flat
+        // element is moved into a shared buffer first.
+        std::vector<piece> share (size_t begin, size_t size);
+
+        // add the pieces of x to the end of this element.
+        void append (element &x);
+
+    private:
+        // the contents of a flat element.
+        mutable integer Value;
+
+        // the contents of an element that is not flat.
+        mutable std::vector<piece> Pieces;
+        size_t Size;
+
+        friend struct two_stack;
+    };
+
+    std::ostream inline &operator << (std::ostream &, const element &);
+
     struct two_stack {
     protected:
-        cross<integer> Stack;
-        cross<integer> AltStack;
+        cross<element> Stack;
+        cross<element> AltStack;
+
+        // buffers of elements that have been removed from the stack. They are
+        // reused for new elements so that an evaluation rarely needs to allocate
+        // once it has warmed up. They are all freed along with the stack.
+        cross<integer> Spare;
+
+        // new buffers are never smaller than this, so that a small
+        // buffer can be reused for any other small element.
+        static constexpr size_t SMALL_ELEMENT_SIZE = 32;
+
+        // memory limits count the size of an element, not the capacity of its
+        // buffer, so only buffers smaller than a large element are kept, and
+        // only this many of them.
+        static constexpr size_t MAX_SPARE_BUFFERS = 64;
+
+        // the number of elements that the stack has room for before it grows.
+        static constexpr size_t INITIAL_STACK_DEPTH = 32;
+
+        // make an element containing the given bytes, reusing a spare buffer if there is one.
+        integer make (slice<const byte>);
+
+        // make an element of the given size whose contents are undefined.
+        integer make (size_t);
+
+        // keep the buffer of an element that is being removed.
+        void recycle (element &);
+
+        // an element containing the bytes of x from begin to begin + size.
+        // Large elements share their data with x.
+        element part (element &x, size_t begin, size_t size);
+
+        // concatenate the top two elements.
+        void join ();
+
+        // replace the top element with the bytes from begin to begin + size
+        // and push the rest of it after that.
+        void divide (size_t position);
+
     public:
+        two_stack ();
 
         // Warning: returned reference is invalidated if stack is modified.
         bytes &top (int index = -1);
 
         const bytes &at (uint64_t i) const;
 
+        // size of an element, which does not require it to be flattened.
+        size_t top_size (int index = -1) const;
+
         size_t size () const;
         size_t alt_size () const;
         size_t combined_size () const;
         bool empty () const;
 
-        virtual void pop_back () = 0;
-        virtual void push_back (slice<const byte>) = 0;
+        // number of bytes in all elements of both stacks.
+        uint64 combined_data_size () const;
 
-        // erase elements from including (top - first). element until excluding (top - last). element
-        // first and last should be negative numbers (distance from the top)
-        virtual void erase (int first, int last) = 0;
+        // move large elements into shared buffers so that a copy of the
+        // stack refers to their data rather than copying it. An element is
+        // copied when it is changed, so a copy never changes the original.
+        // Spare buffers are freed since a copy would not need them.
+        void share ();
 
-        // index should be negative number (distance from the top)
-        virtual void erase (int index) = 0;
-
-        // position should be negative number (distance from the top)
-        virtual void insert (int position, slice<const byte>) = 0;
+        // operations that change the size of the stack are provided
+        // by limited_two_stack, which is not polymorphic so that they
+        // can be inlined into the machine.
 
         void to_alt ();
         void from_alt ();
 
         void swap (size_t index1, size_t index2);
 
-        virtual void modify_top (std::function<void (bytes &)>, int index = -1) = 0;
-
-        void replace_back (const bytes &element) {
-            modify_top ([&element] (bytes &val) {
-                val = element;
-            });
-        }
-
-        typename std::vector<integer>::const_iterator begin () const;
-        typename std::vector<integer>::const_iterator end () const;
-        typename std::vector<integer>::iterator begin ();
-        typename std::vector<integer>::iterator end ();
+        // move the element at index (a negative number) to the top.
+        void roll (int index);
 
-        virtual ~two_stack () {}
+        typename std::vector<element>::const_iterator begin () const;
+        typename std::vector<element>::const_iterator end () const;
+        typename std::vector<element>::iterator begin ();
+        typename std::vector<element>::iterator end ();
 
         friend std::ostream inline &operator << (std::ostream &o, const two_stack &i) {
             return o << std::hex << "{Stack: " << i.Stack << ", AltStack: " << i.AltStack << "}";
@@ -100,20 +188,38 @@ namespace Gigamonkey::Bitcoin {
 
         bool valid () const;
 
-        void pop_back () override;
-        void push_back (slice<const byte>) override;
+        void pop_back ();
+        void push_back (slice<const byte>);
 
         // erase elements from including (top - first). element until excluding (top - last). element
         // first and last should be negative numbers (distance from the top)
-        void erase (int first, int last) override;
+        void erase (int first, int last);
 
         // index should be negative number (distance from the top)
-        void erase (int index) override;
+        void erase (int index);
 
         // position should be negative number (distance from the top)
-        void insert (int position, slice<const byte>) override;
+        void insert (int position, slice<const byte>);
+
+        // push a view of a buffer that the element may share.
+        void push_back (const ptr<const bytes> &buffer, slice<const byte>);
+
+        // push a copy of the element at index (a negative number).
+        void copy_back (int index);
+
+        // (x1 x2 -- x1x2)
+        void cat ();
 
-        void modify_top (std::function<void (bytes &)> f, int index = -1) override;
+        // (x -- x1 x2) where x1 is the first position bytes of x.
+        void split (size_t position);
+
+        // replace the top element with the bytes from begin to begin + size.
+        void substring (size_t begin, size_t size);
+
+        // f is called with a reference to the element, which it may change.
+        template <typename F> void modify_top (F f, int index = -1);
+
+        void replace_back (const bytes &element);
 
     };
 
@@ -135,20 +241,38 @@ namespace Gigamonkey::Bitcoin {
         void increase_memory_usage (uint64_t additionalSize);
         void decrease_memory_usage (uint64_t additionalSize);
 
-        void pop_back () override;
-        void push_back (slice<const byte>) override;
+        void pop_back ();
+        void push_back (slice<const byte>);
 
         // erase elements from including (top - first). element until excluding (top - last). element
         // first and last should be negative numbers (distance from the top)
-        void erase (int first, int last) override;
+        void erase (int first, int last);
 
         // index should be negative number (distance from the top)
-        void erase (int index) override;
+        void erase (int index);
 
         // position should be negative number (distance from the top)
-        void insert (int position, slice<const byte>) override;
+        void insert (int position, slice<const byte>);
+
+        // push a view of a buffer that the element may share.
+        void push_back (const ptr<const bytes> &buffer, slice<const byte>);
+
+        // push a copy of the element at index (a negative number).
+        void copy_back (int index);
+
+        // (x1 x2 -- x1x2)
+        void cat ();
+
+        // (x -- x1 x2) where x1 is the first position bytes of x.
+        void split (size_t position);
 
-        void modify_top (std::function<void (bytes &)> f, int index = -1) override;
+        // replace the top element with the bytes from begin to begin + size.
+        void substring (size_t begin, size_t size);
+
+        // f is called with a reference to the element, which it may change.
+        template <typename F> void modify_top (F f, int index = -1);
+
+        void replace_back (const bytes &element);
     };
 
     // stack operations
@@ -257,9 +381,82 @@ namespace Gigamonkey::Bitcoin {
         return Stack.empty ();
     }
 
+    uint64 inline two_stack::combined_data_size () const {
+        uint64 n = 0;
+        for (const element &x : Stack) n += x.size ();
+        for (const element &x : AltStack) n += x.size ();
+        return n;
+    }
+
+    size_t inline element::size () const {
+        return Pieces.empty () ? Value.size () : Size;
+    }
+
+    bool inline element::flat () const {
+        return Pieces.empty ();
+    }
+
+    const integer inline &element::flatten () const {
+        if (!Pieces.empty ()) {
+            Value.resize (Size);
+            read (0, Size, Value.data ());
+            Pieces.clear ();
+        }
+
+        return Value;
+    }
+
+    integer inline &element::flatten () {
+        static_cast<const element &> (*this).flatten ();
+        return Value;
+    }
+
+    std::ostream inline &operator << (std::ostream &o, const element &x) {
+        return o << x.flatten ();
+    }
+
     bytes inline &two_stack::top (int index) {
         if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
-        return Stack.at (Stack.size () + index);
+        return Stack.at (Stack.size () + index).flatten ();
+    }
+
+    size_t inline two_stack::top_size (int index) const {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        return Stack.at (Stack.size () + index).size ();
+    }
+
+    inline two_stack::two_stack () : Stack {}, AltStack {}, Spare {} {
+        Stack.reserve (INITIAL_STACK_DEPTH);
+    }
+
+    integer inline two_stack::make (size_t size) {
+        integer x {};
+        if (Spare.empty ()) x.reserve (std::max (size, SMALL_ELEMENT_SIZE));
+        else {
+            x = std::move (Spare.back ());
+            Spare.pop_back ();
+        }
+
+        x.resize (size);
+        return x;
+    }
+
+    integer inline two_stack::make (slice<const byte> b) {
+        integer x = make (b.size ());
+        std::copy (b.begin (), b.end (), x.begin ());
+        return x;
+    }
+
+    // only flat elements have a buffer of their own to give back.
+    void inline two_stack::recycle (element &x) {
+        if (x.Value.capacity () > 0 && x.Value.capacity () < element::LARGE_ELEMENT_SIZE && Spare.size () < MAX_SPARE_BUFFERS)
+            Spare.push_back (std::move (x.Value));
+    }
+
+    void inline two_stack::roll (int index) {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        if (Stack.size () < size_t (-index)) throw std::out_of_range ("roll(): index out of range");
+        std::rotate (Stack.end () + index, Stack.end () + index + 1, Stack.end ());
     }
 
     void inline two_stack::swap (size_t index1, size_t index2) {
@@ -267,7 +464,7 @@ namespace Gigamonkey::Bitcoin {
     }
 
     const bytes inline &two_stack::at (uint64_t i) const {
-        return Stack.at (i);
+        return Stack.at (i).flatten ();
     }
 
     void inline two_stack::from_alt () {
@@ -284,19 +481,19 @@ namespace Gigamonkey::Bitcoin {
         Stack.pop_back ();
     }
 
-    typename std::vector<integer>::const_iterator inline two_stack::begin () const {
+    typename std::vector<element>::const_iterator inline two_stack::begin () const {
         return Stack.begin ();
     }
 
-    typename std::vector<integer>::const_iterator inline two_stack::end () const {
+    typename std::vector<element>::const_iterator inline two_stack::end () const {
         return Stack.end ();
     }
 
-    typename std::vector<integer>::iterator inline two_stack::begin () {
+    typename std::vector<element>::iterator inline two_stack::begin () {
         return Stack.begin ();
     }
 
-    typename std::vector<integer>::iterator inline two_stack::end () {
+    typename std::vector<element>::iterator inline two_stack::end () {
         return Stack.end ();
     }
 
@@ -311,17 +508,114 @@ namespace Gigamonkey::Bitcoin {
 
     void inline limited_two_stack<true>::push_back (slice<const byte> element) {
         increase_memory_usage (element.size () + ELEMENT_OVERHEAD);
-        Stack.emplace_back (element);
+        Stack.push_back (make (element));
     }
 
     void inline limited_two_stack<false>::push_back (slice<const byte> element) {
         if (element.size () > MaxScriptElementSize) throw_push_size_exception ();
         if (this->combined_size () == MaxStackElements) throw_stack_overflow_exception ();
-        Stack.emplace_back (element);
+        Stack.push_back (make (element));
+    }
+
+    void inline limited_two_stack<true>::push_back (const ptr<const bytes> &buffer, slice<const byte> b) {
+        if (b.size () < element::LARGE_ELEMENT_SIZE) return push_back (b);
+        increase_memory_usage (b.size () + ELEMENT_OVERHEAD);
+        Stack.push_back (element {{element::piece {buffer, size_t (b.data () - buffer->data ()), b.size ()}}, b.size ()});
+    }
+
+    void inline limited_two_stack<false>::push_back (const ptr<const bytes> &buffer, slice<const byte> b) {
+        if (b.size () < element::LARGE_ELEMENT_SIZE) return push_back (b);
+        if (b.size () > MaxScriptElementSize) throw_push_size_exception ();
+        if (this->combined_size () == MaxStackElements) throw_stack_overflow_exception ();
+        Stack.push_back (element {{element::piece {buffer, size_t (b.data () - buffer->data ()), b.size ()}}, b.size ()});
+    }
+
+    void inline limited_two_stack<true>::copy_back (int index) {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        element &x = Stack.at (Stack.size () + index);
+        increase_memory_usage (x.size () + ELEMENT_OVERHEAD);
+        // x is still valid since Stack has not been changed yet.
+        element y = part (x, 0, x.size ());
+        Stack.push_back (std::move (y));
+    }
+
+    void inline limited_two_stack<false>::copy_back (int index) {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        element &x = Stack.at (Stack.size () + index);
+        if (x.size () > MaxScriptElementSize) throw_push_size_exception ();
+        if (this->combined_size () == MaxStackElements) throw_stack_overflow_exception ();
+        element y = part (x, 0, x.size ());
+        Stack.push_back (std::move (y));
+    }
+
+    void inline limited_two_stack<true>::cat () {
+        // the result takes the place of two elements.
+        decrease_memory_usage (ELEMENT_OVERHEAD);
+        join ();
+    }
+
+    void inline limited_two_stack<false>::cat () {
+        if (top_size (-2) + top_size (-1) > MaxScriptElementSize) throw_push_size_exception ();
+        join ();
+    }
+
+    void inline limited_two_stack<true>::split (size_t position) {
+        increase_memory_usage (ELEMENT_OVERHEAD);
+        divide (position);
+    }
+
+    void inline limited_two_stack<false>::split (size_t position) {
+        if (this->combined_size () == MaxStackElements) throw_stack_overflow_exception ();
+        divide (position);
+    }
+
+    void inline limited_two_stack<true>::substring (size_t begin, size_t size) {
+        element &x = Stack.back ();
+        decrease_memory_usage (x.size () - size);
+        element y = part (x, begin, size);
+        recycle (x);
+        x = std::move (y);
+    }
+
+    void inline limited_two_stack<false>::substring (size_t begin, size_t size) {
+        element &x = Stack.back ();
+        element y = part (x, begin, size);
+        recycle (x);
+        x = std::move (y);
+    }
+
+    template <typename F> void inline limited_two_stack<false>::modify_top (F f, int index) {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        integer &val = Stack.at (Stack.size () + index).flatten ();
+        f (val);
+        if (val.size () > MaxScriptElementSize) throw_push_size_exception ();
+    }
+
+    template <typename F> void inline limited_two_stack<true>::modify_top (F f, int index) {
+        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        integer &val = Stack.at (Stack.size () + index).flatten ();
+        size_t before_size = val.size ();
+        f (val);
+        size_t after_size = val.size ();
+        if (before_size < after_size) increase_memory_usage (after_size - before_size);
+        else decrease_memory_usage (before_size - after_size);
+    }
+
+    void inline limited_two_stack<false>::replace_back (const bytes &element) {
+        modify_top ([&element] (bytes &val) {
+            val = element;
+        });
+    }
+
+    void inline limited_two_stack<true>::replace_back (const bytes &element) {
+        modify_top ([&element] (bytes &val) {
+            val = element;
+        });
     }
 
     void inline limited_two_stack<false>::pop_back () {
         if (Stack.empty ()) throw std::runtime_error ("popstack(): stack empty");
+        recycle (Stack.back ());
         Stack.pop_back ();
     }
 
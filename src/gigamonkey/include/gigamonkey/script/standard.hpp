@@ -0,0 +1,25 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SCRIPT_STANDARD
+#define GIGAMONKEY_SCRIPT_STANDARD
+
+#include <gigamonkey/script.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // Verify spends of the standard scripts pay_to_address, pay_to_pubkey
+    // and bare multisig without running the interpreter. The result is the
+    // same as that of evaluate, including the error code. Nothing is returned
+    // if the scripts are not recognized or if the config sets limits that
+    // these scripts could run into, in which case evaluate must be used.
+    maybe<result> verify_standard (slice<const byte> unlock, slice<const byte> lock,
+        const redemption_document &, const script_config & = {});
+
+    // verify_standard if possible and evaluate otherwise.
+    result evaluate_standard (const script &unlock, const script &lock,
+        const redemption_document &, const script_config & = {});
+
+}
+
+#endif
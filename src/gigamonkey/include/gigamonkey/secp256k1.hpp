@@ -86,6 +86,19 @@ namespace Gigamonkey::secp256k1 {
         }
         
         static bool verify (slice<const byte> pubkey, const digest&, slice<const byte> sig);
+
+        // a signature to be checked by verify_batch.
+        struct verification {
+            slice<const byte> Pubkey;
+            digest Digest;
+            slice<const byte> Signature;
+        };
+
+        // check many signatures using up to the given number of threads
+        // from thread_pool::global () (0 means all of them). Returns the index
+        // of the first invalid signature, or the size of the batch if all are valid.
+        static size_t verify_batch (const std::vector<verification> &, uint32 threads = 0);
+
         static bytes compress (slice<const byte>);
         static bytes decompress (slice<const byte>);
         static bytes negate (slice<const byte>);
@@ -0,0 +1,128 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SHA256
+#define GIGAMONKEY_SHA256
+
+#include "types.hpp"
+#include <data/crypto/hash.hpp>
+#include <span>
+
+// SHA-256, which is used for almost every hash in Bitcoin. There are several
+// implementations, some of which use processor instructions that are not
+// available everywhere. The fastest one that the processor supports is chosen
+// the first time it is needed. SHA2_256 and double_SHA2_256 in hash.hpp go
+// through here.
+//
+// Some implementations hash several messages at once in the lanes of vector
+// registers. These are used for batches, such as a level of a Merkle tree or
+// a run of block headers, and are chosen separately.
+namespace Gigamonkey::sha256 {
+
+    enum class implementation : byte {
+        // portable C++.
+        reference,
+        // the x86 SHA extensions, also known as SHA-NI.
+        x86_shani,
+        // the ARMv8 cryptography extensions.
+        arm_shani,
+        // four, eight, and sixteen messages at once with x86 vector instructions.
+        x86_sse41,
+        x86_avx2,
+        x86_avx512
+    };
+
+    std::ostream &operator << (std::ostream &, implementation);
+
+    // whether the implementation was compiled in and the processor supports it.
+    bool available (implementation);
+
+    // the number of messages that the implementation hashes at once.
+    uint32 lanes (implementation);
+
+    constexpr uint32 max_lanes = 16;
+
+    implementation active ();
+
+    // the implementation used for batches. It may have one lane.
+    implementation active_batch ();
+
+    // use the given implementation from now on. This is for testing and
+    // benchmarks. Throws std::invalid_argument if it is not available
+    // or if it has more than one lane.
+    void select (implementation);
+
+    // use the given implementation for batches. Throws
+    // std::invalid_argument if it is not available.
+    void select_batch (implementation);
+
+    // go back to the fastest available implementations.
+    void reset ();
+
+    constexpr std::array<uint32, 8> Initial {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    // run the compression function on the given number of 64 byte blocks.
+    void transform (uint32 *state, const byte *blocks, size_t count);
+
+    // the number of lanes of the batch implementation.
+    uint32 lanes ();
+
+    // run the compression function with the batch implementation. states
+    // is lanes () states one after another. Lane i reads count blocks
+    // starting at blocks[i].
+    void transform (uint32 *states, const byte *const *blocks, size_t count);
+
+    data::digest<32> hash (slice<const byte>);
+
+    // SHA-256 of SHA-256.
+    data::digest<32> double_hash (slice<const byte>);
+
+    // double hashes of the two sizes that Bitcoin uses most: 64 bytes for a
+    // pair of digests in a Merkle tree and 80 bytes for a block header. The
+    // padding is known ahead of time, as is everything about the second hash
+    // except the 32 bytes that go into it.
+    data::digest<32> double_hash_64 (const byte *);
+    data::digest<32> double_hash_80 (const byte *);
+
+    // the state after the first 64 bytes of an 80 byte message. The nonce of a
+    // block header is in its last 16 bytes, so this stays the same as the nonce
+    // changes and only one block needs to be hashed for each new nonce.
+    std::array<uint32, 8> midstate_80 (const byte *first_64);
+    data::digest<32> double_hash_80 (const std::array<uint32, 8> &midstate, const byte *last_16);
+
+    // hash a batch of messages. Runs of messages with the same length
+    // are hashed together, so this is fastest when they all have the same
+    // length. out must be the same size as in.
+    void hash (std::span<const slice<const byte>> in, std::span<data::digest<32>> out);
+
+    void double_hash (std::span<const slice<const byte>> in, std::span<data::digest<32>> out);
+
+    // a hash that is computed incrementally.
+    struct state {
+        std::array<uint32, 8> State;
+        std::array<byte, 64> Buffer;
+        uint64 Length;
+
+        state () : State {Initial}, Buffer {}, Length {0} {}
+
+        state &update (slice<const byte>);
+
+        data::digest<32> complete ();
+
+        // complete the hash but leave the result as words.
+        const std::array<uint32, 8> &finish ();
+    };
+
+    data::digest<32> inline hash (slice<const byte> b) {
+        return state {}.update (b).complete ();
+    }
+
+    data::digest<32> inline double_hash_80 (const byte *b) {
+        return double_hash_80 (midstate_80 (b), b + 64);
+    }
+
+}
+
+#endif
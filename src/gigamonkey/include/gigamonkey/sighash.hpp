@@ -66,6 +66,21 @@ namespace Gigamonkey::Bitcoin {
     }
     
     namespace sighash {
+
+        // the parts of the Amaury signature hash that are the same for every
+        // input of a transaction. This is computed once per transaction and is
+        // not modified afterward, so it can be shared by threads that sign
+        // or verify different inputs.
+        struct precomputed {
+            digest256 HashPrevouts;
+            digest256 HashSequence;
+            digest256 HashOutputs;
+
+            // the hash of each output, used with sighash::single.
+            cross<digest256> HashOutput;
+
+            explicit precomputed (const incomplete::transaction &);
+        };
         
         // the document containing the information that is signed. 
         struct document {
@@ -83,14 +98,20 @@ namespace Gigamonkey::Bitcoin {
             // the script code contains the previous output script with the 
             // latest instance of OP_CODESEPARATOR before the signature operation 
             // being evaluated and everything earlier removed.
-            program ScriptCode;
+            flat_program ScriptCode;
+
+            // if provided, must have been computed from Transaction.
+            const precomputed *Precomputed;
             
             bool valid () const {
                 return RedeemedValue >= 0 && InputIndex < Transaction.Inputs.size ();
             }
             
-            document (incomplete::transaction &tx, index i, satoshi r, program script_code) :
-                Transaction {tx}, InputIndex {i}, RedeemedValue {r}, ScriptCode {script_code} {}
+            document (incomplete::transaction &tx, index i, satoshi r, flat_program script_code, const precomputed *p = nullptr) :
+                Transaction {tx}, InputIndex {i}, RedeemedValue {r}, ScriptCode {script_code}, Precomputed {p} {}
+
+            document (incomplete::transaction &tx, index i, satoshi r, program script_code, const precomputed *p = nullptr) :
+                document {tx, i, r, flat_program {script_code}, p} {}
             
         };
         
@@ -128,12 +149,9 @@ namespace Gigamonkey::Bitcoin {
         }
         
         // a fake transaction constructed from an incomplete transaction that is used in the original sighash algorithm. 
+        // write_original writes the same thing without constructing it.
         transaction reconstruct (const document &doc, sighash::directive d);
         
-        writer inline &write_original (writer &w, const document &doc, sighash::directive d) {
-            return w << reconstruct (doc, d) << uint32_little {d};
-        }
-        
         namespace Amaury {
             bytes write (const document &, sighash::directive);
             writer &write (writer &w, const document &doc, sighash::directive d);
@@ -177,18 +195,21 @@ namespace Gigamonkey::Bitcoin {
     }
 
     const digest256 inline &incomplete::transaction::hash_prevouts () {
-        if (Cached.HashPrevouts == nullptr) Cached.HashPrevouts = new digest256 {sighash::Amaury::hash_prevouts (*this)};
-        return *Cached.HashPrevouts;
+        return cached::get (Cached.HashPrevouts, [this] () {
+            return sighash::Amaury::hash_prevouts (*this);
+        });
     }
 
     const digest256 inline &incomplete::transaction::hash_sequence () {
-        if (Cached.HashSequence == nullptr) Cached.HashSequence = new digest256 {sighash::Amaury::hash_sequence (*this)};
-        return *Cached.HashSequence;
+        return cached::get (Cached.HashSequence, [this] () {
+            return sighash::Amaury::hash_sequence (*this);
+        });
     }
 
     const digest256 inline &incomplete::transaction::hash_outputs () {
-        if (Cached.HashOutputs == nullptr) Cached.HashOutputs = new digest256 {sighash::Amaury::hash_outputs (*this)};
-        return *Cached.HashOutputs;
+        return cached::get (Cached.HashOutputs, [this] () {
+            return sighash::Amaury::hash_outputs (*this);
+        });
     }
     
 }
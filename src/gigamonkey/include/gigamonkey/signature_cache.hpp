@@ -0,0 +1,43 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_SIGNATURE_CACHE
+#define GIGAMONKEY_SIGNATURE_CACHE
+
+#include <gigamonkey/cache.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    // A cache of signatures that have been verified successfully, so that
+    // a transaction that is checked more than once (in the mempool, in a block,
+    // in an SPV proof) does not need its signatures checked again.
+    //
+    // Entries are keyed by a salted hash of the sighash digest, the
+    // public key and the signature, with the lengths of the last two.
+    struct signature_cache : salted_cache {
+        explicit signature_cache (size_t max_bytes = DEFAULT_SIZE) : salted_cache {max_bytes} {}
+
+        // whether the signature is known to be valid.
+        bool contains (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig);
+
+        // remember that a signature is valid.
+        void insert (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig);
+
+        // a cache shared by the whole program.
+        static signature_cache &global ();
+
+    private:
+        digest256 key (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig) const;
+    };
+
+    bool inline signature_cache::contains (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig) {
+        return salted_cache::contains (key (sighash, pubkey, sig));
+    }
+
+    void inline signature_cache::insert (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig) {
+        salted_cache::insert (key (sighash, pubkey, sig));
+    }
+
+}
+
+#endif
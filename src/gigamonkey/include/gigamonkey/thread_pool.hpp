@@ -0,0 +1,66 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#ifndef GIGAMONKEY_THREAD_POOL
+#define GIGAMONKEY_THREAD_POOL
+
+#include <gigamonkey/types.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Gigamonkey {
+
+    // Threads that are started once and kept for work that is split up
+    // among several threads, such as checking a batch of signatures or
+    // hashing a level of a big Merkle tree. The work is a function that
+    // takes pieces of a job until there are none left.
+    struct thread_pool {
+        // workers = 0 means one less than the number of cores, since
+        // the thread that calls run does some of the work too.
+        explicit thread_pool (uint32 workers = 0);
+        ~thread_pool ();
+
+        thread_pool (const thread_pool &) = delete;
+        thread_pool &operator = (const thread_pool &) = delete;
+
+        // number of threads that can work at once, including the caller of run.
+        uint32 size () const;
+
+        // call work once on the calling thread and on up to threads - 1 workers
+        // (threads = 0 means size ()) and return when every call has returned.
+        // Calls that have not started by the time the calling thread is done
+        // are dropped, so run may be called from inside another job. If a call
+        // throws, the exception is thrown from run.
+        void run (const std::function<void ()> &work, uint32 threads = 0);
+
+        // a pool shared by the whole program.
+        static thread_pool &global ();
+
+    private:
+        struct job {
+            const std::function<void ()> *Work;
+            // calls that have been given to workers and have not returned.
+            uint32 Remaining;
+            std::exception_ptr Error;
+            std::condition_variable Done;
+        };
+
+        std::mutex Mutex;
+        std::condition_variable Wake;
+        std::deque<job *> Waiting;
+        std::vector<std::thread> Workers;
+        bool Stop;
+
+        void work ();
+    };
+
+    uint32 inline thread_pool::size () const {
+        return Workers.size () + 1;
+    }
+
+}
+
+#endif
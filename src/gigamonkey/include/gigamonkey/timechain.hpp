@@ -90,6 +90,14 @@ namespace Gigamonkey::Bitcoin {
         static uint32_little nonce (slice);
         static digest256 hash (slice h);
         static bool valid (slice h);
+
+        // the state of the hash after the first 64 bytes of the header, which
+        // do not include the timestamp, target, or nonce.
+        static std::array<uint32, 8> midstate (slice h);
+
+        // the hash of a header from the midstate of any header
+        // that differs from it only in the last 16 bytes.
+        static digest256 hash (const std::array<uint32, 8> &midstate, slice h);
         
         int32_little Version;
         digest256 Previous;
@@ -439,7 +447,15 @@ namespace Gigamonkey::Bitcoin {
     }
     
     digest256 inline header::hash (slice h) {
-        return Bitcoin::Hash256 (h);
+        return sha256::double_hash_80 (h.data ());
+    }
+
+    std::array<uint32, 8> inline header::midstate (slice h) {
+        return sha256::midstate_80 (h.data ());
+    }
+
+    digest256 inline header::hash (const std::array<uint32, 8> &midstate, slice h) {
+        return sha256::double_hash_80 (midstate, h.data () + 64);
     }
 
     const digest256 inline &header::hash () const {
@@ -34,6 +34,14 @@ namespace Gigamonkey::work {
         byte_array<80> write () const;
         
         uint256 hash () const;
+
+        // see Bitcoin::header::midstate. This does not depend on the
+        // timestamp, target, or nonce, so a miner only needs it once.
+        std::array<uint32, 8> midstate () const;
+
+        // the hash given the midstate of a string that differs
+        // at most in the timestamp, target, and nonce.
+        uint256 hash (const std::array<uint32, 8> &midstate) const;
         
         static bool valid (slice<const byte, 80> x);
         
@@ -92,11 +100,19 @@ namespace Gigamonkey::work {
     }
 
     uint256 inline string::hash () const {
-        return Bitcoin::Hash256 (write ());
+        return Bitcoin::header::hash (write ());
+    }
+
+    std::array<uint32, 8> inline string::midstate () const {
+        return Bitcoin::header::midstate (write ());
+    }
+
+    uint256 inline string::hash (const std::array<uint32, 8> &midstate) const {
+        return Bitcoin::header::hash (midstate, write ());
     }
 
     bool inline string::valid (slice<const byte, 80> x) {
-        return Bitcoin::Hash256 (x) < Bitcoin::header::target (x).expand ();
+        return Bitcoin::header::hash (x) < Bitcoin::header::target (x).expand ();
     }
 
     bool inline string::valid () const {
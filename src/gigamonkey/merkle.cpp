@@ -4,7 +4,15 @@
 #include <gigamonkey/merkle/tree.hpp>
 #include <gigamonkey/merkle/dual.hpp>
 #include <gigamonkey/merkle/server.hpp>
+#include <gigamonkey/merkle/flat.hpp>
+#include <gigamonkey/merkle/BUMP.hpp>
+#include <gigamonkey/thread_pool.hpp>
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <numeric>
+#include <random>
 
 namespace Gigamonkey::Merkle {
 
@@ -12,13 +20,31 @@ namespace Gigamonkey::Merkle {
     
     namespace {
     
+        // all the pairs in a level are the same length, so
+        // they are hashed together as a batch.
         leaf_digests round (leaf_digests l) {
-            leaf_digests r {};
-            while (l.size () >= 2) {
-                r <<= hash_concatinated (first (l), first (rest (l)));
-                l = rest (rest (l));
+            size_t pairs = (l.size () + 1) / 2;
+            std::vector<byte> concatinated (64 * pairs);
+            std::vector<slice<const byte>> in {};
+            in.reserve (pairs);
+
+            byte *at = concatinated.data ();
+            while (l.size () > 0) {
+                // an odd digest at the end is paired with itself.
+                const digest &left = first (l);
+                const digest &right = l.size () > 1 ? first (rest (l)) : left;
+                std::copy (left.begin (), left.end (), at);
+                std::copy (right.begin (), right.end (), at + 32);
+                in.push_back (slice<const byte> {at, 64});
+                l = l.size () > 1 ? rest (rest (l)) : leaf_digests {};
+                at += 64;
             }
-            if (l.size () == 1) r <<= hash_concatinated (first (l), first (l));
+
+            std::vector<digest> out (pairs);
+            Bitcoin::Hash256_batch (in, out);
+
+            leaf_digests r {};
+            for (const digest &d : out) r <<= d;
             return r;
         }
     
@@ -80,63 +106,9 @@ namespace Gigamonkey::Merkle {
     
     }
     
+    // the digests are computed in a flat tree and then linked together.
     tree tree::make (leaf_digests h) {
-        
-        if (h.size () == 0) tree {};
-        if (h.size () == 1) return tree {first (h)};
-        
-        uint32 width = h.size ();
-        uint32 height = 2;
-        
-        leaf_digests next_round = round (h);
-        
-        using trees = list<dt<digest256>>;
-        trees Trees {};
-        
-        leaf_digests last = h;
-        leaf_digests next = next_round;
-
-        while (!next.empty ()) {
-            if (data::size (last) >= 2) {
-                Trees = Trees << dt<digest256> {first (next),
-                    dt<digest256> {first (last)},
-                    dt<digest256> {first (rest (last))}};
-                last = rest (rest (last));
-            } else {
-                Trees = Trees << dt<digest256> {first (next),
-                    dt<digest256> {first (last)},
-                    dt<digest256> {}};
-                last = rest (last);
-            }
-            next = rest (next);
-        }
-        
-        while (next_round.size () > 1) {
-            trees last_trees = Trees;
-            Trees = trees {};
-            next_round = round (next_round);
-            next = next_round;
-            height++;
-            
-            while (!next.empty ()) {
-                if (last_trees.size () >= 2) {
-                    Trees = Trees << dt<digest256> {first (next),
-                        dt<digest256> {first (last_trees)},
-                        dt<digest256> {first (rest (last_trees))}};
-                    last_trees = rest (rest (last_trees));
-                } else {
-                    Trees = Trees << dt<digest256> {first (next),
-                        dt<digest256> {first (last_trees)},
-                        dt<digest256> {}};
-                    last_trees = rest (last_trees);
-                }
-
-                next = rest (next);
-            }
-        }
-        
-        // trees should have size 1 by this point. 
-        return tree {first (Trees), width, height};
+        return tree (flat_tree {h});
     }
     
     digest root (list<digest> l) {
@@ -152,6 +124,97 @@ namespace Gigamonkey::Merkle {
         }
         return l.Digest;
     }
+
+    void hash_concatinated (std::span<const std::array<byte, 64>> pairs, std::span<digest> out) {
+        if (pairs.size () != out.size ()) throw std::invalid_argument {"Merkle pairs and digests sizes differ"};
+
+        constexpr size_t batch = 128;
+        std::array<slice<const byte>, batch> in;
+
+        for (size_t b = 0; b < pairs.size (); b += batch) {
+            size_t e = std::min (pairs.size (), b + batch);
+            for (size_t k = b; k < e; k++) in[k - b] = slice<const byte> {pairs[k].data (), 64};
+            Bitcoin::Hash256_batch (std::span<const slice<const byte>> {in.data (), e - b}, out.subspan (b, e - b));
+        }
+    }
+
+    list<uint32> failed (std::span<const branch> branches, const digest &root) {
+        struct climbing {
+            uint32 Position;
+            leaf Leaf;
+            digests Digests;
+        };
+
+        std::vector<bool> bad (branches.size (), false);
+        std::vector<climbing> current {};
+        current.reserve (branches.size ());
+        for (uint32 i = 0; i < branches.size (); i++)
+            if (!branches[i].valid ()) bad[i] = true;
+            else current.push_back (climbing {i, branches[i].Leaf, branches[i].Digests});
+
+        std::vector<std::array<byte, 64>> pairs {};
+        std::vector<uint32> order {};
+        std::vector<uint32> slot {};
+        std::vector<std::array<byte, 64>> distinct {};
+        std::vector<digest> next {};
+
+        while (true) {
+            // branches at the end of their paths are checked against the root.
+            size_t n = 0;
+            for (size_t k = 0; k < current.size (); k++)
+                if (current[k].Digests.empty ()) {
+                    if (current[k].Leaf.Digest != root) bad[current[k].Position] = true;
+                } else {
+                    if (n != k) current[n] = std::move (current[k]);
+                    n++;
+                }
+
+            current.resize (n);
+            if (n == 0) break;
+
+            pairs.resize (n);
+            for (size_t k = 0; k < n; k++) {
+                const leaf &l = current[k].Leaf;
+                maybe<digest> sibling = first (current[k].Digests);
+                const digest &other = bool (sibling) ? *sibling : l.Digest;
+                const digest &left = l.Index & 1 ? other : l.Digest;
+                const digest &right = l.Index & 1 ? l.Digest : other;
+                std::copy (left.begin (), left.end (), pairs[k].data ());
+                std::copy (right.begin (), right.end (), pairs[k].data () + 32);
+            }
+
+            // branches that go through the same node are put next
+            // to each other so that the node is only hashed once.
+            order.resize (n);
+            std::iota (order.begin (), order.end (), 0);
+            std::sort (order.begin (), order.end (), [&current, &pairs] (uint32 a, uint32 b) {
+                uint64 x = current[a].Leaf.Index >> 1;
+                uint64 y = current[b].Leaf.Index >> 1;
+                return x != y ? x < y : pairs[a] < pairs[b];
+            });
+
+            slot.resize (n);
+            distinct.clear ();
+            for (size_t k = 0; k < n; k++) {
+                uint32 a = order[k];
+                if (k == 0 || (current[a].Leaf.Index >> 1) != (current[order[k - 1]].Leaf.Index >> 1) ||
+                    pairs[a] != pairs[order[k - 1]]) distinct.push_back (pairs[a]);
+                slot[a] = distinct.size () - 1;
+            }
+
+            next.resize (distinct.size ());
+            hash_concatinated (distinct, next);
+
+            for (size_t k = 0; k < n; k++) {
+                current[k].Leaf = leaf {next[slot[k]], current[k].Leaf.Index >> 1};
+                current[k].Digests = rest (current[k].Digests);
+            }
+        }
+
+        list<uint32> result {};
+        for (uint32 i = 0; i < branches.size (); i++) if (bad[i]) result <<= i;
+        return result;
+    }
     
     const list<proof> tree::proofs () const {
         
@@ -348,6 +411,8 @@ namespace Gigamonkey::Merkle {
             height--;
             write_at_height (b, t, height);
         } while (height > 0);
+
+        make_index ();
     }
     
     server::operator tree () const {
@@ -382,40 +447,9 @@ namespace Gigamonkey::Merkle {
         return tree {first (trees), Width, Height};
     }
     
-    server::server (leaf_digests l) : server{} {
+    server::server (leaf_digests l) : server {} {
         if (size (l) == 0) return;
-        
-        Width = size (l);
-        Height = 1;
-        
-        uint32 width = Width;
-        uint32 total = width;
-        while (width > 1) {
-            width = (width + 1) / 2;
-            total += width;
-            Height++;
-        } 
-        Digests.resize (total);
-        
-        leaf_digests v = l;
-        uint32 i = 0;
-        
-        while (true) {
-            leaf_digests x = v;
-            while (!empty (x)) {
-                Digests[i] = first (x);
-                x = rest (x);
-                i++;
-            }
-            if (i == total) break;
-            v = round (v);
-        } 
-        
-        auto a = Digests[total - 1];
-        auto b = Digests[-1];
-        
-        for (uint32 x = 0; x < Width; x++) Indices = Indices.insert (Digests[x], x + 1);
-        
+        *this = server (flat_tree {l});
     }
     
     namespace {
@@ -436,16 +470,347 @@ namespace Gigamonkey::Merkle {
     }
     
     proof server::operator [] (const digest &d) const {
-        uint32 index = Indices[d];
+        uint32 index = find (d);
         if (index == 0) return {};
         
         return get_server_proof (Digests, Width, index - 1);
     }
+
+    namespace {
+        // a random key for each server, from a generator that is seeded once.
+        std::array<uint64, 5> make_seed () {
+            static std::mutex mutex;
+            static std::mt19937_64 random {std::random_device {} ()};
+            std::lock_guard<std::mutex> lock {mutex};
+            std::array<uint64, 5> seed;
+            for (uint64 &x : seed) x = random () | 1;
+            return seed;
+        }
+
+        // multilinear hash of the digest under the seed. The top bits are
+        // the slot, with bits being the log of the size of the table.
+        size_t inline slot (const digest &d, const std::array<uint64, 5> &seed, int bits) {
+            uint64 h = seed[4];
+            for (int i = 0; i < 4; i++) h += seed[i] * boost::endian::load_little_u64 (d.data () + 8 * i);
+            return bits == 0 ? 0 : size_t (h >> (64 - bits));
+        }
+    }
+
+    void server::make_index () {
+        // no more than half of the slots are used.
+        size_t size = 1;
+        while (size < 2 * size_t (Width)) size <<= 1;
+        Index = std::vector<uint32> (size, 0);
+        Seed = make_seed ();
+        size_t mask = size - 1;
+        int bits = std::countr_zero (size);
+
+        for (uint32 x = 0; x < Width; x++) {
+            // if a digest appears twice, the first one is found.
+            size_t i = slot (Digests[x], Seed, bits);
+            while (Index[i] != 0 && Digests[Index[i] - 1] != Digests[x]) i = (i + 1) & mask;
+            if (Index[i] == 0) Index[i] = x + 1;
+        }
+    }
+
+    uint32 server::find (const digest &d) const {
+        if (Index.size () == 0) return 0;
+        size_t mask = Index.size () - 1;
+        for (size_t i = slot (d, Seed, std::countr_zero (Index.size ())); Index[i] != 0; i = (i + 1) & mask)
+            if (Digests[Index[i] - 1] == d) return Index[i];
+        return 0;
+    }
+
+    BUMP server::prove (uint64 block_height, std::span<const digest> leaves) const {
+        if (leaves.size () == 0) return {};
+
+        std::vector<uint32> indices {};
+        indices.reserve (leaves.size ());
+        for (const digest &d : leaves) {
+            uint32 index = find (d);
+            if (index == 0) return {};
+            indices.push_back (index - 1);
+        }
+
+        std::sort (indices.begin (), indices.end ());
+        indices.erase (std::unique (indices.begin (), indices.end ()), indices.end ());
+
+        BUMP::nodes path {};
+        uint32 width = Width;
+        uint32 cumulative = 0;
+
+        // at each level, the nodes we have are the ones above the given leaves
+        // and we need the siblings of these that we do not already have.
+        while (width > 1) {
+            std::vector<BUMP::node> level {};
+            for (size_t k = 0; k < indices.size (); k++) {
+                uint32 i = indices[k];
+                uint32 sibling = i ^ 1;
+                bool have_sibling = i & 1 ?
+                    k > 0 && indices[k - 1] == sibling :
+                    k + 1 < indices.size () && indices[k + 1] == sibling;
+
+                BUMP::node needed = sibling < width ?
+                    BUMP::node {sibling, BUMP::flag::intermediate, Digests[cumulative + sibling]} :
+                    BUMP::node {sibling};
+
+                if (i & 1 && !have_sibling) level.push_back (needed);
+                if (cumulative == 0) level.push_back (BUMP::node {i, BUMP::flag::client, Digests[i]});
+                if (!(i & 1) && !have_sibling) level.push_back (needed);
+            }
+
+            ordst<BUMP::node> nodes {};
+            for (auto n = level.rbegin (); n != level.rend (); n++) nodes >>= *n;
+            path <<= nodes;
+
+            for (uint32 &i : indices) i >>= 1;
+            indices.erase (std::unique (indices.begin (), indices.end ()), indices.end ());
+
+            cumulative += width;
+            width = (width + 1) / 2;
+        }
+
+        // with only one transaction in the block, it is the root.
+        if (Width == 1) path <<= ordst<BUMP::node> {BUMP::node {0, BUMP::flag::client, Digests[0]}};
+
+        return BUMP {block_height, path};
+    }
         
     list<proof> server::proofs () const {
         list<proof> p;
         for (uint32 i = 0; i < Width; i++) p <<= get_server_proof (Digests, Width, i);
         return p;
     }
-    
+
+    namespace {
+
+        // hash the pairs from begin to end in a level into the next level.
+        void hash_pairs (const std::vector<digest> &level, std::vector<digest> &next, size_t begin, size_t end) {
+            // pairs are written next to each other and hashed in batches of this size.
+            constexpr size_t batch = 128;
+            std::array<byte, 64 * batch> concatinated;
+            std::array<slice<const byte>, batch> in;
+
+            for (size_t b = begin; b < end; b += batch) {
+                size_t e = std::min (end, b + batch);
+                for (size_t k = b; k < e; k++) {
+                    const digest &left = level[2 * k];
+                    const digest &right = 2 * k + 1 < level.size () ? level[2 * k + 1] : left;
+                    byte *at = concatinated.data () + 64 * (k - b);
+                    std::copy (left.begin (), left.end (), at);
+                    std::copy (right.begin (), right.end (), at + 32);
+                    in[k - b] = slice<const byte> {at, 64};
+                }
+
+                Bitcoin::Hash256_batch (std::span<const slice<const byte>> {in.data (), e - b},
+                    std::span<digest> {next.data () + b, e - b});
+            }
+        }
+
+        std::vector<digest> next_level (const std::vector<digest> &level, uint32 threads) {
+            // pairs are handed out to threads in chunks of this size.
+            constexpr size_t chunk = 4096;
+
+            size_t pairs = (level.size () + 1) / 2;
+            std::vector<digest> next (pairs);
+
+            threads = std::min (size_t (threads), (pairs + chunk - 1) / chunk);
+            if (threads <= 1) {
+                hash_pairs (level, next, 0, pairs);
+                return next;
+            }
+
+            std::atomic<size_t> n {0};
+
+            auto work = [&level, &next, &n, pairs] () {
+                while (true) {
+                    size_t begin = n.fetch_add (chunk, std::memory_order_relaxed);
+                    if (begin >= pairs) return;
+                    hash_pairs (level, next, begin, std::min (begin + chunk, pairs));
+                }
+            };
+
+            thread_pool::global ().run (work, threads);
+            return next;
+        }
+
+        uint32 all_threads () {
+            return thread_pool::global ().size ();
+        }
+    }
+
+    flat_tree::flat_tree (std::vector<digest> leaves, uint32 threads) : Levels {} {
+        if (leaves.size () == 0) return;
+        if (threads == 0) threads = all_threads ();
+        Levels.push_back (std::move (leaves));
+        while (Levels.back ().size () > 1) Levels.push_back (next_level (Levels.back (), threads));
+    }
+
+    namespace {
+        std::vector<digest> to_vector (leaf_digests l) {
+            std::vector<digest> v {};
+            v.reserve (l.size ());
+            for (const digest &d : l) v.push_back (d);
+            return v;
+        }
+    }
+
+    flat_tree::flat_tree (leaf_digests l, uint32 threads) : flat_tree {to_vector (l), threads} {}
+
+    flat_tree::flat_tree (const tree &t) : Levels {} {
+        if (t.Width == 0 || t.Height == 0) return;
+        Levels.resize (t.Height);
+        for (uint32 h = 0; h < t.Height; h++) {
+            auto i = std::back_inserter (Levels[h]);
+            write_at_height (i, t, t.Height - 1 - h);
+        }
+    }
+
+    flat_tree::flat_tree (const server &s) : Levels {} {
+        if (s.Width == 0 || s.Height == 0) return;
+        size_t at = 0;
+        size_t width = s.Width;
+        while (true) {
+            std::vector<digest> &level = Levels.emplace_back ();
+            level.reserve (width);
+            for (size_t i = 0; i < width; i++) level.push_back (s.Digests[at + i]);
+            if (width == 1) break;
+            at += width;
+            width = (width + 1) / 2;
+        }
+    }
+
+    flat_tree::flat_tree (const dual &d) : Levels {} {
+        std::vector<digest> leaves (d.Paths.size ());
+        std::vector<bool> found (d.Paths.size (), false);
+        for (const entry &e : d.Paths) {
+            if (e.Value.Index >= leaves.size () || found[e.Value.Index]) return;
+            leaves[e.Value.Index] = e.Key;
+            found[e.Value.Index] = true;
+        }
+
+        flat_tree f {std::move (leaves)};
+        if (f.root () == d.Root) *this = std::move (f);
+    }
+
+    bool flat_tree::valid () const {
+        if (Levels.size () == 0 || Levels.back ().size () != 1) return false;
+        for (size_t h = 1; h < Levels.size (); h++)
+            if (Levels[h - 1].size () < 2 || next_level (Levels[h - 1], all_threads ()) != Levels[h]) return false;
+        return true;
+    }
+
+    proof flat_tree::operator [] (uint32 i) const {
+        if (i >= width ()) return {};
+        return proof {branch {Levels[0][i], path (i)}, root ()};
+    }
+
+    Merkle::path flat_tree::path (uint32 i) const {
+        if (i >= width ()) throw std::out_of_range {"no leaf at that index in Merkle tree"};
+
+        // the path is built from the top so that it ends up in order.
+        digests p {};
+        for (uint32 h = height () - 1; h > 0; h--) {
+            const std::vector<digest> &level = Levels[h - 1];
+            uint32 j = i >> (h - 1);
+            p >>= level[j & 1 ? j - 1 : j + 1 < level.size () ? j + 1 : j];
+        }
+
+        return Merkle::path {i, p};
+    }
+
+    void flat_tree::rehash (uint32 i) {
+        size_t h = 0;
+        for (; Levels[h].size () > 1; h++) {
+            const std::vector<digest> &level = Levels[h];
+            uint32 parent = i >> 1;
+            uint32 left = parent << 1;
+            digest d = hash_concatinated (level[left], level[left + 1 < level.size () ? left + 1 : left]);
+            size_t next_width = (level.size () + 1) / 2;
+
+            // a level is added when the one below grows to two digests.
+            if (h + 1 == Levels.size ()) Levels.emplace_back ();
+            std::vector<digest> &next = Levels[h + 1];
+            next.resize (next_width);
+            next[parent] = d;
+            i = parent;
+        }
+
+        // and removed when it shrinks to one.
+        Levels.resize (h + 1);
+    }
+
+    flat_tree &flat_tree::append (const digest &d) {
+        if (Levels.size () == 0) Levels.emplace_back ();
+        Levels[0].push_back (d);
+        rehash (Levels[0].size () - 1);
+        return *this;
+    }
+
+    flat_tree &flat_tree::replace (uint32 i, const digest &d) {
+        if (i >= width ()) throw std::out_of_range {"no leaf at that index in Merkle tree"};
+        Levels[0][i] = d;
+        rehash (i);
+        return *this;
+    }
+
+    flat_tree &flat_tree::remove_last () {
+        if (width () == 0) throw std::out_of_range {"Merkle tree is empty"};
+        Levels[0].pop_back ();
+        if (Levels[0].size () == 0) Levels.clear ();
+        else rehash (Levels[0].size () - 1);
+        return *this;
+    }
+
+    list<proof> flat_tree::proofs () const {
+        list<proof> p;
+        for (uint32 i = 0; i < width (); i++) p <<= (*this)[i];
+        return p;
+    }
+
+    flat_tree::operator tree () const {
+        if (Levels.size () == 0) return tree {};
+
+        std::vector<dt<digest>> trees {};
+        trees.reserve (width ());
+        for (const digest &d : Levels[0]) trees.push_back (dt<digest> {d});
+
+        for (size_t h = 1; h < Levels.size (); h++) {
+            std::vector<dt<digest>> next {};
+            next.reserve (Levels[h].size ());
+            for (size_t k = 0; k < Levels[h].size (); k++)
+                next.push_back (dt<digest> {Levels[h][k], trees[2 * k],
+                    2 * k + 1 < trees.size () ? trees[2 * k + 1] : dt<digest> {}});
+            trees = std::move (next);
+        }
+
+        return tree {trees[0], width (), height ()};
+    }
+
+    flat_tree::operator server () const {
+        server s {};
+        if (Levels.size () == 0) return s;
+
+        s.Width = width ();
+        s.Height = height ();
+
+        size_t total = 0;
+        for (const std::vector<digest> &level : Levels) total += level.size ();
+        s.Digests.resize (total);
+
+        size_t at = 0;
+        for (const std::vector<digest> &level : Levels)
+            for (const digest &d : level) s.Digests[at++] = d;
+
+        s.make_index ();
+        return s;
+    }
+
+    flat_tree::operator dual () const {
+        if (Levels.size () == 0) return dual {};
+        map m {};
+        for (uint32 i = 0; i < width (); i++) m = m.insert (entry ((*this)[i].Branch));
+        return dual {m, root ()};
+    }
+
 }
@@ -160,6 +160,9 @@ namespace Gigamonkey::Merkle {
                 level = ordst<BUMP::node> {};
             }
 
+            // a block with one transaction has a level with only that transaction.
+            if (b.Digests.size () == 0) nodes <<= level;
+
             return nodes;
         }
     }
@@ -208,7 +211,9 @@ namespace Gigamonkey::Merkle {
     BUMP::BUMP (uint64 block_height, map m): BlockHeight {block_height}, Path {} {
         auto b = m.begin ();
         if (b == m.end ()) return;
-        for (uint64 i = 0; i < size ((*b).Value.Digests); i++) Path <<= ordst<node> {};
+        // a block with one transaction still has one level.
+        uint64 height = std::max (uint64 (size ((*b).Value.Digests)), uint64 {1});
+        for (uint64 i = 0; i < height; i++) Path <<= ordst<node> {};
         for (const auto &e : m) *this = *this + branch {e.Key, e.Value};
     }
 
@@ -241,40 +246,36 @@ namespace Gigamonkey::Merkle {
             return result;
         }
 
-        // thrown when an error is found during validation.
-        struct validation_error {};
-
-        // calculate the next layer of merkle nodes as part of the validation process.
-        ordst<BUMP::node> step (ordst<BUMP::node> x) {
-
-            // the elements of the node should be organized in pairs, either
-            // adjacent nodes of the full tree or a digest and a note saying
-            // to duplicate it.
-            if (size (x) % 2 == 1) throw validation_error {};
+        // the nodes in a level should be organized in pairs, either
+        // adjacent nodes of the full tree or a digest and a note saying
+        // to duplicate it. The pairs are written to be hashed later along
+        // with the offsets of the nodes they make, largest first.
+        bool pair_up (ordst<BUMP::node> x, std::vector<std::array<byte, 64>> &pairs, std::vector<uint64> &offsets) {
+            if (size (x) % 2 == 1) return false;
 
             auto nodes = reverse (x);
-
-            ordst<BUMP::node> result;
             while (size (nodes) > 0) {
-                if ((nodes[0].Offset >> 1) != (nodes[1].Offset >> 1) || nodes[1].Offset + 1 != nodes[0].Offset) throw validation_error {};
-
-                result = result.insert (BUMP::node {nodes[0].Offset >> 1, BUMP::flag::intermediate, hash_concatinated (*nodes[1].Digest,
-                    nodes[0].Flag == BUMP::flag::duplicate ? *nodes[1].Digest : *nodes[0].Digest)});
+                const BUMP::node &left = nodes[1];
+                const BUMP::node &right = nodes[0];
+                if ((left.Offset >> 1) != (right.Offset >> 1) || left.Offset + 1 != right.Offset ||
+                    !bool (left.Digest) || (right.Flag != BUMP::flag::duplicate && !bool (right.Digest))) return false;
+
+                const digest &l = *left.Digest;
+                const digest &r = right.Flag == BUMP::flag::duplicate ? l : *right.Digest;
+                std::array<byte, 64> &pair = pairs.emplace_back ();
+                std::copy (l.begin (), l.end (), pair.data ());
+                std::copy (r.begin (), r.end (), pair.data () + 32);
+                offsets.push_back (left.Offset >> 1);
 
                 nodes = rest (rest (nodes));
-
             }
 
-            return result;
+            return true;
         }
     }
 
     bool BUMP::validate (const Bitcoin::TXID &expected_root) const {
-        try {
-            return expected_root == root ();
-        } catch (const validation_error &) {
-            return false;
-        }
+        return expected_root == root ();
     }
 
     BUMP operator + (const BUMP &a, const BUMP &b) {
@@ -296,12 +297,81 @@ namespace Gigamonkey::Merkle {
     }
 
     digest256 BUMP::root () const {
-        ordst<node> current {};
+        return roots (std::span<const BUMP> {this, 1})[0];
+    }
+
+    std::vector<digest256> BUMP::roots (std::span<const BUMP> bumps) {
+        std::vector<digest256> result (bumps.size ());
+
+        // the nodes we have calculated for each BUMP and the levels left to read.
+        std::vector<ordst<node>> current (bumps.size ());
+        std::vector<nodes> remaining {};
+        remaining.reserve (bumps.size ());
+        for (const BUMP &b : bumps) remaining.push_back (b.Path);
+
+        std::vector<bool> failed (bumps.size (), false);
 
-        for (const ordst<node> &next : Path)
-            current = step (combine (current, next));
+        // a block with one transaction has one level with only
+        // that transaction, which is the root, so there is nothing to hash.
+        for (size_t i = 0; i < bumps.size (); i++)
+            if (size (remaining[i]) == 1 && size (first (remaining[i])) == 1) {
+                current[i] = first (remaining[i]);
+                remaining[i] = rest (remaining[i]);
+                failed[i] = first (current[i]).Offset != 0;
+            }
+        std::vector<bool> read (bumps.size (), false);
+
+        // the pairs to hash on this level. The pairs for BUMP i end at end[i].
+        std::vector<std::array<byte, 64>> pairs {};
+        std::vector<uint64> offsets {};
+        std::vector<size_t> end (bumps.size ());
+        std::vector<digest> next {};
+
+        while (true) {
+            pairs.clear ();
+            offsets.clear ();
+
+            bool done = true;
+            for (size_t i = 0; i < bumps.size (); i++) {
+                size_t begin = pairs.size ();
+                read[i] = !failed[i] && !empty (remaining[i]);
+                if (read[i]) {
+                    done = false;
+                    if (!pair_up (combine (current[i], first (remaining[i])), pairs, offsets)) {
+                        failed[i] = true;
+                        pairs.resize (begin);
+                        offsets.resize (begin);
+                    }
+
+                    remaining[i] = rest (remaining[i]);
+                }
+
+                end[i] = pairs.size ();
+            }
+
+            if (done) break;
+
+            next.resize (pairs.size ());
+            hash_concatinated (pairs, next);
+
+            size_t begin = 0;
+            for (size_t i = 0; i < bumps.size (); i++) {
+                if (read[i]) {
+                    // the pairs were written starting from the largest offset.
+                    ordst<node> level {};
+                    for (size_t k = begin; k < end[i]; k++) level >>= node {offsets[k], flag::intermediate, next[k]};
+                    current[i] = level;
+                }
+
+                begin = end[i];
+            }
+        }
 
-        return size (current) == 1 && bool (first (current).Digest) ? *first (current).Digest : digest256 {};
+        for (size_t i = 0; i < bumps.size (); i++)
+            if (!failed[i] && size (current[i]) == 1 && bool (first (current[i]).Digest))
+                result[i] = *first (current[i]).Digest;
+
+        return result;
     }
 
     namespace {
@@ -386,6 +456,13 @@ namespace Gigamonkey::Merkle {
     }
 
     map BUMP::paths () const {
+        // a block with one transaction.
+        if (size (Path) == 1 && size (first (Path)) == 1) {
+            const node &n = first (first (Path));
+            if (n.Flag != flag::client || !bool (n.Digest)) return {};
+            return map {}.insert (*n.Digest, path {n.Offset, {}});
+        }
+
         ordst<ptr<smash>> smashes;
         for (const ordst<node> &n : Path) smashes = path_next_layer (smashes, n);
         map m;
@@ -11,27 +11,11 @@ namespace Gigamonkey::Merkle {
     bool dual::valid () const {
         if (!Root.valid () || !Paths.valid () || Paths.size () == 0) return false;
 
-        ordst<branch> current;
-
-        for (const auto &e : Paths) current >>= branch {e.Key, e.Value};
-
-        while (true) {
-            if (current.size () == 1 && first (current).Digests.size () == 0) break;
-
-            stack<branch> next;
-            for (const auto &b : current) next >>= b;
-
-            current = ordst<branch> {};
-
-            for (const auto &b : next) {
-                branch n = b.rest ();
-                if (size (current) == 0 || first (current) != n) current >>= n;
-            }
-
-        }
-
-        return Root == first (current).Leaf.Digest;
+        std::vector<branch> branches {};
+        branches.reserve (Paths.size ());
+        for (const auto &e : Paths) branches.push_back (branch {e.Key, e.Value});
 
+        return failed (branches, Root).size () == 0;
     }
     
 }
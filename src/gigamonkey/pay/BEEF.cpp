@@ -48,9 +48,13 @@ namespace Gigamonkey {
     }
 
     stack<digest256> BEEF::roots () const {
+        // all the BUMPs are checked together.
+        std::vector<Merkle::BUMP> bumps {};
+        bumps.reserve (size (BUMPs));
+        for (const auto &bump : BUMPs) bumps.push_back (bump);
+
         list<digest256> result;
-        for (const auto &bump : BUMPs) {
-            auto r = bump.root ();
+        for (const digest256 &r : Merkle::BUMP::roots (bumps)) {
             if (!r.valid ()) return {};
             result <<= r;
         }
@@ -1,9 +1,30 @@
 
 #include <gigamonkey/pay/extended.hpp>
 #include <gigamonkey/script/interpreter.hpp>
+#include <gigamonkey/script/standard.hpp>
 
 namespace Gigamonkey::extended {
 
+    Bitcoin::result input::evaluate (Bitcoin::incomplete::transaction &tx, uint32 input_index,
+        Bitcoin::flag flags, const Bitcoin::sighash::precomputed *pre) const {
+        return Bitcoin::evaluate_standard (this->Script, Prevout.Script,
+            Bitcoin::redemption_document {tx, input_index, Prevout.Value, pre}, Bitcoin::script_config {flags});
+    }
+
+    // the incomplete transaction and the unlocking script
+    // contain everything that is checked by the script.
+    Bitcoin::result input::evaluate (Bitcoin::incomplete::transaction &tx, uint32 input_index,
+        Bitcoin::script_cache &cache, const digest256 &spending,
+        Bitcoin::flag flags, const Bitcoin::sighash::precomputed *pre) const {
+        Bitcoin::script_config conf {flags};
+        if (cache.contains (spending, input_index, this->Reference, this->Script, Prevout, conf)) return true;
+
+        Bitcoin::result r = Bitcoin::evaluate_standard (this->Script, Prevout.Script,
+            Bitcoin::redemption_document {tx, input_index, Prevout.Value, pre}, conf);
+        if (r) cache.insert (spending, input_index, this->Reference, this->Script, Prevout, conf);
+        return r;
+    }
+
     uint64 transaction::serialized_size () const {
         return 14u + Bitcoin::var_int::size (Inputs.size ()) + Bitcoin::var_int::size (Outputs.size ()) +
             data::fold ([] (uint64 size, const input &i) -> uint64 {
@@ -37,13 +37,14 @@ namespace Gigamonkey {
 
     extended::transaction redeemable_transaction::redeem (const Gigamonkey::redeem &r) const {
         Bitcoin::incomplete::transaction incomplete (*this);
+        Bitcoin::sighash::precomputed pre {incomplete};
 
         uint32 index = 0;
         list<Bitcoin::sighash::document> docs;
         for (const input &in : this->Inputs)
             docs <<= Bitcoin::sighash::document {
                 incomplete, index++, in.Prevout.Value,
-                Bitcoin::remove_after_last_code_separator (in.script_so_far ())};
+                Bitcoin::remove_after_last_code_separator (in.script_so_far ()), &pre};
 
         auto inputs = this->Inputs;
         auto sigs = Signatures;
@@ -5,12 +5,26 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/script.hpp>
+#include <gigamonkey/signature_cache.hpp>
 #include <gigamonkey/script/bitcoin_core.hpp>
 #include <gigamonkey/script/counter.hpp>
 #include <gigamonkey/script/stack.hpp>
 
 namespace Gigamonkey::Bitcoin {
-    result verify_signature (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc, flag P) {
+    namespace {
+        bool verify (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc, signature_cache *cache) {
+            if (cache == nullptr) return signature::verify (sig, pub, doc);
+
+            digest256 d = signature::hash (doc, signature::directive (sig));
+            slice<const byte> raw = signature::raw (sig);
+            if (cache->contains (d, pub, raw)) return true;
+            if (!secp256k1::pubkey::verify (pub, d, raw)) return false;
+            cache->insert (d, pub, raw);
+            return true;
+        }
+    }
+
+    ScriptError check_signature_encoding (slice<const byte> sig, slice<const byte> pub, flag P) {
 
         if (verify_compressed_pubkey (P))
             if (!secp256k1::pubkey::compressed (pub)) return SCRIPT_ERR_NONCOMPRESSED_PUBKEY;
@@ -37,14 +51,21 @@ namespace Gigamonkey::Bitcoin {
         if (verify_signature_low_S (P))
             if (!secp256k1::signature::normalized (raw)) return SCRIPT_ERR_SIG_HIGH_S;
 
-        if (signature::verify (sig, pub, doc)) return true;
+        return SCRIPT_ERR_OK;
+    }
+
+    result verify_signature (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc, flag P, signature_cache *cache) {
+
+        if (ScriptError err = check_signature_encoding (sig, pub, P); err != SCRIPT_ERR_OK) return err;
+
+        if (verify (sig, pub, doc, cache)) return true;
 
         if (verify_null_fail (P)) if (sig.size () != 0) return SCRIPT_ERR_SIG_NULLFAIL;
 
         return false;
     }
 
-    program remove_after_last_code_separator (slice<const byte> b) {
+    flat_program remove_after_last_code_separator (slice<const byte> b) {
         program_counter counter {b};
         while (counter.Next.size () > 0) counter = counter.next ();
         return counter.to_last_code_separator ();
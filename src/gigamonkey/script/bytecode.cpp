@@ -0,0 +1,240 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/bytecode.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    namespace {
+
+        bool inline is_bad_op (op o) {
+            return o == OP_INVALIDOPCODE || o == OP_RESERVED || o == OP_RESERVED1 ||
+                o == OP_RESERVED2 || o >= FIRST_UNDEFINED_OP_VALUE;
+        }
+
+        // decode a script into operations, with the same errors that
+        // decompile would throw. Positions are given relative to offset.
+        void decode (std::vector<bytecode::operation> &ops, slice<const byte> b, uint32 offset) {
+            size_t n = b.size ();
+            size_t i = 0;
+
+            // open conditionals, which we track in the same way as decompile.
+            std::vector<op> control;
+
+            while (i < n) {
+                op o = op (b[i]);
+                size_t data = i + 1;
+                size_t size = 0;
+
+                if (is_push_data (o)) {
+                    if (o <= OP_PUSHSIZE75) size = o;
+                    else if (o == OP_PUSHDATA1) {
+                        if (n < i + 2) throw invalid_program {SCRIPT_ERR_PUSH_SIZE};
+                        size = b[i + 1];
+                        data = i + 2;
+                    } else if (o == OP_PUSHDATA2) {
+                        if (n < i + 3) throw invalid_program {SCRIPT_ERR_PUSH_SIZE};
+                        size = size_t (b[i + 1]) | (size_t (b[i + 2]) << 8);
+                        data = i + 3;
+                    } else {
+                        if (n < i + 5) throw invalid_program {SCRIPT_ERR_PUSH_SIZE};
+                        size = size_t (b[i + 1]) | (size_t (b[i + 2]) << 8) |
+                            (size_t (b[i + 3]) << 16) | (size_t (b[i + 4]) << 24);
+                        data = i + 5;
+                    }
+
+                    if (n - data < size) throw invalid_program {SCRIPT_ERR_PUSH_SIZE};
+                } else if (is_bad_op (o)) throw invalid_program {SCRIPT_ERR_BAD_OPCODE};
+
+                if (o == OP_ENDIF) {
+                    if (control.empty ()) throw invalid_program {SCRIPT_ERR_UNBALANCED_CONDITIONAL};
+                    op prev = control.back ();
+                    control.pop_back ();
+
+                    if (prev == OP_ELSE) {
+                        if (control.empty ()) throw invalid_program {SCRIPT_ERR_UNBALANCED_CONDITIONAL};
+                        control.pop_back ();
+                    }
+                } else if (o == OP_ELSE || o == OP_IF || o == OP_NOTIF) control.push_back (o);
+
+                uint32 end = static_cast<uint32> (data + size);
+                ops.push_back (bytecode::operation {o, bytecode::classify (o),
+                    static_cast<uint32> (offset + i), static_cast<uint32> (offset + data), offset + end, 0});
+
+                i = end;
+            }
+        }
+
+        // copy operations from one bytecode into another.
+        void append (bytecode &to, uint32 &written, const bytecode &from, size_t first, size_t last) {
+            if (first == last) return;
+            uint32 begin = from.Operations[first].Begin;
+            uint32 end = from.Operations[last - 1].End;
+            std::copy (from.Script.begin () + begin, from.Script.begin () + end, to.Script.begin () + written);
+
+            for (size_t i = first; i < last; i++) {
+                bytecode::operation x = from.Operations[i];
+                x.Begin = x.Begin - begin + written;
+                x.Data = x.Data - begin + written;
+                x.End = x.End - begin + written;
+                to.Operations.push_back (x);
+            }
+
+            written += end - begin;
+        }
+
+        void append (bytecode &to, uint32 &written, op o) {
+            to.Script[written] = o;
+            to.Operations.push_back (bytecode::operation {o, bytecode::classify (o), written, written + 1, written + 1, 0});
+            written++;
+        }
+
+        // the data that is pushed by an operation, as in instruction::push_data.
+        bytes push_data (const bytecode &b, const bytecode::operation &x) {
+            if (is_push_data (x.Op)) return bytes (b.push_data (x));
+            if (!is_push (x.Op)) return {};
+            return bytes (integer {x.Op == OP_1NEGATE ? -1 : int (x.Op - 0x50)});
+        }
+
+        bool is_minimal (const bytecode &b, const bytecode::operation &x) {
+            return is_minimal_push (x.Op, b.push_data (x));
+        }
+    }
+
+    bytecode::bytecode (slice<const byte> b) : Script (b.size ()), Operations {} {
+        std::copy (b.begin (), b.end (), Script.begin ());
+        decode (Operations, b, 0);
+        link ();
+    }
+
+    void bytecode::link () {
+        // branches that have not yet been closed.
+        struct branch {
+            uint32 Index;
+            bool Skip;
+        };
+
+        std::vector<branch> open;
+        uint32 last = static_cast<uint32> (Operations.size ());
+        uint32 count = 0;
+
+        // close the innermost branch at i. A branch that cannot be
+        // skipped means that the branch containing it cannot either.
+        auto close = [&] (uint32 i, bool skip) {
+            operation &x = Operations[open.back ().Index];
+            x.Jump = i;
+            x.Skip = open.back ().Skip;
+            if (!skip && open.size () > 1) open[open.size () - 2].Skip = false;
+        };
+
+        for (uint32 i = 0; i < last; i++) {
+            operation &x = Operations[i];
+            x.Jump = i + 1;
+            x.Count = count;
+            x.Skip = false;
+
+            if (x.Op > OP_16) count++;
+
+            if (x.Op == OP_IF || x.Op == OP_NOTIF) {
+                x.Jump = last;
+                open.push_back (branch {i, true});
+            } else if (x.Op == OP_ELSE) {
+                x.Jump = last;
+                if (!open.empty ()) {
+                    // a second OP_ELSE is an error after genesis, so
+                    // the branch containing it cannot be skipped.
+                    close (i, open.back ().Skip && Operations[open.back ().Index].Op != OP_ELSE);
+                    open.back () = branch {i, true};
+                }
+            } else if (x.Op == OP_ENDIF) {
+                if (!open.empty ()) {
+                    close (i, open.back ().Skip);
+                    open.pop_back ();
+                }
+            } else if (x.Op == OP_VERIF || x.Op == OP_VERNOTIF) {
+                // these are an error before genesis even when not executed.
+                if (!open.empty ()) open.back ().Skip = false;
+            }
+        }
+    }
+
+    // note: pay to script hash only applies to scripts that were created before genesis.
+    bytecode full (const bytecode &unlock, const bytecode &lock, bool support_p2sh) {
+        bytecode b {};
+        uint32 written = 0;
+
+        if (!support_p2sh || !is_P2SH (lock) || unlock.size () == 0) {
+            b.Script.resize (unlock.Script.size () + lock.Script.size () + 1);
+            b.Operations.reserve (unlock.size () + lock.size () + 1);
+
+            append (b, written, unlock, 0, unlock.size ());
+            append (b, written, OP_CODESEPARATOR);
+            append (b, written, lock, 0, lock.size ());
+        } else {
+            // For P2SH scripts. This is a depricated special case that is supported for backwards compatability.
+            const bytecode::operation &push_redeem = unlock.Operations.back ();
+            bytecode redeem {push_data (unlock, push_redeem)};
+
+            b.Script.resize (push_redeem.Begin + redeem.Script.size () + (push_redeem.End - push_redeem.Begin) + lock.Script.size () + 2);
+            b.Operations.reserve (unlock.size () + redeem.size () + lock.size () + 2);
+
+            append (b, written, unlock, 0, unlock.size () - 1);
+            append (b, written, OP_CODESEPARATOR);
+            append (b, written, redeem, 0, redeem.size ());
+            append (b, written, OP_VERIFY);
+            append (b, written, unlock, unlock.size () - 1, unlock.size ());
+            append (b, written, lock, 0, lock.size ());
+        }
+
+        b.link ();
+        return b;
+    }
+
+    ScriptError pre_verify (const bytecode &b, flag flags) {
+        const auto &ops = b.Operations;
+        size_t n = ops.size ();
+
+        if (n == 0) return SCRIPT_ERR_OK;
+
+        // first we check for OP_RETURN data.
+        if (safe_return_data (flags)) {
+            if (n == 2 && ops[0].Op == OP_FALSE && ops[1].Op == OP_RETURN) return SCRIPT_ERR_OK;
+        } else if (n == 1 && ops[0].Op == OP_RETURN) return SCRIPT_ERR_OK;
+
+        std::vector<op> control;
+
+        for (size_t i = 0; i < n; i++) {
+            const bytecode::operation &x = ops[i];
+            op o = x.Op;
+
+            if (is_bad_op (o)) return SCRIPT_ERR_BAD_OPCODE;
+
+            if (verify_minimal_push (flags) && !is_minimal (b, x)) return SCRIPT_ERR_MINIMALDATA;
+
+            // prior to genesis, OP_RETURN is not allowed to appear in a
+            // normal script. It must be in a script consisting only of
+            // itself.
+            if (o == OP_RETURN) {
+                if (!safe_return_data (flags)) return SCRIPT_ERR_OP_RETURN;
+                if (control.empty () && i + 1 == n) return SCRIPT_ERR_OK;
+            }
+
+            if (o == OP_ENDIF) {
+                if (control.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                op prev = control.back ();
+                control.pop_back ();
+
+                if (prev == OP_ELSE) {
+                    if (control.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                    prev = control.back ();
+                    control.pop_back ();
+                }
+
+                if (prev != OP_IF && prev != OP_NOTIF) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+            } else if (o == OP_ELSE || o == OP_IF || o == OP_NOTIF) control.push_back (o);
+        }
+
+        return control.empty () ? SCRIPT_ERR_OK : SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+    }
+
+}
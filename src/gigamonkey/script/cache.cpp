@@ -0,0 +1,24 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/cache.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    digest256 script_cache::key (const digest256 &tx, uint32 input_index, const outpoint &o,
+        slice<const byte> unlock, const output &prevout, const script_config &conf) const {
+        SHA_2_256_writer w;
+        w << Salt << tx << uint32_little {input_index} << o << uint64_little {unlock.size ()} << unlock << prevout <<
+            uint32_little {static_cast<uint32> (conf.Flags)} <<
+            uint64_little {conf.MaxOpsPerScript} << uint64_little {conf.MaxPubKeysPerMultiSig} <<
+            uint64_little {conf.MaxStackMemoryUsage} << uint64_little {conf.MaxScriptNumLength} <<
+            uint64_little {conf.MaxScriptSize};
+        return w.complete ();
+    }
+
+    script_cache &script_cache::global () {
+        static script_cache cache {};
+        return cache;
+    }
+
+}
@@ -0,0 +1,396 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/classifier.hpp>
+#include <gigamonkey/boost/boost.hpp>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace Gigamonkey {
+
+    namespace {
+
+        using namespace Bitcoin;
+
+        // one instruction of a script.
+        struct step {
+            op Op;
+            size_t Begin;
+            size_t DataBegin;
+            size_t End;
+        };
+
+        // read the instruction at the given position. Returns false if the script is truncated.
+        bool read_step (slice<const byte> script, size_t at, step &s) {
+            s.Op = op (script[at]);
+            s.Begin = at;
+            size_t remaining = script.size () - at - 1;
+
+            size_t header = 0;
+            size_t size = 0;
+            if (s.Op == OP_0 || !is_push_data (s.Op)) {
+            } else if (s.Op <= OP_PUSHSIZE75) size = s.Op;
+            else if (s.Op == OP_PUSHDATA1) {
+                if (remaining < 1) return false;
+                header = 1;
+                size = script[at + 1];
+            } else if (s.Op == OP_PUSHDATA2) {
+                if (remaining < 2) return false;
+                header = 2;
+                size = boost::endian::load_little_u16 (&script[at + 1]);
+            } else {
+                if (remaining < 4) return false;
+                header = 4;
+                size = boost::endian::load_little_u32 (&script[at + 1]);
+            }
+
+            if (remaining - header < size) return false;
+            s.DataBegin = at + 1 + header;
+            s.End = s.DataBegin + size;
+            return true;
+        }
+
+        // a token after code tokens have been expanded.
+        struct element {
+            script_classifier::token::kind Kind;
+            op Op;
+            uint32 Size;
+            bytes Data;
+            bool Optional;
+            bool Repeated;
+            int16 Field;
+            // index of this token among capturing tokens.
+            int32 Token;
+        };
+
+        // what is known about an instruction that is read as a given symbol.
+        struct description {
+            bool Op;
+            byte Code;
+            uint32 Size;
+            // index into the data of push classes.
+            int32 Data;
+        };
+
+        bool accepts (const element &e, const description &d, const std::vector<bytes> &literals) {
+            using kind = script_classifier::token::kind;
+            bool push_data = !d.Op || d.Code == OP_0;
+            switch (e.Kind) {
+                case kind::op: return d.Op && d.Code == e.Op;
+                case kind::small_int: return d.Op && d.Code >= OP_1 && d.Code <= OP_16;
+                case kind::push: return !d.Op || is_push (op (d.Code));
+                case kind::push_size: return push_data && d.Size == e.Size;
+                case kind::push_data: return !d.Op && d.Data >= 0 && literals[d.Data] == e.Data;
+                case kind::pubkey: return !d.Op && (d.Size == secp256k1::pubkey::CompressedSize ||
+                    d.Size == secp256k1::pubkey::UncompressedSize);
+                default: return false;
+            }
+        }
+    }
+
+    script_classifier::script_classifier (const std::vector<script_template> &templates) :
+        Templates {static_cast<uint32> (templates.size ())}, Fields {}, Symbols {0}, Classes {}, OtherPush {0},
+        States {}, Next {}, Captures {}, Rests {}, Accepts {} {
+        using kind = token::kind;
+
+        if (templates.size () > MAX_TEMPLATES) throw std::invalid_argument {"too many script templates"};
+
+        // expand code tokens into instructions and collect sizes and data that must be recognized.
+        std::vector<std::vector<element>> elements;
+        std::set<uint32> sizes;
+        std::vector<bytes> literals;
+        int32 capturing = 0;
+
+        for (const script_template &t : templates) {
+            std::vector<element> &x = elements.emplace_back ();
+            int16 fields = 0;
+
+            for (const token &k : t) {
+                if (k.Kind == kind::rest && &k != &t.back ()) throw std::invalid_argument {"rest must be the last token"};
+
+                if (k.Kind == kind::code) {
+                    if (k.Optional || k.Repeated) throw std::invalid_argument {"code cannot be optional or repeated"};
+                    slice<const byte> code = k.Data;
+                    size_t at = 0;
+                    step s;
+                    while (at < code.size ()) {
+                        if (!read_step (code, at, s)) throw std::invalid_argument {"invalid program in script template"};
+                        if (s.Op != OP_0 && is_push_data (s.Op))
+                            x.push_back (element {kind::push_data, s.Op, 0,
+                                bytes (code.range (s.DataBegin, s.End)), false, false, -1, -1});
+                        else x.push_back (element {kind::op, s.Op, 0, bytes {}, false, false, -1, -1});
+                        at = s.End;
+                    }
+
+                    continue;
+                }
+
+                if (k.Kind == kind::op && k.Op != OP_0 && is_push_data (k.Op))
+                    throw std::invalid_argument {"use push_data to match pushes"};
+
+                element e {k.Kind, k.Op, k.Size, k.Data, k.Optional, k.Repeated, -1, -1};
+
+                // pushing empty data is OP_0.
+                if (e.Kind == kind::push_data && e.Data.size () == 0) {
+                    e.Kind = kind::op;
+                    e.Op = OP_0;
+                }
+
+                if (k.Capture) {
+                    if (fields == MAX_FIELDS) throw std::invalid_argument {"too many fields in script template"};
+                    e.Field = fields++;
+                    if (e.Kind != kind::rest) e.Token = capturing++;
+                }
+
+                x.push_back (e);
+            }
+
+            Fields.push_back (fields);
+        }
+
+        for (std::vector<element> &x : elements) for (element &e : x) {
+            if (e.Kind == kind::push_size) sizes.insert (e.Size);
+            else if (e.Kind == kind::pubkey) {
+                sizes.insert (secp256k1::pubkey::CompressedSize);
+                sizes.insert (secp256k1::pubkey::UncompressedSize);
+            } else if (e.Kind == kind::push_data) {
+                sizes.insert (e.Data.size ());
+                if (std::find (literals.begin (), literals.end (), e.Data) == literals.end ()) literals.push_back (e.Data);
+            }
+        }
+
+        // assign symbols. Within a size, classes for particular data come first.
+        std::vector<description> symbols;
+        for (uint32 i = 0; i < 256; i++) symbols.push_back (description {true, byte (i), 0, -1});
+
+        for (uint32 size : sizes) {
+            for (int32 i = 0; i < int32 (literals.size ()); i++) if (literals[i].size () == size) {
+                Classes.push_back (push_class {size, literals[i], uint32 (symbols.size ())});
+                symbols.push_back (description {false, 0, size, i});
+            }
+
+            Classes.push_back (push_class {size, bytes {}, uint32 (symbols.size ())});
+            symbols.push_back (description {false, 0, size, -1});
+        }
+
+        OtherPush = symbols.size ();
+        // a size that no token looks for.
+        symbols.push_back (description {false, 0, std::numeric_limits<uint32>::max (), -1});
+        Symbols = symbols.size ();
+
+        // which symbols each capturing token accepts.
+        Accepts.resize (capturing * Symbols);
+        for (std::vector<element> &x : elements) for (element &e : x) if (e.Token >= 0)
+            for (uint32 s = 0; s < Symbols; s++) Accepts[e.Token * Symbols + s] = accepts (e, symbols[s], literals);
+
+        // positions in the templates are numbered consecutively. A position
+        // at the end of a template means that the template has been matched.
+        std::vector<uint32> base;
+        std::vector<std::pair<uint32, uint32>> positions;
+        for (uint32 t = 0; t < Templates; t++) {
+            base.push_back (positions.size ());
+            for (uint32 i = 0; i <= elements[t].size (); i++) positions.push_back ({t, i});
+        }
+
+        // add a position and every position after it that could be reached by skipping optional tokens.
+        auto closure = [&] (std::set<uint32> &set, uint32 p) {
+            while (true) {
+                set.insert (p);
+                auto [t, i] = positions[p];
+                if (i == elements[t].size () || !elements[t][i].Optional) return;
+                p++;
+            }
+        };
+
+        std::map<std::set<uint32>, uint16> ids;
+        std::vector<std::set<uint32>> sets;
+
+        auto id = [&] (const std::set<uint32> &set) -> uint16 {
+            auto it = ids.find (set);
+            if (it != ids.end ()) return it->second;
+            if (sets.size () == std::numeric_limits<uint16>::max ())
+                throw std::invalid_argument {"too many states in script classifier"};
+            uint16 i = sets.size ();
+            ids[set] = i;
+            sets.push_back (set);
+            return i;
+        };
+
+        id (std::set<uint32> {});
+
+        {
+            std::set<uint32> start;
+            for (uint32 t = 0; t < Templates; t++) closure (start, base[t]);
+            id (start);
+        }
+
+        // subset construction.
+        for (uint32 current = 0; current < sets.size (); current++) {
+            std::set<uint32> set = sets[current];
+
+            state st {-1, uint32 (Captures.size ()), 0, uint32 (Rests.size ()), 0};
+            for (uint32 p : set) {
+                auto [t, i] = positions[p];
+                if (i == elements[t].size ()) {
+                    if (st.Accept < 0 || int32 (t) < st.Accept) st.Accept = t;
+                    continue;
+                }
+
+                const element &e = elements[t][i];
+                if (e.Kind == kind::rest) Rests.push_back (rest {uint16 (t), e.Field});
+                else if (e.Token >= 0) Captures.push_back (capture {uint16 (t), uint16 (e.Field), uint32 (e.Token), e.Repeated});
+            }
+
+            st.CapturesEnd = Captures.size ();
+            st.RestEnd = Rests.size ();
+            States.push_back (st);
+
+            for (uint32 s = 0; s < Symbols; s++) {
+                std::set<uint32> next;
+                std::vector<bool> matched (Templates, false);
+
+                for (uint32 p : set) {
+                    auto [t, i] = positions[p];
+                    if (i == elements[t].size ()) continue;
+
+                    const element &e = elements[t][i];
+                    if (e.Kind == kind::rest || !accepts (e, symbols[s], literals)) continue;
+
+                    if (matched[t]) throw std::invalid_argument {"ambiguous script template"};
+                    matched[t] = true;
+
+                    closure (next, p + 1);
+                    if (e.Repeated) next.insert (p);
+                }
+
+                uint16 n = id (next);
+                Next.resize (sets.size () * Symbols, 0);
+                Next[current * Symbols + s] = n;
+            }
+        }
+    }
+
+    uint32 script_classifier::symbol (slice<const byte> data) const {
+        auto it = std::lower_bound (Classes.begin (), Classes.end (), data.size (),
+            [] (const push_class &c, size_t size) -> bool {
+                return c.Size < size;
+            });
+
+        for (; it != Classes.end () && it->Size == data.size (); it++)
+            if (it->Data.size () == 0 || std::equal (data.begin (), data.end (), it->Data.begin ())) return it->Symbol;
+
+        return OtherPush;
+    }
+
+    script_classifier::match script_classifier::classify (slice<const byte> script) const {
+        // captured parts of the script for each template.
+        constexpr size_t unset = std::numeric_limits<size_t>::max ();
+        std::array<std::array<std::pair<size_t, size_t>, MAX_FIELDS>, MAX_TEMPLATES> fields;
+        for (uint32 t = 0; t < Templates; t++) for (uint32 f = 0; f < Fields[t]; f++) fields[t][f] = {unset, unset};
+
+        int32 rest_match = -1;
+        uint32 current = 1;
+        size_t at = 0;
+        bool complete = false;
+
+        while (true) {
+            const state &st = States[current];
+
+            for (uint32 r = st.RestBegin; r < st.RestEnd; r++) {
+                const rest &x = Rests[r];
+                if (x.Field >= 0) fields[x.Template][x.Field] = {at, script.size ()};
+                if (rest_match < 0 || x.Template < rest_match) rest_match = x.Template;
+            }
+
+            if (at == script.size ()) {
+                complete = true;
+                break;
+            }
+
+            step s;
+            if (!read_step (script, at, s)) break;
+
+            uint32 sym = s.Op != Bitcoin::OP_0 && Bitcoin::is_push_data (s.Op) ?
+                symbol (script.range (s.DataBegin, s.End)) : uint32 (s.Op);
+
+            for (uint32 c = st.CapturesBegin; c < st.CapturesEnd; c++) {
+                const capture &x = Captures[c];
+                if (!Accepts[x.Token * Symbols + sym]) continue;
+                std::pair<size_t, size_t> &field = fields[x.Template][x.Field];
+                if (!x.Repeated) field = Bitcoin::is_push_data (s.Op) ?
+                    std::pair<size_t, size_t> {s.DataBegin, s.End} : std::pair<size_t, size_t> {s.Begin, s.End};
+                else {
+                    if (field.first == unset) field.first = s.Begin;
+                    field.second = s.End;
+                }
+            }
+
+            current = Next[current * Symbols + sym];
+            at = s.End;
+            if (current == 0) break;
+        }
+
+        int32 accepted = complete ? States[current].Accept : -1;
+        if (accepted < 0 || (rest_match >= 0 && rest_match < accepted)) accepted = rest_match;
+
+        match m {accepted, {}};
+        if (accepted < 0) return m;
+
+        for (uint32 f = 0; f < Fields[accepted]; f++) {
+            auto [begin, end] = fields[accepted][f];
+            if (begin != unset) m.Fields[f] = script.range (begin, end);
+        }
+
+        return m;
+    }
+
+    namespace {
+
+        // everything in a Boost output script after the additional data.
+        bytes boost_script_tail (bool use_general_purpose_bits) {
+            bytes script = Boost::output_script::bounty (1, uint256 {0}, work::compact {uint32 (0x1d00ffff)},
+                bytes {}, 0, bytes {}, use_general_purpose_bits).write ();
+
+            // "boostpow", OP_DROP, category, content, target, tag, user nonce, additional data.
+            size_t at = 0;
+            step s;
+            for (int i = 0; i < 8; i++) {
+                read_step (script, at, s);
+                at = s.End;
+            }
+
+            return bytes (slice<const byte> (script).drop (at));
+        }
+
+        script_classifier::script_template boost_template (bool use_general_purpose_bits) {
+            using token = script_classifier::token;
+            return {
+                token::push_data (bytes {0x62, 0x6F, 0x6F, 0x73, 0x74, 0x70, 0x6F, 0x77}), OP_DROP,
+                token::push_size (20).optional (),
+                token::push_size (4),
+                token::push_size (32),
+                token::push_size (4),
+                token::push (),
+                token::push_size (4),
+                token::push (),
+                token::code (boost_script_tail (use_general_purpose_bits))};
+        }
+    }
+
+    const script_classifier &script_classifier::standard () {
+        using namespace Bitcoin;
+        static script_classifier Standard {std::vector<script_template> {
+            {OP_DUP, OP_HASH160, token::push_size (20), OP_EQUALVERIFY, OP_CHECKSIG},
+            {OP_HASH160, token::push_size (20), OP_EQUAL},
+            {token::pubkey (), OP_CHECKSIG},
+            {token::small_int (), token::pubkey ().repeated (), token::small_int (), OP_CHECKMULTISIG},
+            {token {OP_FALSE}.optional (), OP_RETURN, token::rest ()},
+            boost_template (false),
+            boost_template (true)}};
+
+        return Standard;
+    }
+
+}
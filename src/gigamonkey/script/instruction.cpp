@@ -3,6 +3,7 @@
 
 #include <gigamonkey/script/pattern.hpp>
 #include <data/math/number/bytes/Z.hpp>
+#include <boost/endian/conversion.hpp>
 
 namespace Gigamonkey::Bitcoin {
 
@@ -41,15 +42,6 @@ namespace Gigamonkey::Bitcoin {
             return SCRIPT_ERR_OK;
         }
         
-        bool is_minimal_push (const op o, const bytes &data) {
-            if (!is_push_data (o)) return data.size () == 0;
-            if (data.size () == 1 && (data[0] == 0x81 || (data[0] >= 1 && data[0] <= 16))) return false;
-            if (o == OP_PUSHDATA1) return data.size () > 75;
-            if (o == OP_PUSHDATA2) return data.size () > 256;
-            if (o == OP_PUSHDATA4) return data.size () > 65536;
-            return true;
-        }
-        
         template <typename W>
         struct script_writer {
             W &Writer;
@@ -133,6 +125,15 @@ namespace Gigamonkey::Bitcoin {
     
     }
 
+    bool is_minimal_push (op o, slice<const byte> data) {
+        if (!is_push_data (o)) return data.size () == 0;
+        if (data.size () == 1 && (data[0] == 0x81 || (data[0] >= 1 && data[0] <= 16))) return false;
+        if (o == OP_PUSHDATA1) return data.size () > 75;
+        if (o == OP_PUSHDATA2) return data.size () > 256;
+        if (o == OP_PUSHDATA4) return data.size () > 65536;
+        return true;
+    }
+
     ScriptError instruction::verify (flag flags) const {
         auto script_error = verify_instruction (*this);
         if (script_error != SCRIPT_ERR_OK) return script_error;
@@ -313,39 +314,6 @@ namespace Gigamonkey::Bitcoin {
         return compiled;
     }
     
-    program decompile (slice<const byte> b) {
-        
-        program p {};
-        script_reader r {it_rdr {b.data (), b.data () + b.size ()}};
-        
-        stack<op> Control;
-        
-        while (!r.empty ()) {
-            instruction i {};
-            r = r >> i;
-            
-            if (auto err = i.verify (flag {}); err != SCRIPT_ERR_OK) throw invalid_program {err};
-            
-            if (i.Op == OP_ENDIF) {
-                if (Control.empty ()) throw invalid_program {SCRIPT_ERR_UNBALANCED_CONDITIONAL};
-                op prev = first (Control);
-                Control = rest (Control);
-
-                if (prev == OP_ELSE) {
-                    if (Control.empty ()) throw invalid_program {SCRIPT_ERR_UNBALANCED_CONDITIONAL};
-                    prev = first (Control);
-                    Control = rest (Control);
-                }
-
-                if (prev != OP_IF && prev != OP_NOTIF) invalid_program {SCRIPT_ERR_UNBALANCED_CONDITIONAL};
-            } else if (i.Op == OP_ELSE || i.Op == OP_IF || i.Op == OP_NOTIF) Control = Control >> i.Op;
-            
-            p = p << i;
-        }
-        
-        return p;
-    }
-    
     // TODO need to take into account OP_VER etc
     ScriptError valid_program (program p, stack<op> x, flag flags) {
         
@@ -421,5 +389,314 @@ namespace Gigamonkey::Bitcoin {
         for (const instruction &i : p) if (i != sig) q <<= i;
         return q;
     }
-    
+
+    namespace {
+
+        // read the instruction at the given position without copying its data.
+        // Returns SCRIPT_ERR_PUSH_SIZE if the script ends before the instruction does.
+        ScriptError read_next (slice<const byte> b, size_t at, op &o, slice<const byte> &data, size_t &next) {
+            o = op (b[at]);
+            size_t remaining = b.size () - at - 1;
+
+            size_t header = 0;
+            size_t size = 0;
+            if (!is_push_data (o)) {
+            } else if (o <= OP_PUSHSIZE75) size = o;
+            else if (o == OP_PUSHDATA1) {
+                if (remaining < 1) return SCRIPT_ERR_PUSH_SIZE;
+                header = 1;
+                size = b[at + 1];
+            } else if (o == OP_PUSHDATA2) {
+                if (remaining < 2) return SCRIPT_ERR_PUSH_SIZE;
+                header = 2;
+                size = boost::endian::load_little_u16 (&b[at + 1]);
+            } else {
+                if (remaining < 4) return SCRIPT_ERR_PUSH_SIZE;
+                header = 4;
+                size = boost::endian::load_little_u32 (&b[at + 1]);
+            }
+
+            if (remaining - header < size) return SCRIPT_ERR_PUSH_SIZE;
+            data = b.range (at + 1 + header, at + 1 + header + size);
+            next = at + 1 + header + size;
+            return SCRIPT_ERR_OK;
+        }
+
+        bool inline is_bad_op (op o) {
+            return o == OP_INVALIDOPCODE || o == OP_RESERVED || o == OP_RESERVED1 ||
+                o == OP_RESERVED2 || o >= FIRST_UNDEFINED_OP_VALUE;
+        }
+
+        // the conditionals that have been opened but not closed, one bit
+        // per conditional which is set for OP_ELSE. Only scripts nested
+        // more than 512 deep need to allocate anything.
+        struct control_stack {
+            std::array<uint64, 8> Inline {};
+            std::vector<uint64> Overflow {};
+            size_t Size {0};
+
+            bool empty () const {
+                return Size == 0;
+            }
+
+            uint64 &word (size_t i) {
+                return i < Inline.size () * 64 ? Inline[i / 64] : Overflow[i / 64 - Inline.size ()];
+            }
+
+            void push (op o) {
+                if (Size == (Inline.size () + Overflow.size ()) * 64) Overflow.push_back (0);
+                uint64 bit = uint64 (1) << (Size % 64);
+                uint64 &w = word (Size);
+                w = o == OP_ELSE ? w | bit : w & ~bit;
+                Size++;
+            }
+
+            // remove the top element. Returns true for OP_ELSE.
+            bool pop () {
+                Size--;
+                return (word (Size) >> (Size % 64)) & 1;
+            }
+
+            // match an OP_ENDIF with the conditional that it closes. Returns false
+            // if there is none. If an OP_ELSE is closed by another OP_ELSE, matched
+            // is set to false. decompile accepts that but pre_verify does not.
+            bool close (bool &matched) {
+                matched = true;
+                if (empty ()) return false;
+                if (pop ()) {
+                    if (empty ()) return false;
+                    if (pop ()) matched = false;
+                }
+
+                return true;
+            }
+        };
+
+        // an instruction read by scan.
+        struct reading {
+            op Op;
+            // position of the instruction in the script.
+            size_t Begin;
+            size_t End;
+            slice<const byte> Data;
+            // whether this is the last instruction in the script.
+            bool Last;
+            // whether a conditional is open after this instruction.
+            bool Open;
+            // for OP_ENDIF, false if the conditional it closes is not OP_IF or OP_NOTIF.
+            bool Matched;
+        };
+
+        // go through every instruction that decompile would read and return
+        // the error it would throw. f is called for each instruction in order
+        // and scanning stops early if it returns false.
+        template <typename F> ScriptError scan (slice<const byte> b, F f) {
+            control_stack control {};
+            size_t at = 0;
+            while (at < b.size ()) {
+                reading r {};
+                r.Begin = at;
+                r.Matched = true;
+                size_t next;
+                if (auto err = read_next (b, at, r.Op, r.Data, next); err != SCRIPT_ERR_OK) return err;
+                if (is_bad_op (r.Op)) return SCRIPT_ERR_BAD_OPCODE;
+
+                if (r.Op == OP_ENDIF) {
+                    if (!control.close (r.Matched)) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                } else if (r.Op == OP_ELSE || r.Op == OP_IF || r.Op == OP_NOTIF) control.push (r.Op);
+
+                r.End = next;
+                r.Last = next == b.size ();
+                r.Open = !control.empty ();
+                if (!f (r)) return SCRIPT_ERR_OK;
+                at = next;
+            }
+
+            return SCRIPT_ERR_OK;
+        }
+    }
+
+    ScriptError verify_script (slice<const byte> b) {
+        return scan (b, [] (const reading &) -> bool {
+            return true;
+        });
+    }
+
+    bool is_push (slice<const byte> b) {
+        bool push = true;
+        return scan (b, [&push] (const reading &r) -> bool {
+            return push = is_push (r.Op);
+        }) == SCRIPT_ERR_OK && push;
+    }
+
+    bool is_minimal_script (slice<const byte> b) {
+        bool minimal = true;
+        return scan (b, [&minimal] (const reading &r) -> bool {
+            return minimal = is_minimal_push (r.Op, r.Data);
+        }) == SCRIPT_ERR_OK && minimal;
+    }
+
+    ScriptError pre_verify (slice<const byte> b, flag flags) {
+        if (b.size () == 0) return SCRIPT_ERR_OK;
+
+        // first we check for OP_RETURN data.
+        if (safe_return_data (flags)) {
+            if (b.size () == 2 && b[0] == OP_FALSE && b[1] == OP_RETURN) return SCRIPT_ERR_OK;
+        } else if (b.size () == 1 && b[0] == OP_RETURN) return SCRIPT_ERR_OK;
+
+        // the same checks as valid_program, except that an error that
+        // decompile would throw comes first, even if it appears later.
+        ScriptError checked = SCRIPT_ERR_OK;
+        bool done = false;
+        auto err = scan (b, [&] (const reading &r) -> bool {
+            if (done) return true;
+
+            if (verify_minimal_push (flags) && !is_minimal_push (r.Op, r.Data)) checked = SCRIPT_ERR_MINIMALDATA;
+            else if (r.Op == OP_RETURN && !safe_return_data (flags)) checked = SCRIPT_ERR_OP_RETURN;
+            else if (!r.Matched || (r.Last && r.Open)) checked = SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+
+            done = checked != SCRIPT_ERR_OK;
+            return true;
+        });
+
+        return err != SCRIPT_ERR_OK ? err : checked;
+    }
+
+    uint64 sigops (slice<const byte> b) {
+        uint64 count = 0;
+        scan (b, [&count] (const reading &r) -> bool {
+            if (r.Op == OP_CHECKSIG || r.Op == OP_CHECKSIGVERIFY) count++;
+            else if (r.Op == OP_CHECKMULTISIG || r.Op == OP_CHECKMULTISIGVERIFY) count += 20;
+            return true;
+        });
+
+        return count;
+    }
+
+    program decompile (slice<const byte> b) {
+        program p {};
+        if (auto err = scan (b, [&p] (const reading &r) -> bool {
+            p <<= instruction::read (b.range (r.Begin, r.End));
+            return true;
+        }); err != SCRIPT_ERR_OK) throw invalid_program {err};
+
+        return p;
+    }
+
+    // builds a flat_program one instruction at a time into a buffer of known size.
+    struct flat_writer {
+        bytes Script;
+        std::vector<uint32> Offsets;
+        uint32 Written;
+
+        flat_writer (size_t size, size_t instructions) : Script (size), Offsets {}, Written {0} {
+            Offsets.reserve (instructions + 1);
+        }
+
+        flat_writer &operator << (slice<const byte> code) {
+            Offsets.push_back (Written);
+            std::copy (code.begin (), code.end (), Script.begin () + Written);
+            Written += code.size ();
+            return *this;
+        }
+
+        flat_writer &operator << (op o) {
+            byte b = o;
+            return *this << slice<const byte> {&b, 1};
+        }
+
+        flat_writer &operator << (const flat_program &p) {
+            for (size_t i = 0; i < p.size (); i++) *this << p.code (i);
+            return *this;
+        }
+
+        flat_program complete () {
+            Offsets.push_back (Written);
+            uint32 n = Offsets.size () - 1;
+            return flat_program {std::make_shared<const bytes> (std::move (Script)),
+                std::make_shared<const std::vector<uint32>> (std::move (Offsets)), 0, n};
+        }
+    };
+
+    flat_program::flat_program (slice<const byte> b) : flat_program {} {
+        auto offsets = std::make_shared<std::vector<uint32>> ();
+        if (auto err = scan (b, [&offsets] (const reading &r) -> bool {
+            offsets->push_back (r.Begin);
+            return true;
+        }); err != SCRIPT_ERR_OK) throw invalid_program {err};
+
+        offsets->push_back (b.size ());
+        Script = std::make_shared<const bytes> (b);
+        End = offsets->size () - 1;
+        Offsets = offsets;
+    }
+
+    flat_program::flat_program (program p) : flat_program {} {
+        // a program is not checked when it is compiled, so neither is this.
+        auto offsets = std::make_shared<std::vector<uint32>> ();
+        offsets->reserve (p.size () + 1);
+        uint32 at = 0;
+        for (const instruction &i : p) {
+            offsets->push_back (at);
+            at += serialized_size (i);
+        }
+
+        offsets->push_back (at);
+        Script = std::make_shared<const bytes> (compile (p));
+        End = offsets->size () - 1;
+        Offsets = offsets;
+    }
+
+    flat_program::operator program () const {
+        program p {};
+        for (size_t i = 0; i < size (); i++) p <<= (*this)[i];
+        return p;
+    }
+
+    flat_program operator << (const flat_program &p, const instruction &i) {
+        bytes code = compile (i);
+        flat_writer w {p.script ().size () + code.size (), p.size () + 1};
+        w << p << slice<const byte> (code);
+        return w.complete ();
+    }
+
+    flat_program find_and_delete (const flat_program &p, const instruction &sig) {
+        bytes pattern = compile (sig);
+        auto match = [&pattern] (slice<const byte> code) -> bool {
+            return code.size () == pattern.size () && std::equal (code.begin (), code.end (), pattern.begin ());
+        };
+
+        size_t size = 0;
+        size_t count = 0;
+        for (size_t i = 0; i < p.size (); i++) if (slice<const byte> code = p.code (i); !match (code)) {
+            size += code.size ();
+            count++;
+        }
+
+        // nothing to delete, so nothing needs to be copied.
+        if (count == p.size ()) return p;
+
+        flat_writer w {size, count};
+        for (size_t i = 0; i < p.size (); i++) if (slice<const byte> code = p.code (i); !match (code)) w << code;
+        return w.complete ();
+    }
+
+    flat_program full (const flat_program &unlock, const flat_program &lock, bool support_p2sh) {
+        if (!support_p2sh || !is_P2SH (lock.script ()) || unlock.empty ()) {
+            flat_writer w {unlock.script ().size () + lock.script ().size () + 1, unlock.size () + lock.size () + 1};
+            w << unlock << OP_CODESEPARATOR << lock;
+            return w.complete ();
+        }
+
+        // For P2SH scripts. This is a depricated special case that is supported for backwards compatability.
+        size_t last = unlock.size () - 1;
+        slice<const byte> push_redeem = unlock.code (last);
+        flat_program redeem {unlock.push_data (last)};
+
+        flat_writer w {unlock.script ().size () + redeem.script ().size () + lock.script ().size () + 2,
+            unlock.size () + redeem.size () + lock.size () + 2};
+        w << unlock.range (0, last) << OP_CODESEPARATOR << redeem << OP_VERIFY << push_redeem << lock;
+        return w.complete ();
+    }
+
 }
@@ -9,37 +9,41 @@
 namespace Gigamonkey::Bitcoin {
 
     void setup_interpreter (interpreter &I, const script &ux, const script &lx, const script_config &conf) {
-        program p;
 
         try {
-            program unlock = decompile (ux);
-            program lock = decompile (lx);
+            bytecode unlock {ux};
+            bytecode lock {lx};
 
-            p = full (unlock, lock, conf.verify_P2SH ());
+            I.Code = std::make_shared<bytecode> (full (unlock, lock, conf.verify_P2SH ()));
 
-            if (conf.verify_unlock_push_only () && !is_push (unlock)) I.Machine.Result = SCRIPT_ERR_SIG_PUSHONLY;
+            if (conf.verify_unlock_push_only () && !is_push (unlock)) I.Result = SCRIPT_ERR_SIG_PUSHONLY;
             else if (conf.verify_P2SH () && is_P2SH (lock)) {
-                if (empty (unlock)) I.Machine.Result =  SCRIPT_ERR_INVALID_STACK_OPERATION;
-                else if (!is_push (unlock)) I.Machine.Result = SCRIPT_ERR_SIG_PUSHONLY;
-            } else I.Machine.Result = pre_verify (p, conf.Flags);
+                if (unlock.size () == 0) I.Result =  SCRIPT_ERR_INVALID_STACK_OPERATION;
+                else if (!is_push (unlock)) I.Result = SCRIPT_ERR_SIG_PUSHONLY;
+            } else I.Result = pre_verify (*I.Code, conf.Flags);
 
         } catch (const invalid_program &x) {
-            I.Machine.Result.Error = x.Error;
+            I.Result.Error = x.Error;
         }
 
-        if (I.Machine.Result.Error != SCRIPT_ERR_OK) I.Machine.Halt = true;
+        if (I.Result.Error != SCRIPT_ERR_OK) I.Halt = true;
 
-        I.Script = compile (p);
-        I.Counter = program_counter {I.Script};
+        if (I.Code == nullptr) I.Code = std::make_shared<bytecode> ();
+        I.Counter = bytecode::counter {ptr<const bytecode> {I.Code}};
+    }
+
+    std::variant<machine<true>, machine<false>> make_machine (maybe<redemption_document> doc, const script_config &conf) {
+        if (enable_genesis_stack (conf.Flags)) return machine<true> {doc, conf};
+        return machine<false> {doc, conf};
     }
 
     interpreter::interpreter (const script &unlock, const script &lock, const redemption_document &doc, const script_config &conf) :
-        Machine {{doc}, conf} {
+        Halt {false}, Result {false}, Machine {make_machine ({doc}, conf)} {
         setup_interpreter (*this, unlock, lock, conf);
     }
 
     interpreter::interpreter (const script &unlock, const script &lock, const script_config &conf) :
-        Machine {{}, conf} {
+        Halt {false}, Result {false}, Machine {make_machine ({}, conf)} {
         setup_interpreter (*this, unlock, lock, conf);
     }
 
@@ -50,43 +54,42 @@ namespace Gigamonkey::Bitcoin {
     }
 
     std::ostream &operator << (std::ostream &o, const interpreter &i) {
-        return o << "interpreter {\n\tProgram: " << i.unread ()
-            << ",\n\tHalt: " << (i.Machine.Halt ? "true" : "false")
-            << ", Result: " << i.Machine.Result << ", Flags: " << i.Machine.Config.Flags
-            << ",\n\t" << *i.Machine.Stack << ", Exec: " << make_list (i.Machine.Exec)
-            << ", Else: " << make_list (i.Machine.Else) << "}";
+        return std::visit ([&o, &i] (const auto &m) -> std::ostream & {
+            return o << "interpreter {\n\tProgram: " << i.unread ()
+                << ",\n\tHalt: " << (i.Halt ? "true" : "false")
+                << ", Result: " << i.Result << ", Flags: " << m.Config.Flags
+                << ",\n\t" << m.Stack << ", Exec: " << make_list (m.Exec)
+                << ", Else: " << make_list (m.Else) << "}";
+        }, i.Machine);
     }
 
     result step_through (interpreter &m) {
         while (true) {
             std::cout << m << std::endl;
-            if (m.Machine.Halt) break;
+            if (m.Halt) break;
             data::wait_for_enter ();
             m.step ();
         }
 
-        std::cout << "Result " << m.Machine.Result << std::endl;
-        return m.Machine.Result;
+        std::cout << "Result " << m.Result << std::endl;
+        return m.Result;
     }
 
-    maybe<result> machine_step (machine &x, program_counter &p) {
-        auto r = x.step (p);
-        if (!bool (r)) ++p;
-        return r;
+    template <bool genesis> maybe<result> machine_step (machine<genesis> &x, bytecode::counter &p) {
+        return x.step (p);
     }
 
-    result machine_run (machine &x, program_counter &p) {
+    template <bool genesis> result machine_run (machine<genesis> &x, bytecode::counter &p) {
         while (true) {
             auto r = x.step (p);
             if (bool (r)) return *r;
-            else ++p;
         }
     }
 
-    template <typename R>
-    R catch_all_errors (R (*fn) (machine &, program_counter &), machine &x, program_counter &p) {
+    template <typename R, typename F>
+    R catch_all_errors (F fn) {
         try {
-            return fn (x, p);
+            return fn ();
         } catch (script_exception &err) {
             return err.Error;
         } /*catch (scriptnum_overflow_error &err) {
@@ -103,20 +106,149 @@ namespace Gigamonkey::Bitcoin {
     }
 
     void interpreter::step () {
-        if (Machine.Halt) return;
-        auto r = catch_all_errors<maybe<result>> (machine_step, Machine, Counter);
+        if (Halt) return;
+        auto r = catch_all_errors<maybe<result>> ([this] () {
+            return std::visit ([this] (auto &m) {
+                return machine_step (m, Counter);
+            }, Machine);
+        });
+
         if (bool (r)) {
-            Machine.Halt = true;
-            Machine.Result = *r;
+            Halt = true;
+            Result = *r;
         }
     }
 
     result interpreter::run () {
-        if (!Machine.Halt) {
-            Machine.Result = catch_all_errors<result> (machine_run, Machine, Counter);
-            Machine.Halt = true;
+        if (!Halt) {
+            Result = catch_all_errors<result> ([this] () {
+                return std::visit ([this] (auto &m) {
+                    return machine_run (m, Counter);
+                }, Machine);
+            });
+
+            Halt = true;
+        }
+
+        return Result;
+    }
+
+    lock_script::lock_script (const script &lock, const script_config &conf) :
+        Script {lock}, Code {}, Flags {conf.Flags}, Verified {SCRIPT_ERR_OK} {
+        try {
+            Code = std::make_shared<const bytecode> (lock);
+            Verified = pre_verify (full (bytecode {}, *Code, false), Flags);
+        } catch (const invalid_program &) {}
+    }
+
+    namespace {
+
+        result evaluate_one (const script &unlock, const script &lock,
+            const maybe<redemption_document> &doc, const script_config &conf) {
+            return bool (doc) ? evaluate (unlock, lock, *doc, conf) : evaluate (unlock, lock, conf);
+        }
+
+        bool same_operation (const bytecode &a, const bytecode &b, size_t i) {
+            slice<const byte> x = a.code (a.Operations[i]);
+            slice<const byte> y = b.code (b.Operations[i]);
+            return x.size () == y.size () && std::equal (x.begin (), x.end (), y.begin ());
+        }
+
+        // run unlock scripts containing only pushes ahead of the lock script. The
+        // first prefix operations, which are the same in all of them, are run once.
+        template <bool genesis> void evaluate_direct (std::vector<result> &results, const std::vector<size_t> &direct,
+            const std::vector<ptr<const bytecode>> &unlocks, size_t prefix, const lock_script &lock,
+            const maybe<redemption_document> &doc, const script_config &conf) {
+
+            // the full program has an OP_CODESEPARATOR between the two scripts.
+            static const bytecode separator {bytes {OP_CODESEPARATOR}};
+
+            machine<genesis> base {doc, conf};
+            maybe<result> stopped = catch_all_errors<maybe<result>> ([&] () -> maybe<result> {
+                bytecode::counter first {unlocks[direct[0]]};
+                while (first.Index < prefix) if (maybe<result> r = base.step (first); bool (r)) return r;
+                return {};
+            });
+
+            for (size_t i : direct) {
+                if (bool (stopped)) {
+                    results[i] = *stopped;
+                    continue;
+                }
+
+                results[i] = catch_all_errors<result> ([&] () -> result {
+                    machine<genesis> m = base.snapshot ();
+
+                    bytecode::counter unlock {unlocks[i]};
+                    unlock.Index = prefix;
+                    while (!unlock.done ()) if (maybe<result> r = m.step (unlock); bool (r)) return *r;
+
+                    bytecode::counter separate {separator};
+                    if (maybe<result> r = m.step (separate); bool (r)) return *r;
+
+                    bytecode::counter counter {lock.Code};
+                    return machine_run (m, counter);
+                });
+            }
         }
 
-        return Machine.Result;
+        std::vector<result> evaluate_all (const std::vector<script> &unlocks, const lock_script &lock,
+            const maybe<redemption_document> &doc, const script_config &conf) {
+            std::vector<result> results (unlocks.size (), result {false});
+
+            // the lock script must be decoded and cannot be pay to script hash.
+            bool can_run_directly = lock.Code != nullptr && !(conf.verify_P2SH () && is_P2SH (*lock.Code));
+
+            ScriptError lock_error = !can_run_directly || lock.Flags == conf.Flags ? lock.Verified :
+                pre_verify (full (bytecode {}, *lock.Code, false), conf.Flags);
+
+            std::vector<ptr<const bytecode>> code (unlocks.size ());
+            std::vector<size_t> direct;
+
+            for (size_t i = 0; i < unlocks.size (); i++) {
+                if (can_run_directly) try {
+                    ptr<const bytecode> unlock = std::make_shared<const bytecode> (unlocks[i]);
+                    if (is_push (*unlock)) {
+                        // a script of pushes has no conditionals or bad op codes,
+                        // so it can be checked separately from the lock script.
+                        ScriptError err = pre_verify (*unlock, conf.Flags);
+                        if (err == SCRIPT_ERR_OK) err = lock_error;
+
+                        if (err != SCRIPT_ERR_OK) results[i] = err;
+                        else {
+                            code[i] = unlock;
+                            direct.push_back (i);
+                        }
+
+                        continue;
+                    }
+                } catch (const invalid_program &) {}
+
+                results[i] = evaluate_one (unlocks[i], lock.Script, doc, conf);
+            }
+
+            if (direct.empty ()) return results;
+
+            size_t prefix = code[direct[0]]->size ();
+            for (size_t i : direct) {
+                size_t k = 0;
+                while (k < prefix && k < code[i]->size () && same_operation (*code[direct[0]], *code[i], k)) k++;
+                prefix = k;
+            }
+
+            if (enable_genesis_stack (conf.Flags)) evaluate_direct<true> (results, direct, code, prefix, lock, doc, conf);
+            else evaluate_direct<false> (results, direct, code, prefix, lock, doc, conf);
+
+            return results;
+        }
+    }
+
+    std::vector<result> evaluate_batch (const std::vector<script> &unlocks, const lock_script &lock,
+        const redemption_document &doc, const script_config &conf) {
+        return evaluate_all (unlocks, lock, maybe<redemption_document> {doc}, conf);
+    }
+
+    std::vector<result> evaluate_batch (const std::vector<script> &unlocks, const lock_script &lock, const script_config &conf) {
+        return evaluate_all (unlocks, lock, maybe<redemption_document> {}, conf);
     }
 }
@@ -3,54 +3,93 @@
 
 #include <gigamonkey/script/machine.hpp>
 #include <gigamonkey/script/bitcoin_core.hpp>
+#include <gigamonkey/signature_cache.hpp>
 #include <sv/policy/policy.h>
+#include <optional>
+
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+#include <gigamonkey/script/profile.hpp>
+#include <chrono>
+#endif
 
 // not in use but required by config.h dependency
 bool fRequireStandard = true;
 
 namespace Gigamonkey::Bitcoin {
 
-    machine::machine (ptr<two_stack> stack, maybe<redemption_document> doc, const script_config &conf):
-        Halt {false}, Result {false}, Config {conf},
+    template <bool genesis> limited_two_stack<genesis> inline make_stack (const script_config &conf) {
+        if constexpr (genesis) return limited_two_stack<true> {conf.MaxStackMemoryUsage};
+        else return limited_two_stack<false> {};
+    }
+
+    template <bool genesis> machine<genesis>::machine (maybe<redemption_document> doc, const script_config &conf):
+        Config {conf},
         UtxoAfterGenesis {bool (static_cast<uint32> (Config.Flags & flag::ENABLE_GENESIS_OPCODES))},
         RequireMinimal {Config.verify_minimal_push ()},
-        Document {doc}, Stack {stack}, Exec {}, Else {}, OpCount {0} {}
+        Document {doc}, Stack {make_stack<genesis> (conf)}, Exec {}, Else {}, NotExecuted {0}, OpCount {0}, Deferred {} {}
+
+    template <bool genesis> machine<genesis> machine<genesis>::snapshot () {
+        Stack.share ();
+        return *this;
+    }
 
     bool inline IsValidMaxOpsPerScript (uint64_t nOpCount, const script_config &config) {
         return (nOpCount <= config.MaxOpsPerScript);
     }
 
-    bool inline machine::increment_operation () {
+    // arithmetic on numbers that fit in 64 bits. These return false
+    // if the result does not fit, in which case we use integer instead.
+    bool inline unary_int64 (op Op, int64 &n) {
+        switch (Op) {
+            case OP_1ADD: return !__builtin_add_overflow (n, int64 (1), &n);
+            case OP_1SUB: return !__builtin_sub_overflow (n, int64 (1), &n);
+            // numbers that we read have magnitude less than 2^63, so these can't overflow.
+            case OP_NEGATE: n = -n; return true;
+            case OP_ABS: if (n < 0) n = -n; return true;
+            case OP_NOT: n = n == 0; return true;
+            case OP_0NOTEQUAL: n = n != 0; return true;
+            default: return false;
+        }
+    }
+
+    bool inline binary_int64 (op Op, int64 a, int64 b, int64 &r) {
+        switch (Op) {
+            case OP_ADD: return !__builtin_add_overflow (a, b, &r);
+            case OP_SUB: return !__builtin_sub_overflow (a, b, &r);
+            case OP_MUL: return !__builtin_mul_overflow (a, b, &r);
+            // division by zero is handled with the other errors.
+            case OP_DIV: if (b == 0) return false; r = a / b; return true;
+            case OP_MOD: if (b == 0) return false; r = a % b; return true;
+            case OP_BOOLAND: r = a != 0 && b != 0; return true;
+            case OP_BOOLOR: r = a != 0 || b != 0; return true;
+            case OP_NUMEQUAL:
+            case OP_NUMEQUALVERIFY: r = a == b; return true;
+            case OP_NUMNOTEQUAL: r = a != b; return true;
+            case OP_LESSTHAN: r = a < b; return true;
+            case OP_GREATERTHAN: r = a > b; return true;
+            case OP_LESSTHANOREQUAL: r = a <= b; return true;
+            case OP_GREATERTHANOREQUAL: r = a >= b; return true;
+            case OP_MIN: r = a < b ? a : b; return true;
+            case OP_MAX: r = a > b ? a : b; return true;
+            default: return false;
+        }
+    }
+
+    template <bool genesis> bool inline machine<genesis>::increment_operation () {
         return IsValidMaxOpsPerScript (++OpCount, Config);
     }
     
-    program inline cleanup_script_code (program script_code, slice<const byte> sig) {
+    flat_program inline cleanup_script_code (const flat_program &script_code, slice<const byte> sig) {
         return sighash::has_fork_id (signature::directive (sig)) ? script_code :
             find_and_delete (script_code, instruction::push (sig));
     }
     
-    sighash::document inline *add_script_code (redemption_document &doc, program script_code) {
-        return new sighash::document {doc.Transaction, doc.InputIndex, doc.RedeemedValue, script_code};
+    sighash::document inline add_script_code (redemption_document &doc, const flat_program &script_code) {
+        return sighash::document {doc.Transaction, doc.InputIndex, doc.RedeemedValue, script_code, doc.Precomputed};
     }
 
     constexpr auto bits_per_byte {8};
     
-    slice<const byte> get_push_data (slice<const byte> instruction) {
-        if (instruction.size () < 1) return {};
-        
-        op Op = op (instruction[0]);
-        
-        if (!is_push_data (Op)) return {};
-        
-        if (Op <= OP_PUSHSIZE75) return instruction.drop (1);
-        
-        if (Op == OP_PUSHDATA1) return instruction.drop (2);
-        
-        if (Op == OP_PUSHDATA2) return instruction.drop (3);
-        
-        return instruction.drop (5);
-    }
-
     bool inline IsInvalidBranchingOpcode (op opcode) {
         return opcode == OP_VERNOTIF || opcode == OP_VERIF;
     }
@@ -63,15 +102,106 @@ namespace Gigamonkey::Bitcoin {
         return ul;
     }
     
-    maybe<result> machine::step (const program_counter &Counter) {
+    template <bool genesis> maybe<result> machine<genesis>::step (bytecode::counter &Counter) {
+        if (Config.DeferSignatures) return deferred_step (Counter);
+        return measure (Counter);
+    }
+
+    template <bool genesis> maybe<result> machine<genesis>::measure (bytecode::counter &Counter) {
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+        if (Config.Profile) return profile_step (Counter);
+#endif
+        return execute (Counter);
+    }
+
+    template <bool genesis> maybe<result> machine<genesis>::deferred_step (bytecode::counter &Counter) {
+        maybe<result> r;
+        try {
+            r = measure (Counter);
+        } catch (...) {
+            // the script would have stopped at an invalid signature before it got here.
+            if (maybe<result> failure = check_deferred (); bool (failure)) return failure;
+            throw;
+        }
+
+        if (!bool (r) || Deferred.empty ()) return r;
+
+        // the signatures are checked along with those of other scripts.
+        if (Config.SignatureBatch != nullptr && r->verify ()) {
+            *Config.SignatureBatch += std::move (Deferred);
+            return r;
+        }
+
+        maybe<result> failure = check_deferred ();
+        if (!bool (failure)) return r;
+
+        // a failed OP_CHECKSIG at the end of the script does not stop it,
+        // so an error found in the final checks still stands.
+        if (!failure->Error && r->Error) return r;
+        return failure;
+    }
+
+    template <bool genesis> maybe<result> machine<genesis>::check_deferred () {
+        maybe<signature_batch::job> failure = Deferred.check (Config.SignatureCache);
+        if (bool (failure)) return failure->Failure;
+        return {};
+    }
+
+    template <bool genesis> bool machine<genesis>::deferrable (op Op, const bytecode::counter &Counter) const {
+        return Config.DeferSignatures && bool (Document) &&
+            (Op == OP_CHECKSIGVERIFY || (Exec.empty () && Counter.Index + 1 == Counter.Code->size ()));
+    }
+
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+    template <bool genesis> maybe<result> machine<genesis>::profile_step (bytecode::counter &Counter) {
+        if (Counter.done ()) {
+            profile::record_script ();
+            return execute (Counter);
+        }
+
+        // an op in a branch that is not executed takes almost no time,
+        // so it would make the op look cheaper than it is.
+        if (NotExecuted != 0) {
+            profile::record_skipped ();
+            return execute (Counter);
+        }
+
+        op Op = Counter->Op;
+
+        // push data and the top element before and after.
+        uint64 bytes = Counter->End - Counter->Data;
+        if (Stack.size () > 0) bytes += Stack.top_size ();
+
+        uint64 sigops = 0;
+        if (Op == OP_CHECKSIG || Op == OP_CHECKSIGVERIFY) sigops = 1;
+        else if ((Op == OP_CHECKMULTISIG || Op == OP_CHECKMULTISIGVERIFY) && Stack.size () > 0) {
+            int64 keys;
+            if (read_int64 (Stack.top (), keys) && keys > 0) sigops = keys;
+        }
+
+        auto begin = std::chrono::steady_clock::now ();
+        maybe<result> r = execute (Counter);
+        auto end = std::chrono::steady_clock::now ();
+
+        if (Stack.size () > 0) bytes += Stack.top_size ();
+
+        profile::record (Op, std::chrono::duration_cast<std::chrono::nanoseconds> (end - begin).count (), bytes);
+        if (sigops > 0) profile::record_sigops (sigops);
+        profile::record_stack (Stack.combined_size (), Stack.combined_data_size ());
+        return r;
+    }
+#endif
+
+    template <bool genesis> maybe<result> machine<genesis>::execute (bytecode::counter &Counter) {
         
-        if (Counter.Next == slice<const byte> {}) {
-            if (Config.verify_clean_stack () && (Stack->size () != 1)) return SCRIPT_ERR_CLEANSTACK;
-            if (Stack->size () == 0) return false;
-            return nonzero (Stack->top ());
+        if (Counter.done ()) {
+            if (!Exec.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+            if (Config.verify_clean_stack () && (Stack.size () != 1)) return SCRIPT_ERR_CLEANSTACK;
+            if (Stack.size () == 0) return false;
+            return nonzero (Stack.top ());
         }
         
-        op Op = op (Counter.Next[0]);
+        op Op = Counter->Op;
         
         // Check opcode limits.
         //
@@ -81,14 +211,25 @@ namespace Gigamonkey::Bitcoin {
         
         // whether this op code will be executed. 
         // need to take into account OP_RETURN
-        bool executed = !count (Exec.begin (), Exec.end (), false);
-        if (!executed) return {};
+        bool executed = NotExecuted == 0;
+
+        // in a branch that is not executed, we still need to
+        // keep track of conditionals in order to find its end.
+        if (!executed && (Op < OP_IF || Op > OP_ENDIF)) {
+            ++Counter;
+            return {};
+        }
 
         // Some opcodes are disabled.
         if (Config.disabled (Op) && executed) return SCRIPT_ERR_DISABLED_OPCODE;
         
-        if (executed && 0 <= Op && Op <= OP_PUSHDATA4) Stack->push_back (get_push_data (Counter.Next));
-        else switch (Op) {
+        if (executed && 0 <= Op && Op <= OP_PUSHDATA4) {
+            slice<const byte> data = Counter.push_data ();
+            // large pushes refer to the script instead of copying it.
+            if (data.size () >= element::LARGE_ELEMENT_SIZE && Counter.Owner != nullptr)
+                Stack.push_back (Counter.script (), data);
+            else Stack.push_back (data);
+        } else switch (Op) {
             //
             // Push value
             //
@@ -110,7 +251,7 @@ namespace Gigamonkey::Bitcoin {
             case OP_15:
             case OP_16: {
                 // ( -- value)
-                Stack->push_back (integer {((int) Op - (int) (OP_1 - 1))});
+                Stack.push_back (integer {((int) Op - (int) (OP_1 - 1))});
                 // The result of these opcodes should always be the
                 // minimal way to push the data they push, so no need
                 // for a CheckMinimalPush here.
@@ -131,7 +272,7 @@ namespace Gigamonkey::Bitcoin {
                     break;
                 }
 
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
                 // Note that elsewhere numeric opcodes are limited to
                 // operands in the range -2**31+1 to 2**31-1, however it
@@ -148,7 +289,7 @@ namespace Gigamonkey::Bitcoin {
                 // up to 5-byte bignums, which are good until 2**39-1,
                 // well beyond the 2**32-1 limit of the nLockTime field
                 // itself.
-                const integer nLockTime = read_integer (Stack->top (), RequireMinimal, 5);
+                const integer nLockTime = read_integer (Stack.top (), RequireMinimal, 5);
 
                 // In the rare event that the argument may be < 0 due to
                 // some arithmetic being done first, you can always use
@@ -171,12 +312,12 @@ namespace Gigamonkey::Bitcoin {
                     break;
                 }
 
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
                 // nSequence, like nLockTime, is a 32-bit unsigned
                 // integer field. See the comment in CHECKLOCKTIMEVERIFY
                 // regarding 5-byte numeric operands.
-                const integer nSequence = read_integer (Stack->top (), RequireMinimal, 5);
+                const integer nSequence = read_integer (Stack.top (), RequireMinimal, 5);
 
                 // In the rare event that the argument may be < 0 due to
                 // some arithmetic being done first, you can always use
@@ -210,9 +351,9 @@ namespace Gigamonkey::Bitcoin {
                 // endif
                 bool fValue = false;
                 if (executed) {
-                    if (Stack->size () < 1) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                    if (Stack.size () < 1) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
 
-                    auto &vch = Stack->top ();
+                    auto &vch = Stack.top ();
                     if (verify_minimal_if (Config.Flags))
                         if (vch.size () > 1 || vch.size () == 1 && vch[0] != 1)
                             return SCRIPT_ERR_MINIMALIF;
@@ -221,11 +362,15 @@ namespace Gigamonkey::Bitcoin {
                     if (Op == OP_NOTIF)
                         fValue = !fValue;
 
-                    Stack->pop_back ();
+                    Stack.pop_back ();
                 }
 
                 Exec.push_back (fValue);
                 Else.push_back (false);
+                if (!fValue) {
+                    NotExecuted++;
+                    return skip (Counter);
+                }
             } break;
 
             case OP_ELSE: {
@@ -235,10 +380,16 @@ namespace Gigamonkey::Bitcoin {
 
                 Exec.back () = !Exec.back ();
                 Else.back () = true;
+                if (Exec.back ()) NotExecuted--;
+                else {
+                    NotExecuted++;
+                    return skip (Counter);
+                }
             } break;
 
             case OP_ENDIF: {
                 if (Exec.empty ()) return SCRIPT_ERR_UNBALANCED_CONDITIONAL;
+                if (!Exec.back ()) NotExecuted--;
                 Exec.pop_back ();
                 Else.pop_back ();
             } break;
@@ -246,9 +397,9 @@ namespace Gigamonkey::Bitcoin {
             case OP_VERIFY: {
                 // (true -- ) or
                 // (false -- false) and return
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                if (nonzero (Stack->top ())) Stack->pop_back ();
+                if (nonzero (Stack.top ())) Stack.pop_back ();
                 else return SCRIPT_ERR_VERIFY;
                 
             } break;
@@ -264,127 +415,110 @@ namespace Gigamonkey::Bitcoin {
             // Stack ops
             //
             case OP_TOALTSTACK: {
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                Stack->to_alt ();
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                Stack.to_alt ();
             } break;
 
             case OP_FROMALTSTACK: {
-                if (Stack->alt_size () < 1) return SCRIPT_ERR_INVALID_ALTSTACK_OPERATION;
-                Stack->from_alt ();
+                if (Stack.alt_size () < 1) return SCRIPT_ERR_INVALID_ALTSTACK_OPERATION;
+                Stack.from_alt ();
             } break;
 
             case OP_2DROP: {
                 // (x1 x2 -- )
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                     
-                Stack->pop_back ();
-                Stack->pop_back ();
+                Stack.pop_back ();
+                Stack.pop_back ();
                 
             } break;
 
             case OP_2DUP: {
                 // (x1 x2 -- x1 x2 x1 x2)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                
-                auto vch1 = Stack->top (-2);
-                auto vch2 = Stack->top ();
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                Stack->push_back (vch1);
-                Stack->push_back (vch2);
+                Stack.copy_back (-2);
+                Stack.copy_back (-2);
                 
             } break;
 
             case OP_3DUP: {
                 // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
-                if (Stack->size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto vch1 = Stack->top (-3);
-                auto vch2 = Stack->top (-2);
-                auto vch3 = Stack->top ();
-                
-                Stack->push_back (vch1);
-                Stack->push_back (vch2);
-                Stack->push_back (vch3);
+                Stack.copy_back (-3);
+                Stack.copy_back (-3);
+                Stack.copy_back (-3);
                 
             } break;
 
             case OP_2OVER: {
                 // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
-                if (Stack->size () < 4) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 4) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto vch1 = Stack->top (-4);
-                auto vch2 = Stack->top (-3);
-                Stack->push_back (vch1);
-                Stack->push_back (vch2);
+                Stack.copy_back (-4);
+                Stack.copy_back (-4);
             } break;
 
             case OP_2ROT: {
                 // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
-                if (Stack->size () < 6) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                
-                auto vch1 = Stack->top (-6);
-                auto vch2 = Stack->top (-5);
+                if (Stack.size () < 6) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                Stack->erase (-6, -4);
-                Stack->push_back (vch1);
-                Stack->push_back (vch2);
+                Stack.roll (-6);
+                Stack.roll (-6);
                 
             } break;
 
             case OP_2SWAP: {
                 
                 // (x1 x2 x3 x4 -- x3 x4 x1 x2)
-                if (Stack->size () < 4) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 4) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                Stack->swap (Stack->size () - 4, Stack->size () - 2);
-                Stack->swap (Stack->size () - 3, Stack->size () - 1);
+                Stack.swap (Stack.size () - 4, Stack.size () - 2);
+                Stack.swap (Stack.size () - 3, Stack.size () - 1);
                 
             } break;
             
             case OP_IFDUP: {
                 // (x - 0 | x x)
-                if (Stack->size () < 1)
+                if (Stack.size () < 1)
                     return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto vch = Stack->top ();
-
-                if (nonzero (vch)) Stack->push_back (vch);
+                if (nonzero (Stack.top ())) Stack.copy_back (-1);
                 
             } break;
 
             case OP_DEPTH: {
                 // -- stacksize
-                Stack->push_back (integer {Stack->size ()});
+                Stack.push_back (integer {Stack.size ()});
                 
             } break;
 
             case OP_DROP: {
                 // (x -- )
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                Stack->pop_back ();
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                Stack.pop_back ();
                 
             } break;
 
             case OP_DUP: {
                 // (x -- x x)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto vch = Stack->top ();
-                Stack->push_back (vch);
+                Stack.copy_back (-1);
             } break;
 
             case OP_NIP: {
                 // (x1 x2 -- x2)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                Stack->erase (-2);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                Stack.erase (-2);
                 
             } break;
 
             case OP_OVER: {
                 // (x1 x2 -- x1 x2 x1)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                auto vch = Stack->top (-2);
-                Stack->push_back (vch);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                Stack.copy_back (-2);
                 
             } break;
 
@@ -392,19 +526,17 @@ namespace Gigamonkey::Bitcoin {
             case OP_ROLL: {
                 // (xn ... x2 x1 x0 n - xn ... x2 x1 x0 xn)
                 // (xn ... x2 x1 x0 n - ... x2 x1 x0 xn)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                const auto sn = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
-                Stack->pop_back ();
-                if (sn < 0 || sn >= Stack->size ())
+                const auto sn = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
+                Stack.pop_back ();
+                if (sn < 0 || sn >= Stack.size ())
                     return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
                 const uint32 n = uint32 (read_as_uint32_little (sn));
-                auto vch = Stack->top (-n - 1);
 
-                if (Op == OP_ROLL) Stack->erase (-n - 1);
-
-                Stack->push_back (vch);
+                if (Op == OP_ROLL) Stack.roll (-int (n) - 1);
+                else Stack.copy_back (-int (n) - 1);
                 
             } break;
 
@@ -412,34 +544,35 @@ namespace Gigamonkey::Bitcoin {
                 // (x1 x2 x3 -- x2 x3 x1)
                 //  x2 x1 x3  after first swap
                 //  x2 x3 x1  after second swap
-                if (Stack->size () < 3)
+                if (Stack.size () < 3)
                     return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                Stack->swap (Stack->size () - 3, Stack->size () - 2);
-                Stack->swap (Stack->size () - 2, Stack->size () - 1);
+                Stack.swap (Stack.size () - 3, Stack.size () - 2);
+                Stack.swap (Stack.size () - 2, Stack.size () - 1);
                 
             } break;
 
             case OP_SWAP: {
                 // (x1 x2 -- x2 x1)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                Stack->swap (Stack->size () - 2, Stack->size () - 1);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                Stack.swap (Stack.size () - 2, Stack.size () - 1);
                 
             } break;
 
             case OP_TUCK: {
                 // (x1 x2 -- x2 x1 x2)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                auto vch = Stack->top ();
-                Stack->insert (-2, vch);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                // (x1 x2 x2) and then swap the lower two.
+                Stack.copy_back (-1);
+                Stack.swap (Stack.size () - 3, Stack.size () - 2);
                 
             } break;
 
             case OP_SIZE: {
                 // (in -- in size)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                Stack->push_back (integer {Stack->top ().size ()});
+                Stack.push_back (integer {Stack.top_size ()});
                 
             } break;
 
@@ -450,10 +583,10 @@ namespace Gigamonkey::Bitcoin {
             case OP_OR:
             case OP_XOR: {
                 // (x1 x2 - out)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto &vch1 = Stack->top (-2);
-                auto &vch2 = Stack->top ();
+                auto &vch1 = Stack.top (-2);
+                auto &vch2 = Stack.top ();
 
                 // Inputs must be the same size
                 if (vch1.size () != vch2.size ()) return SCRIPT_ERR_INVALID_OPERAND_SIZE;
@@ -474,14 +607,14 @@ namespace Gigamonkey::Bitcoin {
                 }
 
                 // And pop vch2.
-                Stack->pop_back ();
+                Stack.pop_back ();
             } break;
 
             case OP_INVERT: {
                 // (x -- out)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto &vch1 = Stack->top ();
+                auto &vch1 = Stack.top ();
                 // To avoid allocating, we modify vch1 in place
                 for (size_t i = 0; i < vch1.size (); i++) vch1[i] = ~vch1[i];
                 
@@ -489,13 +622,13 @@ namespace Gigamonkey::Bitcoin {
 
             case OP_LSHIFT: {
                 // (x n -- out)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
                 if (n < 0) return SCRIPT_ERR_INVALID_NUMBER_RANGE;
 
-                Stack->pop_back ();
+                Stack.pop_back ();
 
-                Stack->modify_top ([&n] (bytes &values) {
+                Stack.modify_top ([&n] (bytes &values) {
                     if (n >= values.size () * bits_per_byte) fill (begin (values), end (values), 0);
                     else {
                         integer max = integer {INT32_MAX};
@@ -510,13 +643,13 @@ namespace Gigamonkey::Bitcoin {
 
             case OP_RSHIFT: {
                 // (x n -- out)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
                 if (n < 0) return SCRIPT_ERR_INVALID_NUMBER_RANGE;
 
-                Stack->pop_back ();
+                Stack.pop_back ();
 
-                Stack->modify_top ([&n] (bytes &values) {
+                Stack.modify_top ([&n] (bytes &values) {
                     if (n >= values.size () * bits_per_byte) fill (begin (values), end (values), 0);
                     else {
                         integer max = integer {INT32_MAX};
@@ -532,10 +665,10 @@ namespace Gigamonkey::Bitcoin {
             case OP_EQUAL:
             case OP_EQUALVERIFY: {
                 // (x1 x2 - bool)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto &vch1 = Stack->top (-2);
-                auto &vch2 = Stack->top ();
+                auto &vch1 = Stack.top (-2);
+                auto &vch2 = Stack.top ();
 
                 bool fEqual = (vch1 == vch2);
                 // OP_NOTEQUAL is disabled because it would be too
@@ -544,12 +677,12 @@ namespace Gigamonkey::Bitcoin {
                 // (numerically, 0x01 == 0x0001 == 0x000001)
                 // if (opcode == OP_NOTEQUAL)
                 //    fEqual = !fEqual;
-                Stack->pop_back ();
-                Stack->pop_back ();
-                Stack->push_back (integer (fEqual));
+                Stack.pop_back ();
+                Stack.pop_back ();
+                Stack.push_back (integer (fEqual));
                 
                 if (Op == OP_EQUALVERIFY) {
-                    if (fEqual) Stack->pop_back ();
+                    if (fEqual) Stack.pop_back ();
                     else return SCRIPT_ERR_EQUALVERIFY;
                 }
                 
@@ -567,9 +700,19 @@ namespace Gigamonkey::Bitcoin {
             case OP_NOT:
             case OP_0NOTEQUAL: {
                 // (in -- out)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                integer bn = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                const integer &in = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
+
+                int64 n;
+                if (read_int64 (in, n) && unary_int64 (Op, n)) {
+                    std::array<byte, 9> buffer;
+                    Stack.pop_back ();
+                    Stack.push_back (write_int64 (n, buffer));
+                    break;
+                }
+
+                integer bn = in;
                 
                 switch (Op) {
                     case OP_1ADD:
@@ -602,8 +745,8 @@ namespace Gigamonkey::Bitcoin {
                         break;
                 }
                 
-                Stack->pop_back ();
-                Stack->push_back (bn);
+                Stack.pop_back ();
+                Stack.push_back (bn);
             } break;
 
             case OP_ADD:
@@ -623,10 +766,25 @@ namespace Gigamonkey::Bitcoin {
             case OP_MIN:
             case OP_MAX: {
                 // (x1 x2 -- out)
-                if (Stack->size () < 2) SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+
+                const auto& bn1 = read_integer (Stack.top (-2), RequireMinimal, Config.MaxScriptNumLength);
+                const auto& bn2 = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
 
-                const auto& bn1 = read_integer (Stack->top (-2), RequireMinimal, Config.MaxScriptNumLength);
-                const auto& bn2 = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                int64 a, b, r;
+                if (read_int64 (bn1, a) && read_int64 (bn2, b) && binary_int64 (Op, a, b, r)) {
+                    std::array<byte, 9> buffer;
+                    Stack.pop_back ();
+                    Stack.pop_back ();
+                    Stack.push_back (write_int64 (r, buffer));
+
+                    if (Op == OP_NUMEQUALVERIFY) {
+                        if (r != 0) Stack.pop_back ();
+                        else return SCRIPT_ERR_NUMEQUALVERIFY;
+                    }
+
+                    break;
+                }
 
                 integer bn {};
                 switch (Op) {
@@ -692,30 +850,32 @@ namespace Gigamonkey::Bitcoin {
                         break;
                 }
                 
-                Stack->pop_back ();
-                Stack->pop_back ();
-                Stack->push_back (bn);
+                Stack.pop_back ();
+                Stack.pop_back ();
+                Stack.push_back (bn);
 
                 if (Op == OP_NUMEQUALVERIFY) {
-                    if (nonzero (Stack->top ())) Stack->pop_back ();
+                    if (nonzero (Stack.top ())) Stack.pop_back ();
                     else return SCRIPT_ERR_NUMEQUALVERIFY;
                 }
             } break;
 
             case OP_WITHIN: {
                 // (x min max -- out)
-                if (Stack->size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                const auto &bn1 = read_integer (Stack->top (-3), RequireMinimal, Config.MaxScriptNumLength);
-                const auto &bn2 = read_integer (Stack->top (-2), RequireMinimal, Config.MaxScriptNumLength);
-                const auto &bn3 = read_integer (Stack->top (-1), RequireMinimal, Config.MaxScriptNumLength);
-                    
-                const bool fValue = (bn2 <= bn1 && bn1 < bn3);
-                Stack->pop_back ();
-                Stack->pop_back ();
-                Stack->pop_back ();
-
-                Stack->push_back (integer (fValue));
+                const auto &bn1 = read_integer (Stack.top (-3), RequireMinimal, Config.MaxScriptNumLength);
+                const auto &bn2 = read_integer (Stack.top (-2), RequireMinimal, Config.MaxScriptNumLength);
+                const auto &bn3 = read_integer (Stack.top (-1), RequireMinimal, Config.MaxScriptNumLength);
+
+                int64 x, min, max;
+                const bool fValue = read_int64 (bn1, x) && read_int64 (bn2, min) && read_int64 (bn3, max) ?
+                    min <= x && x < max : (bn2 <= bn1 && bn1 < bn3);
+                Stack.pop_back ();
+                Stack.pop_back ();
+                Stack.pop_back ();
+
+                Stack.push_back (integer (fValue));
             } break;
             //
             // Crypto
@@ -726,43 +886,51 @@ namespace Gigamonkey::Bitcoin {
             case OP_HASH160:
             case OP_HASH256: {
                 // (in -- hash)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                if (Op == OP_RIPEMD160) Stack->replace_back (RIPEMD_160 (Stack->top ()));
-                else if (Op == OP_SHA1) Stack->replace_back (SHA1 (Stack->top ()));
-                else if (Op == OP_SHA256) Stack->replace_back (SHA2_256 (Stack->top ()));
-                else if (Op == OP_HASH160) Stack->replace_back (Hash160 (Stack->top ()));
-                else if (Op == OP_HASH256) Stack->replace_back (Hash256 (Stack->top ()));
+                if (Op == OP_RIPEMD160) Stack.replace_back (RIPEMD_160 (Stack.top ()));
+                else if (Op == OP_SHA1) Stack.replace_back (SHA1 (Stack.top ()));
+                else if (Op == OP_SHA256) Stack.replace_back (SHA2_256 (Stack.top ()));
+                else if (Op == OP_HASH160) Stack.replace_back (Hash160 (Stack.top ()));
+                else if (Op == OP_HASH256) Stack.replace_back (Hash256 (Stack.top ()));
             } break;
             
             // we take care of this elsewhere. 
-            case OP_CODESEPARATOR: break;
+            case OP_CODESEPARATOR: {
+                Counter.LastCodeSeparator = Counter->End;
+            } break;
             
             case OP_CHECKSIG: 
             case OP_CHECKSIGVERIFY: {
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                const bytes &sig = Stack->top (-2);
-                const bytes &pub = Stack->top ();
+                const bytes &sig = Stack.top (-2);
+                const bytes &pub = Stack.top ();
                 
                 result r;
-                if (bool (Document)) {
+                if (deferrable (Op, Counter)) {
                     auto doc = add_script_code (*Document, cleanup_script_code (Counter.to_last_code_separator (), sig));
-                    r = result {verify_signature (sig, pub, *doc, Config.Flags)};
-                    delete doc;
+
+                    // continue as if the signature were valid.
+                    r = Deferred.add (sig, pub, doc, Config.Flags, Config.SignatureCache,
+                        verify_null_fail (Config.Flags) && sig.size () != 0 ? result {SCRIPT_ERR_SIG_NULLFAIL} :
+                        Op == OP_CHECKSIGVERIFY ? result {SCRIPT_ERR_CHECKSIGVERIFY} : result {false},
+                        Document->InputIndex);
+                } else if (bool (Document)) {
+                    auto doc = add_script_code (*Document, cleanup_script_code (Counter.to_last_code_separator (), sig));
+                    r = result {verify_signature (sig, pub, doc, Config.Flags, Config.SignatureCache)};
                 } else r = result {true};
                 
                 if (r.Error) return r.Error;
                 
-                Stack->pop_back ();
-                Stack->pop_back ();
-                Stack->push_back (integer (r.Success));
+                Stack.pop_back ();
+                Stack.pop_back ();
+                Stack.push_back (integer (r.Success));
                 
+                // the script goes on after a successful verify.
                 if (Op == OP_CHECKSIGVERIFY) {
-                    if (r.Success) {
-                        Stack->pop_back ();
-                        return true;
-                    } else return SCRIPT_ERR_CHECKSIGVERIFY;
+                    if (!r.Success) return SCRIPT_ERR_CHECKSIGVERIFY;
+                    Stack.pop_back ();
                 }
                 
             } break;
@@ -774,11 +942,11 @@ namespace Gigamonkey::Bitcoin {
                 // num_of_pubkeys -- bool)
                     
                 uint64_t i = 1;
-                if (Stack->size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
                 // initialize to max size of CScriptNum::MAXIMUM_ELEMENT_SIZE (4 bytes) 
                 // because only 4 byte integers are supported by  OP_CHECKMULTISIG / OP_CHECKMULTISIGVERIFY
-                auto nKeysCountZ = read_integer (Stack->top (-i), RequireMinimal, MAXIMUM_ELEMENT_SIZE);
+                auto nKeysCountZ = read_integer (Stack.top (-i), RequireMinimal, MAXIMUM_ELEMENT_SIZE);
                 if (nKeysCountZ < 0) return SCRIPT_ERR_PUBKEY_COUNT;
                 
                 int64 nKeysCount = static_cast<int64> (nKeysCountZ);
@@ -796,9 +964,9 @@ namespace Gigamonkey::Bitcoin {
                 // operation fails.
                 uint64_t ikey2 = nKeysCount + 2;
                 i += nKeysCount;
-                if (Stack->size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                auto nSigsCountZ = read_integer (Stack->top (-i), RequireMinimal, MAXIMUM_ELEMENT_SIZE);
+                auto nSigsCountZ = read_integer (Stack.top (-i), RequireMinimal, MAXIMUM_ELEMENT_SIZE);
                     
                 if (nSigsCountZ < 0) return SCRIPT_ERR_SIG_COUNT;
                 
@@ -807,24 +975,24 @@ namespace Gigamonkey::Bitcoin {
                 
                 uint64_t isig = ++i;
                 i += nSigsCount;
-                if (Stack->size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < i) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
-                sighash::document *doc = nullptr;
+                std::optional<sighash::document> doc;
                 if (bool (Document)) {
-                    program script_code = Counter.to_last_code_separator ();
+                    flat_program script_code = Counter.to_last_code_separator ();
                     
                     // Remove signature for pre-fork scripts
-                    for (auto it = Stack->begin () + 1; it != Stack->begin () + 1 + nSigsCount; it++)
-                        script_code = cleanup_script_code (script_code, *it);
+                    for (auto it = Stack.begin () + 1; it != Stack.begin () + 1 + nSigsCount; it++)
+                        script_code = cleanup_script_code (script_code, it->flatten ());
                     
-                    doc = add_script_code (*Document, script_code);
+                    doc.emplace (add_script_code (*Document, script_code));
                 }
                 
                 bool fSuccess = true;
                 while (fSuccess && nSigsCount > 0) {
 
-                    const bytes &sig = Stack->top (-isig);
-                    const bytes &pub = Stack->top (-ikey);
+                    const bytes &sig = Stack.top (-isig);
+                    const bytes &pub = Stack.top (-ikey);
                     
                     // Note how this makes the exact order of
                     // pubkey/signature evaluation distinguishable by
@@ -832,7 +1000,7 @@ namespace Gigamonkey::Bitcoin {
                     // See the script_(in)valid tests for details.
                     // Check signature
                     
-                    result r = (doc == nullptr) ? result {true} : result {verify_signature (sig, pub, *doc, Config.Flags)};
+                    result r = !doc.has_value () ? result {true} : result {verify_signature (sig, pub, *doc, Config.Flags, Config.SignatureCache)};
                     
                     if (r.Error) return r.Error;
                     
@@ -851,20 +1019,18 @@ namespace Gigamonkey::Bitcoin {
                     
                 }
                 
-                delete doc;
-                
                 // Clean up stack of actual arguments
                 while (i-- > 1) {
                     // If the operation failed, we require that all
                     // signatures must be empty vector
                     if (!fSuccess && (verify_null_fail (Config.Flags)) &&
-                        !ikey2 && Stack->top ().size ()) {
+                        !ikey2 && Stack.top ().size ()) {
                         return SCRIPT_ERR_SIG_NULLFAIL;
                     }
                     
                     if (ikey2 > 0) ikey2--;
                     
-                    Stack->pop_back ();
+                    Stack.pop_back ();
                 }
                 
                 // A bug causes CHECKMULTISIG to consume one extra
@@ -873,20 +1039,19 @@ namespace Gigamonkey::Bitcoin {
                 // Unfortunately this is a potential source of
                 // mutability, so optionally verify it is exactly equal
                 // to zero prior to removing it from the stack.
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
                 
                 if ((verify_null_dummy (Config.Flags)) &&
-                    Stack->top ().size ()) return SCRIPT_ERR_SIG_NULLDUMMY;
+                    Stack.top ().size ()) return SCRIPT_ERR_SIG_NULLDUMMY;
                 
-                Stack->pop_back ();
+                Stack.pop_back ();
                 
-                Stack->push_back (integer (fSuccess));
+                Stack.push_back (integer (fSuccess));
                 
+                // the script goes on after a successful verify.
                 if (Op == OP_CHECKMULTISIGVERIFY) {
-                    if (fSuccess) {
-                        Stack->pop_back ();
-                        return true;
-                    } else return SCRIPT_ERR_CHECKMULTISIGVERIFY;
+                    if (!fSuccess) return SCRIPT_ERR_CHECKMULTISIGVERIFY;
+                    Stack.pop_back ();
                 }
                 
             } break;
@@ -896,50 +1061,27 @@ namespace Gigamonkey::Bitcoin {
             //
             case OP_CAT: {
                 // (x1 x2 -- out)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-
-                // We make copy of last element on stack (vch2) so we can pop the last
-                // element before appending it to the previous element.
-                // If appending would be first, we could exceed stack size in the process
-                // even though OP_CAT actually reduces total stack size.
-                bytes vch = Stack->top ();
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                Stack->pop_back ();
-                Stack->modify_top ([&vch] (bytes &val) {
-                    val.insert (val.end (), vch.begin (), vch.end ());
-                });
+                // large elements are joined without copying their data.
+                Stack.cat ();
             } break;
 
             case OP_SPLIT: {
                 // (in position -- x1 x2)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-
-                const auto &data = Stack->top (-2);
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
                 // Make sure the split point is apropriate.
-                const integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                const integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
 
-                if (n < 0 || n > data.size ()) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                if (n < 0 || n > Stack.top_size (-2)) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
 
                 const uint32 position = uint32 (read_as_uint32_little (n));
 
-                // Prepare the results in their own buffer as `data`
-                // will be invalidated.
-                integer n1;
-                integer n2;
-
-                n1.resize (position);
-                n2.resize (data.size () - position);
-
-                std::copy (data.begin (), data.begin () + position, n1.begin ());
-                std::copy (data.begin () + position, data.end (), n2.begin ());
+                Stack.pop_back ();
 
-                Stack->pop_back ();
-                Stack->pop_back ();
-
-                // Replace existing stack values by the new values.
-                Stack->push_back (n1);
-                Stack->push_back (n2);
+                // Replace the data by the two parts, which share its buffer if they are large.
+                Stack.split (position);
             } break;
 
             // Extend a number to a certain size.
@@ -947,9 +1089,9 @@ namespace Gigamonkey::Bitcoin {
             // are not minimally encoded -- use OP_BIN2NUM first)
             case OP_NUM2BIN: {
                 // (in size -- out)
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                const integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
+                const integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
 
                 if (n < 0 || n > std::numeric_limits<int32_t>::max ())
                     return SCRIPT_ERR_PUSH_SIZE;
@@ -958,9 +1100,9 @@ namespace Gigamonkey::Bitcoin {
                 if (!UtxoAfterGenesis && (size > MAX_SCRIPT_ELEMENT_SIZE_BEFORE_GENESIS))
                     return SCRIPT_ERR_PUSH_SIZE;
 
-                Stack->pop_back ();
+                Stack.pop_back ();
 
-                Stack->modify_top ([size] (bytes &rawnum) {
+                Stack.modify_top ([size] (bytes &rawnum) {
                     if (rawnum.size () > size) throw script_exception {SCRIPT_ERR_IMPOSSIBLE_ENCODING};
                     extend_number (rawnum, size);
                 });
@@ -971,9 +1113,9 @@ namespace Gigamonkey::Bitcoin {
             case OP_BIN2NUM: {
 
                 // (in -- out)
-                if (Stack->size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                if (Stack.size () < 1) return SCRIPT_ERR_INVALID_STACK_OPERATION;
 
-                Stack->modify_top ([this] (bytes &n) {
+                Stack.modify_top ([this] (bytes &n) {
                     trim_number (n);
                     if (n.size () > this->Config.MaxScriptNumLength) throw script_exception {SCRIPT_ERR_INVALID_NUMBER_RANGE};
                 });
@@ -981,73 +1123,47 @@ namespace Gigamonkey::Bitcoin {
             } break;
 
             case OP_SUBSTR: {
-                if (Stack->size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                const auto &data = Stack->top (-3);
-                const integer len = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
-                const integer pos = read_integer (Stack->top (-2), RequireMinimal, Config.MaxScriptNumLength);
-                if (pos < 0 || pos > data.size ()) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
-                if (len < 0 || pos + len > data.size ()) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                if (Stack.size () < 3) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                const size_t size = Stack.top_size (-3);
+                const integer len = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
+                const integer pos = read_integer (Stack.top (-2), RequireMinimal, Config.MaxScriptNumLength);
+                if (pos < 0 || pos > size) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                if (len < 0 || pos + len > size) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
 
                 const uint32 position = uint32 (read_as_uint32_little (pos));
                 const uint32 length = uint32 (read_as_uint32_little (len));
 
-                integer n1;
-
-                n1.resize (length);
-
-                std::copy (data.begin () + position, data.begin () + position + length, n1.begin ());
+                Stack.pop_back ();
+                Stack.pop_back ();
 
-                Stack->pop_back ();
-                Stack->pop_back ();
-                Stack->pop_back ();
-
-                Stack->push_back (n1);
+                Stack.substring (position, length);
 
             } break;
 
             case OP_LEFT: {
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                const auto &data = Stack->top (-2);
-                const integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
-                if (n < 0 || n > data.size ()) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                const integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
+                if (n < 0 || n > Stack.top_size (-2)) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
 
                 const uint32 position = uint32 (read_as_uint32_little (n));
 
-                // Prepare the results in their own buffer as `data`
-                // will be invalidated.
-                integer n1;
-
-                n1.resize (position);
-
-                std::copy (data.begin (), data.begin () + position, n1.begin ());
+                Stack.pop_back ();
 
-                Stack->pop_back ();
-                Stack->pop_back ();
-
-                Stack->push_back (n1);
+                Stack.substring (0, position);
 
             } break;
 
             case OP_RIGHT: {
-                if (Stack->size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
-                const auto &data = Stack->top (-2);
-                const integer n = read_integer (Stack->top (), RequireMinimal, Config.MaxScriptNumLength);
-                if (n < 0 || n > data.size ()) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
+                if (Stack.size () < 2) return SCRIPT_ERR_INVALID_STACK_OPERATION;
+                const integer n = read_integer (Stack.top (), RequireMinimal, Config.MaxScriptNumLength);
+                const size_t size = Stack.top_size (-2);
+                if (n < 0 || n > size) return SCRIPT_ERR_INVALID_SPLIT_RANGE;
 
                 const uint32 position = uint32 (read_as_uint32_little (n));
 
-                // Prepare the results in their own buffer as `data`
-                // will be invalidated.
-                integer n1;
-
-                n1.resize (position);
-
-                std::copy (data.begin () + data.size () - position, data.end (), n1.begin ());
+                Stack.pop_back ();
 
-                Stack->pop_back ();
-                Stack->pop_back ();
-
-                Stack->push_back (n1);
+                Stack.substring (size - position, position);
 
             } break;
             
@@ -1058,8 +1174,24 @@ namespace Gigamonkey::Bitcoin {
             }
         }
         
+        ++Counter;
         return {};
         
     }
-    
+
+    template <bool genesis> maybe<result> machine<genesis>::skip (bytecode::counter &Counter) {
+        // go directly to the end of a branch that will not be executed
+        // if we know that nothing in it could cause an error.
+        if (!Counter->Skip) ++Counter;
+        else {
+            OpCount += Counter.skip ();
+            if (!IsValidMaxOpsPerScript (OpCount, Config)) return SCRIPT_ERR_OP_COUNT;
+        }
+
+        return {};
+    }
+
+    template struct machine<true>;
+    template struct machine<false>;
+
 }
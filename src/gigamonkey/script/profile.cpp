@@ -0,0 +1,192 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/profile.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace Gigamonkey::Bitcoin {
+
+    namespace {
+
+        // only the thread that owns a counter writes to it, so it does not need an
+        // atomic increment. It is atomic so that other threads can read it.
+        struct counter {
+            std::atomic<uint64> Value {0};
+
+            void add (uint64 x) {
+                Value.store (Value.load (std::memory_order_relaxed) + x, std::memory_order_relaxed);
+            }
+
+            void max (uint64 x) {
+                if (x > Value.load (std::memory_order_relaxed)) Value.store (x, std::memory_order_relaxed);
+            }
+
+            uint64 get () const {
+                return Value.load (std::memory_order_relaxed);
+            }
+
+            void clear () {
+                Value.store (0, std::memory_order_relaxed);
+            }
+        };
+
+        struct recorder;
+
+        // recorders of all running threads, and the totals of threads that have exited.
+        struct registry {
+            std::mutex Mutex;
+            std::set<recorder *> Running;
+            profile Exited;
+        };
+
+        registry &get_registry () {
+            static registry r {};
+            return r;
+        }
+
+        struct recorder {
+            struct opcode {
+                counter Count;
+                counter Nanoseconds;
+                counter Bytes;
+            };
+
+            std::array<opcode, 256> Opcodes;
+            counter Scripts;
+            counter SigOps;
+            counter Skipped;
+            counter MaxStackElements;
+            counter MaxStackBytes;
+
+            recorder () {
+                registry &r = get_registry ();
+                std::lock_guard<std::mutex> lock {r.Mutex};
+                r.Running.insert (this);
+            }
+
+            ~recorder () {
+                registry &r = get_registry ();
+                std::lock_guard<std::mutex> lock {r.Mutex};
+                r.Exited += read ();
+                r.Running.erase (this);
+            }
+
+            profile read () const {
+                profile p {};
+                for (int i = 0; i < 256; i++) {
+                    p.Opcodes[i].Count = Opcodes[i].Count.get ();
+                    p.Opcodes[i].Nanoseconds = Opcodes[i].Nanoseconds.get ();
+                    p.Opcodes[i].Bytes = Opcodes[i].Bytes.get ();
+                }
+
+                p.Scripts = Scripts.get ();
+                p.SigOps = SigOps.get ();
+                p.Skipped = Skipped.get ();
+                p.MaxStackElements = MaxStackElements.get ();
+                p.MaxStackBytes = MaxStackBytes.get ();
+                return p;
+            }
+
+            void clear () {
+                for (opcode &o : Opcodes) {
+                    o.Count.clear ();
+                    o.Nanoseconds.clear ();
+                    o.Bytes.clear ();
+                }
+
+                Scripts.clear ();
+                SigOps.clear ();
+                Skipped.clear ();
+                MaxStackElements.clear ();
+                MaxStackBytes.clear ();
+            }
+        };
+
+        recorder &local_recorder () {
+            thread_local recorder r {};
+            return r;
+        }
+    }
+
+    profile::profile () : Opcodes {}, Scripts {0}, SigOps {0}, Skipped {0}, MaxStackElements {0}, MaxStackBytes {0} {}
+
+    profile &profile::operator += (const profile &p) {
+        for (int i = 0; i < 256; i++) {
+            Opcodes[i].Count += p.Opcodes[i].Count;
+            Opcodes[i].Nanoseconds += p.Opcodes[i].Nanoseconds;
+            Opcodes[i].Bytes += p.Opcodes[i].Bytes;
+        }
+
+        Scripts += p.Scripts;
+        SigOps += p.SigOps;
+        Skipped += p.Skipped;
+        MaxStackElements = std::max (MaxStackElements, p.MaxStackElements);
+        MaxStackBytes = std::max (MaxStackBytes, p.MaxStackBytes);
+        return *this;
+    }
+
+    data::JSON profile::report () const {
+        data::JSON ops = data::JSON::array ();
+        for (int i = 0; i < 256; i++) if (Opcodes[i].Count > 0) ops.push_back (data::JSON {
+            {"op", GetOpName (op (i))},
+            {"count", Opcodes[i].Count},
+            {"nanoseconds", Opcodes[i].Nanoseconds},
+            {"bytes", Opcodes[i].Bytes}});
+
+        return data::JSON {
+            {"scripts", Scripts},
+            {"sigops", SigOps},
+            {"skipped", Skipped},
+            {"max_stack_elements", MaxStackElements},
+            {"max_stack_bytes", MaxStackBytes},
+            {"opcodes", ops}};
+    }
+
+    profile profile::local () {
+        return local_recorder ().read ();
+    }
+
+    profile profile::total () {
+        registry &r = get_registry ();
+        std::lock_guard<std::mutex> lock {r.Mutex};
+        profile p = r.Exited;
+        for (const recorder *x : r.Running) p += x->read ();
+        return p;
+    }
+
+    void profile::reset () {
+        registry &r = get_registry ();
+        std::lock_guard<std::mutex> lock {r.Mutex};
+        r.Exited = profile {};
+        for (recorder *x : r.Running) x->clear ();
+    }
+
+    void profile::record (op o, uint64 nanoseconds, uint64 bytes) {
+        recorder::opcode &x = local_recorder ().Opcodes[o];
+        x.Count.add (1);
+        x.Nanoseconds.add (nanoseconds);
+        x.Bytes.add (bytes);
+    }
+
+    void profile::record_stack (uint64 elements, uint64 bytes) {
+        recorder &r = local_recorder ();
+        r.MaxStackElements.max (elements);
+        r.MaxStackBytes.max (bytes);
+    }
+
+    void profile::record_sigops (uint64 n) {
+        local_recorder ().SigOps.add (n);
+    }
+
+    void profile::record_skipped () {
+        local_recorder ().Skipped.add (1);
+    }
+
+    void profile::record_script () {
+        local_recorder ().Scripts.add (1);
+    }
+
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/signature_batch.hpp>
+#include <gigamonkey/signature_cache.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    result signature_batch::add (slice<const byte> sig, slice<const byte> pub, const sighash::document &doc,
+        flag flags, signature_cache *cache, const result &failure, uint32 input_index) {
+        if (ScriptError err = check_signature_encoding (sig, pub, flags); err != SCRIPT_ERR_OK) return err;
+
+        digest256 d = signature::hash (doc, signature::directive (sig));
+        slice<const byte> raw = signature::raw (sig);
+        if (cache == nullptr || !cache->contains (d, pub, raw))
+            Jobs.push_back (job {d, bytes (pub), bytes (raw), failure, input_index});
+
+        return true;
+    }
+
+    signature_batch &signature_batch::operator += (signature_batch &&b) {
+        if (Jobs.empty ()) Jobs = std::move (b.Jobs);
+        else std::move (b.Jobs.begin (), b.Jobs.end (), std::back_inserter (Jobs));
+        b.Jobs.clear ();
+        return *this;
+    }
+
+    maybe<signature_batch::job> signature_batch::check (signature_cache *cache, uint32 threads) {
+        std::vector<secp256k1::pubkey::verification> batch;
+        batch.reserve (Jobs.size ());
+        for (const job &j : Jobs) batch.push_back ({j.Pubkey, j.Digest, j.Signature});
+
+        size_t first = secp256k1::pubkey::verify_batch (batch, threads);
+
+        maybe<job> failure;
+        if (first < Jobs.size ()) failure = Jobs[first];
+        else if (cache != nullptr) for (const job &j : Jobs) cache->insert (j.Digest, j.Pubkey, j.Signature);
+
+        Jobs.clear ();
+        return failure;
+    }
+
+}
@@ -3,29 +3,108 @@
 
 namespace Gigamonkey::Bitcoin {
 
-    void limited_two_stack<false>::modify_top (std::function<void (bytes &)> f, int index) {
-        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
-        auto &val = Stack.at (Stack.size () + index);
-        size_t before_size = val.size ();
-        f (val);
-        size_t after_size = val.size ();
-        if (after_size > MaxScriptElementSize) throw_push_size_exception ();
+    void element::read (size_t begin, size_t size, byte *out) const {
+        if (Pieces.empty ()) {
+            std::copy (Value.begin () + begin, Value.begin () + begin + size, out);
+            return;
+        }
+
+        for (const piece &p : Pieces) {
+            if (size == 0) return;
+            if (begin >= p.Size) {
+                begin -= p.Size;
+                continue;
+            }
+
+            size_t n = std::min (size, p.Size - begin);
+            auto from = p.Buffer->begin () + p.Begin + begin;
+            out = std::copy (from, from + n, out);
+            size -= n;
+            begin = 0;
+        }
     }
 
-    void limited_two_stack<true>::modify_top (std::function<void (bytes &)> f, int index) {
-        if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
-        auto &val = Stack.at (Stack.size () + index);
-        size_t before_size = val.size ();
-        f (val);
-        size_t after_size = val.size ();
-        if (before_size < after_size) increase_memory_usage (after_size - before_size);
-        else decrease_memory_usage (before_size - after_size);
+    std::vector<element::piece> element::share (size_t begin, size_t size) {
+        if (Pieces.empty ()) {
+            if (Value.size () == 0) return {};
+            Size = Value.size ();
+            Pieces.push_back (piece {std::make_shared<const bytes> (static_cast<bytes &&> (Value)), 0, Size});
+            Value.clear ();
+        }
+
+        std::vector<piece> shared;
+        for (const piece &p : Pieces) {
+            if (size == 0) break;
+            if (begin >= p.Size) {
+                begin -= p.Size;
+                continue;
+            }
+
+            size_t n = std::min (size, p.Size - begin);
+            shared.push_back (piece {p.Buffer, p.Begin + begin, n});
+            size -= n;
+            begin = 0;
+        }
+
+        return shared;
+    }
+
+    void element::append (element &x) {
+        if (x.size () == 0) return;
+        size_t size = this->size () + x.size ();
+
+        std::vector<piece> p = x.share (0, x.size ());
+        if (Pieces.empty ()) Pieces = share (0, this->size ());
+        Pieces.insert (Pieces.end (), p.begin (), p.end ());
+        Size = size;
+
+        if (Pieces.size () > MAX_PIECES) flatten ();
+    }
+
+    void two_stack::share () {
+        // sharing part of an element moves all of it into a shared buffer.
+        for (cross<element> *stack : {&Stack, &AltStack})
+            for (element &x : *stack) if (x.size () >= element::LARGE_ELEMENT_SIZE && x.flat ()) x.share (0, 0);
+
+        Spare.clear ();
+    }
+
+    element two_stack::part (element &x, size_t begin, size_t size) {
+        if (size >= element::LARGE_ELEMENT_SIZE) return element {x.share (begin, size), size};
+
+        integer y = make (size);
+        x.read (begin, size, y.data ());
+        return element {std::move (y)};
+    }
+
+    void two_stack::join () {
+        element &x = Stack[Stack.size () - 2];
+        element &y = Stack.back ();
+
+        if (x.size () + y.size () < element::LARGE_ELEMENT_SIZE) {
+            integer &a = x.flatten ();
+            const integer &b = y.flatten ();
+            a.insert (a.end (), b.begin (), b.end ());
+        } else x.append (y);
+
+        recycle (y);
+        Stack.pop_back ();
+    }
+
+    void two_stack::divide (size_t position) {
+        element &x = Stack.back ();
+        element right = part (x, position, x.size () - position);
+        element left = part (x, 0, position);
+        recycle (x);
+        x = std::move (left);
+        Stack.push_back (std::move (right));
     }
 
     void limited_two_stack<true>::pop_back () {
         if (Stack.empty ()) throw std::runtime_error ("popstack(): stack empty");
 
-        decrease_memory_usage (top ().size () + ELEMENT_OVERHEAD);
+        decrease_memory_usage (Stack.back ().size () + ELEMENT_OVERHEAD);
+        recycle (Stack.back ());
         Stack.pop_back ();
     }
 
@@ -33,8 +112,10 @@ namespace Gigamonkey::Bitcoin {
         if (last >= 0 || last <= first)
             throw std::invalid_argument ("Invalid argument - first and last should be negative, also last should be larger than first.");
 
-        for (typename std::vector<integer>::iterator it = Stack.end () + first; it != Stack.end () + last; it++)
+        for (typename std::vector<element>::iterator it = Stack.end () + first; it != Stack.end () + last; it++) {
             decrease_memory_usage (it->size () + ELEMENT_OVERHEAD);
+            recycle (*it);
+        }
 
         Stack.erase (Stack.end () + first, Stack.end () + last);
     }
@@ -43,18 +124,23 @@ namespace Gigamonkey::Bitcoin {
         if (last >= 0 || last <= first)
             throw std::invalid_argument ("Invalid argument - first and last should be negative, also last should be larger than first.");
 
+        for (typename std::vector<element>::iterator it = Stack.end () + first; it != Stack.end () + last; it++) recycle (*it);
+
         Stack.erase (Stack.end () + first, Stack.end () + last);
     }
 
     void limited_two_stack<true>::erase (int index) {
         if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
 
-        decrease_memory_usage (Stack.at (Stack.size () + index).size () + ELEMENT_OVERHEAD);
+        auto &x = Stack.at (Stack.size () + index);
+        decrease_memory_usage (x.size () + ELEMENT_OVERHEAD);
+        recycle (x);
         Stack.erase (Stack.end () + index);
     }
 
     void limited_two_stack<false>::erase (int index) {
         if (index >= 0) throw std::invalid_argument ("Invalid argument - index should be < 0.");
+        recycle (Stack.at (Stack.size () + index));
         Stack.erase (Stack.end () + index);
     }
 
@@ -63,7 +149,7 @@ namespace Gigamonkey::Bitcoin {
         if (position >= 0) throw std::invalid_argument ("Invalid argument - position should be < 0.");
 
         increase_memory_usage (element.size () + ELEMENT_OVERHEAD);
-        Stack.insert (Stack.end () + position, integer {element});
+        Stack.insert (Stack.end () + position, make (element));
     }
 
     void limited_two_stack<false>::insert (int position, slice<const byte> element) {
@@ -72,6 +158,6 @@ namespace Gigamonkey::Bitcoin {
         if (element.size () > MaxScriptElementSize || this->combined_size () == MaxStackElements)
             throw_stack_overflow_exception ();
 
-        Stack.insert (Stack.end () + position, integer {element});
+        Stack.insert (Stack.end () + position, make (element));
     }
 }
@@ -0,0 +1,177 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/script/standard.hpp>
+#include <gigamonkey/script/interpreter.hpp>
+#include <gigamonkey/script/stack.hpp>
+#include <gigamonkey/script/signature_batch.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    namespace {
+
+        // read a push of 2 to 75 bytes. Such a push is always minimal.
+        bool read_push (slice<const byte> &script, slice<const byte> &data) {
+            if (script.size () == 0) return false;
+            size_t size = script[0];
+            if (size < 2 || size > OP_PUSHSIZE75 || script.size () < size + 1) return false;
+            data = slice<const byte> {script.data () + 1, size};
+            script = slice<const byte> {script.data () + size + 1, script.size () - size - 1};
+            return true;
+        }
+
+        bool read_pubkey (slice<const byte> &script, slice<const byte> &pubkey) {
+            return script.size () > 0 &&
+                (script[0] == secp256k1::pubkey::CompressedSize || script[0] == secp256k1::pubkey::UncompressedSize) &&
+                read_push (script, pubkey);
+        }
+
+        // the interpreter puts an OP_CODESEPARATOR between the unlock
+        // and lock scripts, so the script code is the lock script.
+        flat_program script_code (slice<const byte> lock, const cross<slice<const byte>> &sigs) {
+            flat_program code {lock};
+            for (const slice<const byte> &sig : sigs)
+                if (!sighash::has_fork_id (signature::directive (sig)))
+                    code = find_and_delete (code, instruction::push (sig));
+            return code;
+        }
+
+        // whether the config allows a script with the given number of
+        // operations and bytes to run without reaching a limit.
+        bool within_limits (const script_config &conf, uint64 ops, uint64 size) {
+            if (ops > conf.MaxOpsPerScript) return false;
+            // everything on the stack comes from the scripts, except a
+            // copy of a public key and its hash.
+            return !enable_genesis_stack (conf.Flags) ||
+                conf.MaxStackMemoryUsage >= 2 * size + 64 * limited_two_stack<true>::ELEMENT_OVERHEAD;
+        }
+
+        // the OP_CHECKSIG at the end of a script, which can
+        // be put off if signatures are checked in a batch.
+        result final_checksig (slice<const byte> sig, slice<const byte> pub,
+            const sighash::document &d, uint32 input_index, const script_config &conf) {
+            if (conf.DeferSignatures && conf.SignatureBatch != nullptr)
+                return conf.SignatureBatch->add (sig, pub, d, conf.Flags, conf.SignatureCache,
+                    verify_null_fail (conf.Flags) && sig.size () != 0 ? result {SCRIPT_ERR_SIG_NULLFAIL} : result {false},
+                    input_index);
+
+            return verify_signature (sig, pub, d, conf.Flags, conf.SignatureCache);
+        }
+
+        maybe<result> verify_pay_to_address (slice<const byte> unlock, slice<const byte> lock,
+            const redemption_document &doc, const script_config &conf) {
+            // OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+            if (lock.size () != 25 || lock[0] != OP_DUP || lock[1] != OP_HASH160 || lock[2] != 20 ||
+                lock[23] != OP_EQUALVERIFY || lock[24] != OP_CHECKSIG) return {};
+
+            slice<const byte> sig;
+            slice<const byte> pub;
+            if (!read_push (unlock, sig) || !read_push (unlock, pub) || unlock.size () != 0) return {};
+
+            // OP_CODESEPARATOR, OP_DUP, OP_HASH160, OP_EQUALVERIFY, OP_CHECKSIG.
+            if (!within_limits (conf, 5, 25 + sig.size () + pub.size ())) return {};
+
+            digest160 address = Hash160 (pub);
+            if (!std::equal (address.begin (), address.end (), lock.data () + 3)) return result {SCRIPT_ERR_EQUALVERIFY};
+
+            sighash::document d {doc.Transaction, doc.InputIndex, doc.RedeemedValue, script_code (lock, {sig}), doc.Precomputed};
+            return final_checksig (sig, pub, d, doc.InputIndex, conf);
+        }
+
+        maybe<result> verify_pay_to_pubkey (slice<const byte> unlock, slice<const byte> lock,
+            const redemption_document &doc, const script_config &conf) {
+            // <pubkey> OP_CHECKSIG
+            slice<const byte> key = lock;
+            slice<const byte> pub;
+            if (!read_pubkey (key, pub) || key.size () != 1 || key[0] != OP_CHECKSIG) return {};
+
+            slice<const byte> sig;
+            if (!read_push (unlock, sig) || unlock.size () != 0) return {};
+
+            // OP_CODESEPARATOR, OP_CHECKSIG.
+            if (!within_limits (conf, 2, lock.size () + sig.size ())) return {};
+
+            sighash::document d {doc.Transaction, doc.InputIndex, doc.RedeemedValue, script_code (lock, {sig}), doc.Precomputed};
+            return final_checksig (sig, pub, d, doc.InputIndex, conf);
+        }
+
+        maybe<result> verify_multisig (slice<const byte> unlock, slice<const byte> lock,
+            const redemption_document &doc, const script_config &conf) {
+            // OP_m <pubkey> ... OP_n OP_CHECKMULTISIG
+            if (lock.size () < 3 || lock[0] < OP_1 || lock[0] > OP_16 ||
+                lock[lock.size () - 1] != OP_CHECKMULTISIG) return {};
+
+            int64 m = lock[0] - OP_1 + 1;
+
+            cross<slice<const byte>> pubs;
+            slice<const byte> rest {lock.data () + 1, lock.size () - 1};
+            slice<const byte> pub;
+            // OP_n can be no more than OP_16.
+            while (pubs.size () < 16 && read_pubkey (rest, pub)) pubs.push_back (pub);
+
+            int64 n = pubs.size ();
+            if (rest.size () != 2 || n == 0 || n > 16 || rest[0] != OP_1 + n - 1 || n < m) return {};
+
+            // OP_0 <sig> ...
+            if (unlock.size () == 0 || unlock[0] != OP_0) return {};
+            unlock = slice<const byte> {unlock.data () + 1, unlock.size () - 1};
+
+            cross<slice<const byte>> sigs;
+            slice<const byte> sig;
+            while (read_push (unlock, sig)) sigs.push_back (sig);
+            if (unlock.size () != 0 || int64 (sigs.size ()) != m) return {};
+
+            // OP_CODESEPARATOR and OP_CHECKMULTISIG, which also counts each key.
+            if (uint64 (n) > conf.MaxPubKeysPerMultiSig) return {};
+            uint64 size = lock.size ();
+            for (const slice<const byte> &s : sigs) size += s.size ();
+            if (!within_limits (conf, 2 + n, size)) return {};
+
+            sighash::document d {doc.Transaction, doc.InputIndex, doc.RedeemedValue, script_code (lock, sigs), doc.Precomputed};
+
+            // the same algorithm as OP_CHECKMULTISIG. The signatures
+            // and keys are checked starting from the top of the stack.
+            int64 isig = m - 1;
+            int64 ikey = n - 1;
+            int64 remaining_sigs = m;
+            int64 remaining_keys = n;
+            bool success = true;
+            while (success && remaining_sigs > 0) {
+                result r = verify_signature (sigs[isig], pubs[ikey], d, conf.Flags, conf.SignatureCache);
+                if (r.Error) return r;
+
+                if (r.Success) {
+                    isig--;
+                    remaining_sigs--;
+                }
+
+                ikey--;
+                remaining_keys--;
+
+                if (remaining_sigs > remaining_keys) success = false;
+            }
+
+            // every signature is at least 2 bytes long.
+            if (!success && verify_null_fail (conf.Flags)) return result {SCRIPT_ERR_SIG_NULLFAIL};
+
+            return result {success};
+        }
+    }
+
+    maybe<result> verify_standard (slice<const byte> unlock, slice<const byte> lock,
+        const redemption_document &doc, const script_config &conf) {
+        // profiles must record every operation.
+        if (conf.Profile) return {};
+
+        if (maybe<result> r = verify_pay_to_address (unlock, lock, doc, conf); bool (r)) return r;
+        if (maybe<result> r = verify_pay_to_pubkey (unlock, lock, doc, conf); bool (r)) return r;
+        return verify_multisig (unlock, lock, doc, conf);
+    }
+
+    result evaluate_standard (const script &unlock, const script &lock,
+        const redemption_document &doc, const script_config &conf) {
+        if (maybe<result> r = verify_standard (unlock, lock, doc, conf); bool (r)) return *r;
+        return evaluate (unlock, lock, doc, conf);
+    }
+
+}
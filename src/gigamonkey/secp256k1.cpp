@@ -7,6 +7,8 @@
 #include <gigamonkey/secp256k1.hpp>
 #include <data/encoding/integer.hpp>
 #include <secp256k1.h>
+#include <gigamonkey/thread_pool.hpp>
+#include <atomic>
 
 namespace Gigamonkey::secp256k1 {
 
@@ -308,6 +310,46 @@ namespace Gigamonkey::secp256k1 {
         return parse (context, pubkey, pk) && verify_signature (context, pubkey, d, parsed);
     }
     
+    size_t pubkey::verify_batch (const std::vector<verification> &batch, uint32 threads) {
+        // signatures are handed out to threads in chunks of this size.
+        constexpr size_t chunk = 8;
+
+        thread_pool &pool = thread_pool::global ();
+        if (threads == 0) threads = pool.size ();
+        threads = std::min (size_t (threads), (batch.size () + chunk - 1) / chunk);
+
+        if (threads <= 1) {
+            for (size_t i = 0; i < batch.size (); i++)
+                if (!verify (batch[i].Pubkey, batch[i].Digest, batch[i].Signature)) return i;
+            return batch.size ();
+        }
+
+        // the context is created lazily, which is not thread safe.
+        Verification ();
+
+        std::atomic<size_t> next {0};
+        std::atomic<size_t> first {batch.size ()};
+
+        auto work = [&batch, &next, &first] () {
+            while (true) {
+                size_t begin = next.fetch_add (chunk, std::memory_order_relaxed);
+                // nothing after the first failure matters.
+                if (begin >= first.load (std::memory_order_relaxed)) return;
+                size_t end = std::min (begin + chunk, batch.size ());
+                for (size_t i = begin; i < end; i++)
+                    if (!verify (batch[i].Pubkey, batch[i].Digest, batch[i].Signature)) {
+                        size_t f = first.load (std::memory_order_relaxed);
+                        while (i < f && !first.compare_exchange_weak (f, i, std::memory_order_relaxed));
+                        return;
+                    }
+            }
+        };
+
+        pool.run (work, threads);
+
+        return first.load ();
+    }
+
     uint256 secret::negate (const uint256& sk) {
         uint256 out {sk};
         return secp256k1_ec_seckey_negate (Verification (), out.data ()) == 1 ? out : uint256 {};
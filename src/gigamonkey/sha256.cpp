@@ -0,0 +1,469 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/sha256.hpp>
+#include <boost/endian/conversion.hpp>
+#include "sha256/kernels.hpp"
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        constexpr uint32 K[64] {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        uint32 inline rotate (uint32 x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        uint32 inline sigma0 (uint32 x) {
+            return rotate (x, 7) ^ rotate (x, 18) ^ (x >> 3);
+        }
+
+        uint32 inline sigma1 (uint32 x) {
+            return rotate (x, 17) ^ rotate (x, 19) ^ (x >> 10);
+        }
+
+        // one round, in which the working variables are passed
+        // in rotated order rather than moved.
+        void inline round (uint32 a, uint32 b, uint32 c, uint32 &d, uint32 e, uint32 f, uint32 g, uint32 &h, uint32 k) {
+            uint32 t1 = h + (rotate (e, 6) ^ rotate (e, 11) ^ rotate (e, 25)) + ((e & f) ^ (~e & g)) + k;
+            uint32 t2 = (rotate (a, 2) ^ rotate (a, 13) ^ rotate (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            d += t1;
+            h = t1 + t2;
+        }
+
+        void transform_reference (uint32 *s, const byte *blocks, size_t count) {
+            for (; count > 0; count--, blocks += 64) {
+                uint32 w[16];
+                for (int i = 0; i < 16; i++) w[i] = boost::endian::load_big_u32 (blocks + 4 * i);
+
+                uint32 a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+                for (int i = 0; i < 64; i += 8) {
+                    if (i >= 16) for (int j = 0; j < 8; j++)
+                        w[(i + j) & 15] += sigma1 (w[(i + j + 14) & 15]) + w[(i + j + 9) & 15] + sigma0 (w[(i + j + 1) & 15]);
+
+                    round (a, b, c, d, e, f, g, h, K[i] + w[i & 15]);
+                    round (h, a, b, c, d, e, f, g, K[i + 1] + w[(i + 1) & 15]);
+                    round (g, h, a, b, c, d, e, f, K[i + 2] + w[(i + 2) & 15]);
+                    round (f, g, h, a, b, c, d, e, K[i + 3] + w[(i + 3) & 15]);
+                    round (e, f, g, h, a, b, c, d, K[i + 4] + w[(i + 4) & 15]);
+                    round (d, e, f, g, h, a, b, c, K[i + 5] + w[(i + 5) & 15]);
+                    round (c, d, e, f, g, h, a, b, K[i + 6] + w[(i + 6) & 15]);
+                    round (b, c, d, e, f, g, h, a, K[i + 7] + w[(i + 7) & 15]);
+                }
+
+                s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+                s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+            }
+        }
+
+#ifdef GIGAMONKEY_SHA256_X86_LANES
+        // which registers the operating system saves.
+        uint64 xcr0 () {
+            uint32 a, d;
+            __asm__ ("xgetbv" : "=a" (a), "=d" (d) : "c" (0));
+            return (uint64 (d) << 32) | a;
+        }
+#endif
+
+        bool supported (implementation x) {
+            switch (x) {
+                case implementation::reference: return true;
+#ifdef GIGAMONKEY_SHA256_X86_SHANI
+                case implementation::x86_shani: {
+                    unsigned int a, b, c, d;
+                    if (!__get_cpuid (1, &a, &b, &c, &d) || !(c & bit_SSSE3) || !(c & bit_SSE4_1)) return false;
+                    return __get_cpuid_count (7, 0, &a, &b, &c, &d) && (b & bit_SHA);
+                }
+#endif
+#ifdef GIGAMONKEY_SHA256_ARM_SHANI
+                case implementation::arm_shani: {
+#if defined(__APPLE__)
+                    return true;
+#elif defined(__linux__)
+                    return getauxval (AT_HWCAP) & HWCAP_SHA2;
+#else
+                    return false;
+#endif
+                }
+#endif
+#ifdef GIGAMONKEY_SHA256_X86_LANES
+                case implementation::x86_sse41: {
+                    unsigned int a, b, c, d;
+                    return __get_cpuid (1, &a, &b, &c, &d) && (c & bit_SSE4_1);
+                }
+                case implementation::x86_avx2: {
+                    unsigned int a, b, c, d;
+                    // the operating system must save the ymm registers.
+                    if (!__get_cpuid (1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || (xcr0 () & 0x06) != 0x06) return false;
+                    return __get_cpuid_count (7, 0, &a, &b, &c, &d) && (b & bit_AVX2);
+                }
+                case implementation::x86_avx512: {
+                    unsigned int a, b, c, d;
+                    // and the zmm and mask registers.
+                    if (!__get_cpuid (1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || (xcr0 () & 0xe6) != 0xe6) return false;
+                    return __get_cpuid_count (7, 0, &a, &b, &c, &d) && (b & bit_AVX512F);
+                }
+#endif
+                default: return false;
+            }
+        }
+
+        // a message that ends at a block boundary is followed by a block of padding
+        // that depends only on its length. These are for 64 and 80 bytes, and for
+        // the 32 bytes of the second hash in a double hash, with the message left out.
+        constexpr std::array<byte, 64> padding (size_t length) {
+            std::array<byte, 64> b {};
+            b[length % 64] = 0x80;
+            uint64 bits = length * 8;
+            for (int i = 0; i < 8; i++) b[63 - i] = byte (bits >> (8 * i));
+            return b;
+        }
+
+        alignas (16) constexpr std::array<byte, 64> Pad32 = padding (32);
+        alignas (16) constexpr std::array<byte, 64> Pad64 = padding (64);
+        alignas (16) constexpr std::array<byte, 64> Pad80 = padding (80);
+
+        data::digest<32> write (const uint32 *s) {
+            data::digest<32> d;
+            for (int i = 0; i < 8; i++) boost::endian::store_big_u32 (d.data () + 4 * i, s[i]);
+            return d;
+        }
+
+        // the second hash of a double hash, which is of the state of the first.
+        data::digest<32> finish_double (const uint32 *first) {
+            alignas (16) std::array<byte, 64> block = Pad32;
+            for (int i = 0; i < 8; i++) boost::endian::store_big_u32 (block.data () + 4 * i, first[i]);
+            std::array<uint32, 8> s = Initial;
+            transform (s.data (), block.data (), 1);
+            return write (s.data ());
+        }
+
+        using transformer = void (*) (uint32 *, const byte *, size_t);
+
+        transformer function (implementation x) {
+            switch (x) {
+#ifdef GIGAMONKEY_SHA256_X86_SHANI
+                case implementation::x86_shani: return transform_x86_shani;
+#endif
+#ifdef GIGAMONKEY_SHA256_ARM_SHANI
+                case implementation::arm_shani: return transform_arm_shani;
+#endif
+                default: return transform_reference;
+            }
+        }
+
+        using lane_transformer = void (*) (uint32 *, const byte *const *, size_t);
+
+        // a single stream implementation used for batches.
+        template <transformer f> void one_lane (uint32 *state, const byte *const *blocks, size_t count) {
+            f (state, blocks[0], count);
+        }
+
+        lane_transformer lane_function (implementation x) {
+            switch (x) {
+#ifdef GIGAMONKEY_SHA256_X86_SHANI
+                case implementation::x86_shani: return one_lane<transform_x86_shani>;
+#endif
+#ifdef GIGAMONKEY_SHA256_ARM_SHANI
+                case implementation::arm_shani: return one_lane<transform_arm_shani>;
+#endif
+#ifdef GIGAMONKEY_SHA256_X86_LANES
+                case implementation::x86_sse41: return transform_x86_sse41;
+                case implementation::x86_avx2: return transform_x86_avx2;
+                case implementation::x86_avx512: return transform_x86_avx512;
+#endif
+                default: return one_lane<transform_reference>;
+            }
+        }
+
+        implementation fastest () {
+            for (implementation x : {implementation::x86_shani, implementation::arm_shani})
+                if (supported (x)) return x;
+            return implementation::reference;
+        }
+
+        // one message at a time with the SHA extensions is about as fast as
+        // sixteen lanes of AVX-512 and it does not slow the clock down, so
+        // vectors are for processors that do not have them.
+        implementation fastest_batch () {
+            for (implementation x : {implementation::x86_shani, implementation::arm_shani,
+                implementation::x86_avx512, implementation::x86_avx2, implementation::x86_sse41})
+                if (supported (x)) return x;
+            return implementation::reference;
+        }
+
+        struct dispatch {
+            std::atomic<implementation> Active;
+            std::atomic<transformer> Transform;
+
+            // the batch implementation is only read through Batch, so
+            // that the number of lanes always goes with the function.
+            struct batch {
+                implementation Active;
+                uint32 Lanes;
+                lane_transformer Transform;
+            };
+
+            std::atomic<const batch *> Batch;
+
+            dispatch () {
+                set (fastest ());
+                set_batch (fastest_batch ());
+            }
+
+            void set (implementation x) {
+                Transform.store (function (x), std::memory_order_relaxed);
+                Active.store (x, std::memory_order_relaxed);
+            }
+
+            void set_batch (implementation x) {
+                static const batch all[] {
+                    {implementation::reference, 1, lane_function (implementation::reference)},
+                    {implementation::x86_shani, 1, lane_function (implementation::x86_shani)},
+                    {implementation::arm_shani, 1, lane_function (implementation::arm_shani)},
+                    {implementation::x86_sse41, 4, lane_function (implementation::x86_sse41)},
+                    {implementation::x86_avx2, 8, lane_function (implementation::x86_avx2)},
+                    {implementation::x86_avx512, 16, lane_function (implementation::x86_avx512)}};
+                Batch.store (&all[static_cast<byte> (x)], std::memory_order_relaxed);
+            }
+        };
+
+        dispatch &current () {
+            static dispatch d {};
+            return d;
+        }
+
+        // hash up to max_lanes messages of the same length at once. If there are fewer
+        // messages than lanes, the last one is repeated in the remaining lanes.
+        void hash_lanes (const dispatch::batch &x, const slice<const byte> *in, data::digest<32> *out, size_t n, bool twice) {
+            alignas (64) uint32 states[8 * max_lanes];
+            alignas (64) byte tail[max_lanes][128];
+            const byte *blocks[max_lanes] {};
+
+            size_t length = in[0].size ();
+            size_t full = length / 64;
+            size_t rest = length % 64;
+            size_t tail_blocks = rest < 56 ? 1 : 2;
+
+            for (uint32 j = 0; j < x.Lanes; j++) {
+                std::copy (Initial.begin (), Initial.end (), states + 8 * j);
+                blocks[j] = in[std::min (size_t (j), n - 1)].data ();
+            }
+
+            // full blocks are hashed where they are.
+            if (full > 0) x.Transform (states, blocks, full);
+
+            // if the messages end at a block boundary, every lane gets the same padding.
+            if (rest == 0) {
+                std::array<byte, 64> p = length == 64 ? Pad64 : padding (length);
+                std::copy (p.begin (), p.end (), tail[0]);
+                for (uint32 j = 0; j < x.Lanes; j++) blocks[j] = tail[0];
+            } else for (uint32 j = 0; j < x.Lanes; j++) {
+                byte *t = tail[j];
+                std::copy (blocks[j] + 64 * full, blocks[j] + length, t);
+                t[rest] = 0x80;
+                std::fill (t + rest + 1, t + 64 * tail_blocks - 8, 0);
+                boost::endian::store_big_u64 (t + 64 * tail_blocks - 8, uint64 (length) * 8);
+                blocks[j] = t;
+            }
+
+            x.Transform (states, blocks, tail_blocks);
+
+            if (twice) {
+                for (uint32 j = 0; j < x.Lanes; j++) {
+                    byte *t = tail[j];
+                    std::copy (Pad32.begin () + 32, Pad32.end (), t + 32);
+                    for (int i = 0; i < 8; i++) boost::endian::store_big_u32 (t + 4 * i, states[8 * j + i]);
+                    std::copy (Initial.begin (), Initial.end (), states + 8 * j);
+                    blocks[j] = t;
+                }
+
+                x.Transform (states, blocks, 1);
+            }
+
+            for (size_t j = 0; j < n; j++) out[j] = write (states + 8 * j);
+        }
+
+        void hash_batch (std::span<const slice<const byte>> in, std::span<data::digest<32>> out, bool twice) {
+            if (in.size () != out.size ()) throw std::invalid_argument {"sha256 batch input and output sizes differ"};
+
+            const dispatch::batch &x = *current ().Batch.load (std::memory_order_relaxed);
+
+            size_t i = 0;
+            while (i < in.size ()) {
+                size_t n = 1;
+                while (n < x.Lanes && i + n < in.size () && in[i + n].size () == in[i].size ()) n++;
+
+                // a message by itself is not worth a whole vector.
+                if (n == 1 && x.Lanes > 1) out[i] = twice ? double_hash (in[i]) : hash (in[i]);
+                else hash_lanes (x, &in[i], &out[i], n, twice);
+
+                i += n;
+            }
+        }
+    }
+
+    std::ostream &operator << (std::ostream &o, implementation x) {
+        switch (x) {
+            case implementation::reference: return o << "reference";
+            case implementation::x86_shani: return o << "x86_shani";
+            case implementation::arm_shani: return o << "arm_shani";
+            case implementation::x86_sse41: return o << "x86_sse41";
+            case implementation::x86_avx2: return o << "x86_avx2";
+            case implementation::x86_avx512: return o << "x86_avx512";
+            default: return o << "unknown";
+        }
+    }
+
+    bool available (implementation x) {
+        return supported (x);
+    }
+
+    uint32 lanes (implementation x) {
+        switch (x) {
+            case implementation::x86_sse41: return 4;
+            case implementation::x86_avx2: return 8;
+            case implementation::x86_avx512: return 16;
+            default: return 1;
+        }
+    }
+
+    implementation active () {
+        return current ().Active.load (std::memory_order_relaxed);
+    }
+
+    implementation active_batch () {
+        return current ().Batch.load (std::memory_order_relaxed)->Active;
+    }
+
+    void select (implementation x) {
+        if (!supported (x)) throw std::invalid_argument {"sha256 implementation is not available"};
+        if (lanes (x) > 1) throw std::invalid_argument {"sha256 implementation is only for batches"};
+        current ().set (x);
+    }
+
+    void select_batch (implementation x) {
+        if (!supported (x)) throw std::invalid_argument {"sha256 implementation is not available"};
+        current ().set_batch (x);
+    }
+
+    void reset () {
+        current ().set (fastest ());
+        current ().set_batch (fastest_batch ());
+    }
+
+    void transform (uint32 *state, const byte *blocks, size_t count) {
+        current ().Transform.load (std::memory_order_relaxed) (state, blocks, count);
+    }
+
+    uint32 lanes () {
+        return current ().Batch.load (std::memory_order_relaxed)->Lanes;
+    }
+
+    void transform (uint32 *states, const byte *const *blocks, size_t count) {
+        current ().Batch.load (std::memory_order_relaxed)->Transform (states, blocks, count);
+    }
+
+    data::digest<32> double_hash (slice<const byte> b) {
+        state x {};
+        x.update (b);
+        return finish_double (x.finish ().data ());
+    }
+
+    data::digest<32> double_hash_64 (const byte *b) {
+        std::array<uint32, 8> s = Initial;
+        transform (s.data (), b, 1);
+        transform (s.data (), Pad64.data (), 1);
+        return finish_double (s.data ());
+    }
+
+    std::array<uint32, 8> midstate_80 (const byte *b) {
+        std::array<uint32, 8> s = Initial;
+        transform (s.data (), b, 1);
+        return s;
+    }
+
+    data::digest<32> double_hash_80 (const std::array<uint32, 8> &midstate, const byte *b) {
+        alignas (16) std::array<byte, 64> block = Pad80;
+        std::copy (b, b + 16, block.data ());
+        std::array<uint32, 8> s = midstate;
+        transform (s.data (), block.data (), 1);
+        return finish_double (s.data ());
+    }
+
+    void hash (std::span<const slice<const byte>> in, std::span<data::digest<32>> out) {
+        hash_batch (in, out, false);
+    }
+
+    void double_hash (std::span<const slice<const byte>> in, std::span<data::digest<32>> out) {
+        hash_batch (in, out, true);
+    }
+
+    state &state::update (slice<const byte> b) {
+        const byte *data = b.data ();
+        size_t size = b.size ();
+        size_t buffered = Length % 64;
+        Length += size;
+
+        if (buffered > 0) {
+            size_t fill = std::min (size, 64 - buffered);
+            std::copy (data, data + fill, Buffer.data () + buffered);
+            data += fill;
+            size -= fill;
+            if (buffered + fill < 64) return *this;
+            transform (State.data (), Buffer.data (), 1);
+        }
+
+        // full blocks are hashed where they are.
+        if (size >= 64) {
+            transform (State.data (), data, size / 64);
+            data += size - size % 64;
+            size %= 64;
+        }
+
+        std::copy (data, data + size, Buffer.data ());
+        return *this;
+    }
+
+    data::digest<32> state::complete () {
+        return write (finish ().data ());
+    }
+
+    const std::array<uint32, 8> &state::finish () {
+        size_t buffered = Length % 64;
+        uint64 bits = Length * 8;
+
+        Buffer[buffered] = 0x80;
+        std::fill (Buffer.data () + buffered + 1, Buffer.data () + 64, 0);
+        if (buffered >= 56) {
+            transform (State.data (), Buffer.data (), 1);
+            std::fill (Buffer.data (), Buffer.data () + 56, 0);
+        }
+
+        boost::endian::store_big_u64 (Buffer.data () + 56, bits);
+        transform (State.data (), Buffer.data (), 1);
+        return State;
+    }
+
+}
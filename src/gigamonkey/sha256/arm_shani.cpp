@@ -0,0 +1,66 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// SHA-256 with the ARMv8 cryptography extensions. This file is compiled with
+// -march=armv8-a+crypto and is only used if the processor supports them.
+
+#include "kernels.hpp"
+#include <arm_neon.h>
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        alignas (16) constexpr std::uint32_t K[64] {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        // load a big-endian message block.
+        inline uint32x4_t load (const unsigned char *b) {
+            return vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (b)));
+        }
+
+        // four rounds with message words m, which starts at round 4 * i.
+        inline void quad_round (uint32x4_t &abcd, uint32x4_t &efgh, uint32x4_t m, int i) {
+            uint32x4_t x = vaddq_u32 (m, vld1q_u32 (K + 4 * i));
+            uint32x4_t saved = abcd;
+            abcd = vsha256hq_u32 (abcd, efgh, x);
+            efgh = vsha256h2q_u32 (efgh, saved, x);
+        }
+    }
+
+    void transform_arm_shani (std::uint32_t *s, const unsigned char *blocks, std::size_t count) {
+        uint32x4_t abcd = vld1q_u32 (s);
+        uint32x4_t efgh = vld1q_u32 (s + 4);
+
+        for (; count > 0; count--, blocks += 64) {
+            uint32x4_t abcd_saved = abcd;
+            uint32x4_t efgh_saved = efgh;
+
+            uint32x4_t m[4] {load (blocks), load (blocks + 16), load (blocks + 32), load (blocks + 48)};
+
+            // rounds 0 through 47 also compute the message for 16 rounds later.
+            for (int i = 0; i < 12; i++) {
+                uint32x4_t &m0 = m[i & 3];
+                uint32x4_t next = vsha256su0q_u32 (m0, m[(i + 1) & 3]);
+                quad_round (abcd, efgh, m0, i);
+                m0 = vsha256su1q_u32 (next, m[(i + 2) & 3], m[(i + 3) & 3]);
+            }
+
+            for (int i = 12; i < 16; i++) quad_round (abcd, efgh, m[i & 3], i);
+
+            abcd = vaddq_u32 (abcd, abcd_saved);
+            efgh = vaddq_u32 (efgh, efgh_saved);
+        }
+
+        vst1q_u32 (s, abcd);
+        vst1q_u32 (s + 4, efgh);
+    }
+
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// The SHA-256 kernels that are compiled for instructions the processor might
+// not have. Each is in its own file with its own compile flags, and sha256.cpp
+// checks the processor before calling one. Those files must include nothing
+// but this and the intrinsics header. Any inline function from another header
+// would be compiled with the extra instructions, and the linker could keep that
+// copy for the whole program, which would then crash on older processors.
+
+#ifndef GIGAMONKEY_SHA256_KERNELS
+#define GIGAMONKEY_SHA256_KERNELS
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Gigamonkey::sha256 {
+
+    // state is 8 words. Read count blocks of 64 bytes in a row.
+    void transform_x86_shani (std::uint32_t *state, const unsigned char *blocks, std::size_t count);
+    void transform_arm_shani (std::uint32_t *state, const unsigned char *blocks, std::size_t count);
+
+    // states holds one state of 8 words for each lane, one after another.
+    // Each lane reads count blocks in a row starting from its pointer.
+    void transform_x86_sse41 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count);
+    void transform_x86_avx2 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count);
+    void transform_x86_avx512 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count);
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// The SHA-256 compression function run on several independent messages at
+// once, one in each lane of a vector register. This is included by each of
+// the files that implement it for a particular instruction set. V provides
+// the vector operations and the number of lanes. Like those files, this must
+// include nothing but kernels.hpp; see there.
+
+#ifndef GIGAMONKEY_SHA256_LANES
+#define GIGAMONKEY_SHA256_LANES
+
+#include "kernels.hpp"
+
+namespace Gigamonkey::sha256::lanes {
+
+    alignas (64) constexpr std::uint32_t K[64] {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    template <typename V> struct rounds {
+        using word = typename V::word;
+        constexpr static int N = V::Lanes;
+
+        static word inline big_sigma0 (word a) {
+            return V::xor3 (V::template rotr<2> (a), V::template rotr<13> (a), V::template rotr<22> (a));
+        }
+
+        static word inline big_sigma1 (word e) {
+            return V::xor3 (V::template rotr<6> (e), V::template rotr<11> (e), V::template rotr<25> (e));
+        }
+
+        static word inline sigma0 (word x) {
+            return V::xor3 (V::template rotr<7> (x), V::template rotr<18> (x), V::template shr<3> (x));
+        }
+
+        static word inline sigma1 (word x) {
+            return V::xor3 (V::template rotr<17> (x), V::template rotr<19> (x), V::template shr<10> (x));
+        }
+
+        static void inline round (word a, word b, word c, word &d, word e, word f, word g, word &h, word k) {
+            word t1 = V::add (V::add (h, big_sigma1 (e)), V::add (V::choose (e, f, g), k));
+            word t2 = V::add (big_sigma0 (a), V::majority (a, b, c));
+            d = V::add (d, t1);
+            h = V::add (t1, t2);
+        }
+
+        static std::uint32_t inline load_big (const unsigned char *b) {
+            return (std::uint32_t (b[0]) << 24) | (std::uint32_t (b[1]) << 16) | (std::uint32_t (b[2]) << 8) | std::uint32_t (b[3]);
+        }
+
+        // word i of the current block of every lane.
+        static word inline load (const unsigned char *const *blocks, std::size_t offset) {
+            alignas (64) std::uint32_t x[N];
+            for (int j = 0; j < N; j++) x[j] = load_big (blocks[j] + offset);
+            return V::load (x);
+        }
+
+        // states holds N states of 8 words one after another. Each lane
+        // reads count blocks in a row starting from its pointer.
+        static void transform (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count) {
+            alignas (64) std::uint32_t x[N];
+            word s[8];
+            for (int i = 0; i < 8; i++) {
+                for (int j = 0; j < N; j++) x[j] = states[8 * j + i];
+                s[i] = V::load (x);
+            }
+
+            for (std::size_t block = 0; block < count; block++) {
+                word w[16];
+                for (int i = 0; i < 16; i++) w[i] = load (blocks, 64 * block + 4 * i);
+
+                word a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+                for (int i = 0; i < 64; i += 8) {
+                    if (i >= 16) for (int j = 0; j < 8; j++) {
+                        word &x = w[(i + j) & 15];
+                        x = V::add (V::add (x, sigma1 (w[(i + j + 14) & 15])),
+                            V::add (w[(i + j + 9) & 15], sigma0 (w[(i + j + 1) & 15])));
+                    }
+
+                    round (a, b, c, d, e, f, g, h, V::add (V::set1 (K[i]), w[i & 15]));
+                    round (h, a, b, c, d, e, f, g, V::add (V::set1 (K[i + 1]), w[(i + 1) & 15]));
+                    round (g, h, a, b, c, d, e, f, V::add (V::set1 (K[i + 2]), w[(i + 2) & 15]));
+                    round (f, g, h, a, b, c, d, e, V::add (V::set1 (K[i + 3]), w[(i + 3) & 15]));
+                    round (e, f, g, h, a, b, c, d, V::add (V::set1 (K[i + 4]), w[(i + 4) & 15]));
+                    round (d, e, f, g, h, a, b, c, V::add (V::set1 (K[i + 5]), w[(i + 5) & 15]));
+                    round (c, d, e, f, g, h, a, b, V::add (V::set1 (K[i + 6]), w[(i + 6) & 15]));
+                    round (b, c, d, e, f, g, h, a, V::add (V::set1 (K[i + 7]), w[(i + 7) & 15]));
+                }
+
+                s[0] = V::add (s[0], a); s[1] = V::add (s[1], b); s[2] = V::add (s[2], c); s[3] = V::add (s[3], d);
+                s[4] = V::add (s[4], e); s[5] = V::add (s[5], f); s[6] = V::add (s[6], g); s[7] = V::add (s[7], h);
+            }
+
+            for (int i = 0; i < 8; i++) {
+                V::store (x, s[i]);
+                for (int j = 0; j < N; j++) states[8 * j + i] = x[j];
+            }
+        }
+    };
+
+}
+
+#endif
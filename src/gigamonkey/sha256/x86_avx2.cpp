@@ -0,0 +1,61 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// SHA-256 on eight messages at once with AVX2. This file is compiled with
+// -mavx2 and is only used if the processor supports it.
+
+#include "lanes.hpp"
+#include <immintrin.h>
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        struct avx2 {
+            using word = __m256i;
+            constexpr static int Lanes = 8;
+
+            static word inline load (const std::uint32_t *x) {
+                return _mm256_load_si256 (reinterpret_cast<const __m256i *> (x));
+            }
+
+            static void inline store (std::uint32_t *x, word w) {
+                _mm256_store_si256 (reinterpret_cast<__m256i *> (x), w);
+            }
+
+            static word inline set1 (std::uint32_t x) {
+                return _mm256_set1_epi32 (x);
+            }
+
+            static word inline add (word a, word b) {
+                return _mm256_add_epi32 (a, b);
+            }
+
+            template <int n> static word inline shr (word x) {
+                return _mm256_srli_epi32 (x, n);
+            }
+
+            template <int n> static word inline rotr (word x) {
+                return _mm256_or_si256 (_mm256_srli_epi32 (x, n), _mm256_slli_epi32 (x, 32 - n));
+            }
+
+            static word inline xor3 (word a, word b, word c) {
+                return _mm256_xor_si256 (_mm256_xor_si256 (a, b), c);
+            }
+
+            static word inline choose (word e, word f, word g) {
+                return _mm256_xor_si256 (g, _mm256_and_si256 (e, _mm256_xor_si256 (f, g)));
+            }
+
+            static word inline majority (word a, word b, word c) {
+                return _mm256_or_si256 (_mm256_and_si256 (a, b), _mm256_and_si256 (c, _mm256_or_si256 (a, b)));
+            }
+        };
+
+    }
+
+    void transform_x86_avx2 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count) {
+        lanes::rounds<avx2>::transform (states, blocks, count);
+    }
+
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// SHA-256 on sixteen messages at once with AVX-512. This file is compiled
+// with -mavx512f and is only used if the processor supports it.
+
+#include "lanes.hpp"
+#include <immintrin.h>
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        // AVX-512 has rotations and three-input logic, which
+        // save most of the instructions in the round function.
+        struct avx512 {
+            using word = __m512i;
+            constexpr static int Lanes = 16;
+
+            static word inline load (const std::uint32_t *x) {
+                return _mm512_load_si512 (x);
+            }
+
+            static void inline store (std::uint32_t *x, word w) {
+                _mm512_store_si512 (x, w);
+            }
+
+            static word inline set1 (std::uint32_t x) {
+                return _mm512_set1_epi32 (x);
+            }
+
+            static word inline add (word a, word b) {
+                return _mm512_add_epi32 (a, b);
+            }
+
+            template <int n> static word inline shr (word x) {
+                return _mm512_srli_epi32 (x, n);
+            }
+
+            template <int n> static word inline rotr (word x) {
+                return _mm512_ror_epi32 (x, n);
+            }
+
+            static word inline xor3 (word a, word b, word c) {
+                return _mm512_ternarylogic_epi32 (a, b, c, 0x96);
+            }
+
+            static word inline choose (word e, word f, word g) {
+                return _mm512_ternarylogic_epi32 (e, f, g, 0xca);
+            }
+
+            static word inline majority (word a, word b, word c) {
+                return _mm512_ternarylogic_epi32 (a, b, c, 0xe8);
+            }
+        };
+
+    }
+
+    void transform_x86_avx512 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count) {
+        lanes::rounds<avx512>::transform (states, blocks, count);
+    }
+
+}
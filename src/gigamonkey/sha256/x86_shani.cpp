@@ -0,0 +1,111 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// SHA-256 with the x86 SHA extensions. This file is compiled with -msse4.1
+// -msha and is only used if the processor has been seen to support them.
+
+#include "kernels.hpp"
+#include <immintrin.h>
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        alignas (16) constexpr std::uint32_t K[64] {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        // four rounds with message words m, which starts at round 4 * i.
+        inline void quad_round (__m128i &abef, __m128i &cdgh, __m128i m, int i) {
+            __m128i x = _mm_add_epi32 (m, _mm_load_si128 (reinterpret_cast<const __m128i *> (K + 4 * i)));
+            cdgh = _mm_sha256rnds2_epu32 (cdgh, abef, x);
+            abef = _mm_sha256rnds2_epu32 (abef, cdgh, _mm_shuffle_epi32 (x, 0x0e));
+        }
+
+        // the first part of the message schedule, which can start early.
+        inline void schedule_a (__m128i &m0, __m128i m1) {
+            m0 = _mm_sha256msg1_epu32 (m0, m1);
+        }
+
+        // finish the next four words of the message in m2.
+        inline void schedule_c (__m128i m0, __m128i m1, __m128i &m2) {
+            m2 = _mm_sha256msg2_epu32 (_mm_add_epi32 (m2, _mm_alignr_epi8 (m1, m0, 4)), m1);
+        }
+
+        inline void schedule_b (__m128i &m0, __m128i m1, __m128i &m2) {
+            schedule_c (m0, m1, m2);
+            schedule_a (m0, m1);
+        }
+
+        // load a big-endian message block.
+        inline __m128i load (const unsigned char *b) {
+            const __m128i mask = _mm_set_epi64x (0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+            return _mm_shuffle_epi8 (_mm_loadu_si128 (reinterpret_cast<const __m128i *> (b)), mask);
+        }
+    }
+
+    void transform_x86_shani (std::uint32_t *s, const unsigned char *blocks, std::size_t count) {
+        // the instructions want the state as ABEF and CDGH.
+        __m128i abcd = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (s));
+        __m128i efgh = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (s + 4));
+        __m128i t1 = _mm_shuffle_epi32 (abcd, 0xb1);
+        __m128i t2 = _mm_shuffle_epi32 (efgh, 0x1b);
+        __m128i abef = _mm_alignr_epi8 (t1, t2, 8);
+        __m128i cdgh = _mm_blend_epi16 (t2, t1, 0xf0);
+
+        for (; count > 0; count--, blocks += 64) {
+            __m128i abef_saved = abef;
+            __m128i cdgh_saved = cdgh;
+
+            __m128i m0 = load (blocks);
+            quad_round (abef, cdgh, m0, 0);
+            __m128i m1 = load (blocks + 16);
+            quad_round (abef, cdgh, m1, 1);
+            schedule_a (m0, m1);
+            __m128i m2 = load (blocks + 32);
+            quad_round (abef, cdgh, m2, 2);
+            schedule_a (m1, m2);
+            __m128i m3 = load (blocks + 48);
+            quad_round (abef, cdgh, m3, 3);
+            schedule_b (m2, m3, m0);
+            quad_round (abef, cdgh, m0, 4);
+            schedule_b (m3, m0, m1);
+            quad_round (abef, cdgh, m1, 5);
+            schedule_b (m0, m1, m2);
+            quad_round (abef, cdgh, m2, 6);
+            schedule_b (m1, m2, m3);
+            quad_round (abef, cdgh, m3, 7);
+            schedule_b (m2, m3, m0);
+            quad_round (abef, cdgh, m0, 8);
+            schedule_b (m3, m0, m1);
+            quad_round (abef, cdgh, m1, 9);
+            schedule_b (m0, m1, m2);
+            quad_round (abef, cdgh, m2, 10);
+            schedule_b (m1, m2, m3);
+            quad_round (abef, cdgh, m3, 11);
+            schedule_b (m2, m3, m0);
+            quad_round (abef, cdgh, m0, 12);
+            schedule_b (m3, m0, m1);
+            quad_round (abef, cdgh, m1, 13);
+            schedule_c (m0, m1, m2);
+            quad_round (abef, cdgh, m2, 14);
+            schedule_c (m1, m2, m3);
+            quad_round (abef, cdgh, m3, 15);
+
+            abef = _mm_add_epi32 (abef, abef_saved);
+            cdgh = _mm_add_epi32 (cdgh, cdgh_saved);
+        }
+
+        t1 = _mm_shuffle_epi32 (abef, 0x1b);
+        t2 = _mm_shuffle_epi32 (cdgh, 0xb1);
+        _mm_storeu_si128 (reinterpret_cast<__m128i *> (s), _mm_blend_epi16 (t1, t2, 0xf0));
+        _mm_storeu_si128 (reinterpret_cast<__m128i *> (s + 4), _mm_alignr_epi8 (t2, t1, 8));
+    }
+
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+// SHA-256 on four messages at once with SSE4.1. This file is compiled with
+// -msse4.1 and is only used if the processor supports it.
+
+#include "lanes.hpp"
+#include <immintrin.h>
+
+namespace Gigamonkey::sha256 {
+
+    namespace {
+
+        struct sse41 {
+            using word = __m128i;
+            constexpr static int Lanes = 4;
+
+            static word inline load (const std::uint32_t *x) {
+                return _mm_load_si128 (reinterpret_cast<const __m128i *> (x));
+            }
+
+            static void inline store (std::uint32_t *x, word w) {
+                _mm_store_si128 (reinterpret_cast<__m128i *> (x), w);
+            }
+
+            static word inline set1 (std::uint32_t x) {
+                return _mm_set1_epi32 (x);
+            }
+
+            static word inline add (word a, word b) {
+                return _mm_add_epi32 (a, b);
+            }
+
+            template <int n> static word inline shr (word x) {
+                return _mm_srli_epi32 (x, n);
+            }
+
+            template <int n> static word inline rotr (word x) {
+                return _mm_or_si128 (_mm_srli_epi32 (x, n), _mm_slli_epi32 (x, 32 - n));
+            }
+
+            static word inline xor3 (word a, word b, word c) {
+                return _mm_xor_si128 (_mm_xor_si128 (a, b), c);
+            }
+
+            static word inline choose (word e, word f, word g) {
+                return _mm_xor_si128 (g, _mm_and_si128 (e, _mm_xor_si128 (f, g)));
+            }
+
+            static word inline majority (word a, word b, word c) {
+                return _mm_or_si128 (_mm_and_si128 (a, b), _mm_and_si128 (c, _mm_or_si128 (a, b)));
+            }
+        };
+
+    }
+
+    void transform_x86_sse41 (std::uint32_t *states, const unsigned char *const *blocks, std::size_t count) {
+        lanes::rounds<sse41>::transform (states, blocks, count);
+    }
+
+}
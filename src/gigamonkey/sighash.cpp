@@ -6,10 +6,19 @@
 
 namespace Gigamonkey::Bitcoin::sighash {
     
-    bytes remove_code_separators (program p) {
-        program r;
-        for (const instruction &i : p) if (i.Op != OP_CODESEPARATOR) r = r << i;
-        return compile (r);
+    bytes remove_code_separators (const flat_program &p) {
+        size_t separators = 0;
+        for (size_t i = 0; i < p.size (); i++) if (p.op_code (i) == OP_CODESEPARATOR) separators++;
+        if (separators == 0) return compile (p);
+
+        bytes r (p.script ().size () - separators);
+        auto it = r.begin ();
+        for (size_t i = 0; i < p.size (); i++) if (p.op_code (i) != OP_CODESEPARATOR) {
+            slice<const byte> code = p.code (i);
+            it = std::copy (code.begin (), code.end (), it);
+        }
+
+        return r;
     }
     
     transaction reconstruct (const document &doc, sighash::directive d) {
@@ -23,11 +32,14 @@ namespace Gigamonkey::Bitcoin::sighash {
         else for (int i = 0; i < doc.Transaction.Inputs.size (); i++)
             in <<= input {doc.Transaction.Inputs[i].Reference,
                 i == doc.InputIndex ? remove_code_separators (doc.ScriptCode) : bytes {},
-                base (d) == sighash::all || i == doc.InputIndex ? doc.Transaction.Inputs[i].Sequence : uint32_little {0}};
+                (base (d) != sighash::none && base (d) != sighash::single) || i == doc.InputIndex ?
+                    doc.Transaction.Inputs[i].Sequence : uint32_little {0}};
         
-        if (sighash::base (d) == sighash::single)
-            out <<= doc.Transaction.Outputs[doc.InputIndex]; 
-        else if (sighash::base (d) == sighash::all)
+        // outputs before the one that is signed are replaced with blank outputs.
+        if (sighash::base (d) == sighash::single) {
+            for (int i = 0; i < doc.InputIndex; i++) out <<= output {};
+            out <<= doc.Transaction.Outputs[doc.InputIndex];
+        } else if (sighash::base (d) != sighash::none)
             for (const output &o : doc.Transaction.Outputs)
                 out <<= o;
         
@@ -35,10 +47,73 @@ namespace Gigamonkey::Bitcoin::sighash {
         
     }
 
+    writer &write_original (writer &w, const document &doc, sighash::directive d) {
+        const incomplete::transaction &tx = doc.Transaction;
+        bytes script_code = remove_code_separators (doc.ScriptCode);
+
+        // any type other than none or single is treated as all.
+        bool sign_all = sighash::base (d) != sighash::none && sighash::base (d) != sighash::single;
+
+        w << tx.Version;
+
+        if (sighash::is_anyone_can_pay (d)) {
+            const incomplete::input &in = tx.Inputs[doc.InputIndex];
+            var_int::write (w, 1) << in.Reference << var_string {script_code} << in.Sequence;
+        } else {
+            var_int::write (w, tx.Inputs.size ());
+            index i = 0;
+            for (const incomplete::input &in : tx.Inputs) {
+                w << in.Reference;
+                if (i == doc.InputIndex) w << var_string {script_code};
+                else var_int::write (w, 0);
+                w << (sign_all || i == doc.InputIndex ? in.Sequence : uint32_little {0});
+                i++;
+            }
+        }
+
+        if (sighash::base (d) == sighash::single) {
+            var_int::write (w, doc.InputIndex + 1);
+            for (index i = 0; i < doc.InputIndex; i++) w << output {};
+            w << tx.Outputs[doc.InputIndex];
+        } else if (sign_all) {
+            var_int::write (w, tx.Outputs.size ());
+            for (const output &o : tx.Outputs) w << o;
+        } else var_int::write (w, 0);
+
+        return w << tx.LockTime << uint32_little {d};
+    }
+
+    precomputed::precomputed (const incomplete::transaction &tx) :
+        HashPrevouts {Amaury::hash_prevouts (tx)},
+        HashSequence {Amaury::hash_sequence (tx)},
+        HashOutputs {Amaury::hash_outputs (tx)}, HashOutput {} {
+        HashOutput.reserve (tx.Outputs.size ());
+        for (const output &o : tx.Outputs) HashOutput.push_back (Hash256 (bytes (o)));
+    }
+
     writer &Amaury::write (writer &w, const document &doc, sighash::directive d) {
 
         if (!sighash::has_fork_id (d)) return write_original (w, doc, d & ~sighash::fork_id);
 
+        if (doc.Precomputed != nullptr) {
+            const precomputed &p = *doc.Precomputed;
+            return w << doc.Transaction.Version
+                << (!sighash::is_anyone_can_pay (d) ? p.HashPrevouts : incomplete::transaction::cached::zero ())
+                << (!sighash::is_anyone_can_pay (d) &&
+                    (sighash::base (d) != sighash::single) &&
+                    (sighash::base (d) != sighash::none) ?
+                    p.HashSequence : incomplete::transaction::cached::zero ())
+                << doc.Transaction.Inputs[doc.InputIndex].Reference
+                << var_string {compile (doc.ScriptCode)}
+                << doc.RedeemedValue
+                << doc.Transaction.Inputs[doc.InputIndex].Sequence
+                << (sighash::base (d) == sighash::all ? p.HashOutputs :
+                    sighash::base (d) == sighash::single && doc.InputIndex < p.HashOutput.size () ?
+                        p.HashOutput[doc.InputIndex] : incomplete::transaction::cached::zero ())
+                << doc.Transaction.LockTime
+                << uint32_little {d};
+        }
+
         // Version
         return w << doc.Transaction.Version
 
@@ -63,7 +138,7 @@ namespace Gigamonkey::Bitcoin::sighash {
             // Outputs (none/one/all, depending on flags)
             << (sighash::base (d) == sighash::all ?
                 doc.Transaction.hash_outputs ():
-                ((sighash::base (d) == sighash::single) && (doc.InputIndex < doc.Transaction.Inputs.size ())) ?
+                ((sighash::base (d) == sighash::single) && (doc.InputIndex < doc.Transaction.Outputs.size ())) ?
                     Hash256 (bytes (doc.Transaction.Outputs[doc.InputIndex])):
                     incomplete::transaction::cached::zero ())
             // Locktime
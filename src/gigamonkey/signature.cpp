@@ -7,10 +7,9 @@ namespace Gigamonkey::Bitcoin {
     
     digest256 signature::hash (const sighash::document &doc, sighash::directive d) {
         if (!doc.valid () || (sighash::base (d) == sighash::single && doc.InputIndex >= doc.Transaction.Outputs.size ())) return {};
-        //Hash256_writer w;
-        data::lazy_bytes_writer w;
+        Hash256_writer w;
         sighash::write (w, doc, d);
-        return Hash256 (w.complete ());
+        return w.complete ();
     }
 
 }
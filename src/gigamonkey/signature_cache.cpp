@@ -0,0 +1,21 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/signature_cache.hpp>
+
+namespace Gigamonkey::Bitcoin {
+
+    digest256 signature_cache::key (const digest256 &sighash, slice<const byte> pubkey, slice<const byte> sig) const {
+        SHA_2_256_writer w;
+        // both are prefixed by their lengths so that no other
+        // split of the same bytes gives the same key.
+        w << Salt << sighash << uint64_little {pubkey.size ()} << pubkey << uint64_little {sig.size ()} << sig;
+        return w.complete ();
+    }
+
+    signature_cache &signature_cache::global () {
+        static signature_cache cache {};
+        return cache;
+    }
+
+}
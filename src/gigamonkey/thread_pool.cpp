@@ -0,0 +1,97 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/thread_pool.hpp>
+#include <algorithm>
+
+namespace Gigamonkey {
+
+    thread_pool::thread_pool (uint32 workers) : Mutex {}, Wake {}, Waiting {}, Workers {}, Stop {false} {
+        if (workers == 0) workers = std::max (std::thread::hardware_concurrency (), 1u) - 1;
+        Workers.reserve (workers);
+        for (uint32 i = 0; i < workers; i++) Workers.emplace_back ([this] () {
+            work ();
+        });
+    }
+
+    thread_pool::~thread_pool () {
+        {
+            std::lock_guard<std::mutex> lock {Mutex};
+            Stop = true;
+        }
+
+        Wake.notify_all ();
+        for (std::thread &t : Workers) t.join ();
+    }
+
+    void thread_pool::work () {
+        std::unique_lock<std::mutex> lock {Mutex};
+        while (true) {
+            Wake.wait (lock, [this] () {
+                return Stop || !Waiting.empty ();
+            });
+
+            if (Waiting.empty ()) return;
+
+            job *j = Waiting.front ();
+            Waiting.pop_front ();
+            lock.unlock ();
+
+            std::exception_ptr error {};
+            try {
+                (*j->Work) ();
+            } catch (...) {
+                error = std::current_exception ();
+            }
+
+            lock.lock ();
+            if (error && !j->Error) j->Error = error;
+            if (--j->Remaining == 0) j->Done.notify_one ();
+        }
+    }
+
+    void thread_pool::run (const std::function<void ()> &work, uint32 threads) {
+        if (threads == 0 || threads > size ()) threads = size ();
+
+        uint32 given = threads - 1;
+        job j {&work, given, {}, {}};
+        if (given > 0) {
+            {
+                std::lock_guard<std::mutex> lock {Mutex};
+                for (uint32 i = 0; i < given; i++) Waiting.push_back (&j);
+            }
+
+            if (given == 1) Wake.notify_one ();
+            else Wake.notify_all ();
+        }
+
+        std::exception_ptr error {};
+        try {
+            work ();
+        } catch (...) {
+            error = std::current_exception ();
+        }
+
+        std::unique_lock<std::mutex> lock {Mutex};
+
+        // whatever the workers have not picked up is done already.
+        auto dropped = std::remove (Waiting.begin (), Waiting.end (), &j);
+        j.Remaining -= Waiting.end () - dropped;
+        Waiting.erase (dropped, Waiting.end ());
+
+        j.Done.wait (lock, [&j] () {
+            return j.Remaining == 0;
+        });
+
+        if (!error) error = j.Error;
+        lock.unlock ();
+
+        if (error) std::rethrow_exception (error);
+    }
+
+    thread_pool &thread_pool::global () {
+        static thread_pool pool {};
+        return pool;
+    }
+
+}
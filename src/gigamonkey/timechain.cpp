@@ -54,7 +54,7 @@ namespace Gigamonkey::Bitcoin {
     }
     
     bool input::valid () const {
-        return decompile (Script) != program {};
+        return Script.size () > 0 && well_formed (Script);
     }
     
     bool output::valid () const {
@@ -275,14 +275,10 @@ namespace Gigamonkey::Bitcoin {
     }
 
     uint64 transaction::sigops () const {
-        uint64 sigops {0};
-        for (const auto &in : Inputs) for (const byte &op : in.Script)
-            if (op == OP_CHECKSIG || op == OP_CHECKSIGVERIFY) sigops++;
-            else if (op == OP_CHECKMULTISIG || op == OP_CHECKMULTISIGVERIFY) sigops += 20;
-        for (const auto &out : Outputs) for (const byte &op : out.Script)
-            if (op == OP_CHECKSIG || op == OP_CHECKSIGVERIFY) sigops++;
-            else if (op == OP_CHECKMULTISIG || op == OP_CHECKMULTISIGVERIFY) sigops += 20;
-        return 0;
+        uint64 total {0};
+        for (const auto &in : Inputs) total += Bitcoin::sigops (in.Script);
+        for (const auto &out : Outputs) total += Bitcoin::sigops (out.Script);
+        return total;
     }
 
     Bitcoin::TXID outpoint::digest (slice x) {
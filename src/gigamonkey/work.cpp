@@ -16,16 +16,22 @@ namespace Gigamonkey::work {
         
         proof pr {p, initial};
         
-        while (!pr.valid ()) {
-            pr.Solution.Share.Nonce++;
-            if (pr.Solution.Share.Nonce == 0) {
-                if (pr.Solution.Share.ExtraNonce2[-1] == 0xff)
-                    throw std::logic_error {"we don't know how to increment extra_nonce_2"};
-                ++pr.Solution.Share.ExtraNonce2[-1];
-            }
+        while (true) {
+            // only the nonce changes in the inner loop, so the first
+            // 64 bytes of the header are hashed once per extra nonce.
+            string x = pr.string ();
+            std::array<uint32, 8> midstate = x.midstate ();
+            
+            do {
+                x.Nonce = pr.Solution.Share.Nonce;
+                if (x.hash (midstate) < target) return pr;
+                pr.Solution.Share.Nonce++;
+            } while (pr.Solution.Share.Nonce != 0);
+            
+            if (pr.Solution.Share.ExtraNonce2[-1] == 0xff)
+                throw std::logic_error {"we don't know how to increment extra_nonce_2"};
+            ++pr.Solution.Share.ExtraNonce2[-1];
         }
-        
-        return pr;
     }
     
     // copied from arith_uint256.cpp and therefore probably works. 
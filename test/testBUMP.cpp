@@ -2,6 +2,7 @@
 // Distributed under the Open BSV software license, see the accompanying file LICENSE.
 
 #include <gigamonkey/merkle/BUMP.hpp>
+#include <gigamonkey/merkle/server.hpp>
 #include "gtest/gtest.h"
 
 namespace Gigamonkey::Merkle {
@@ -206,6 +207,77 @@ namespace Gigamonkey::Merkle {
 
         EXPECT_EQ (expected_merkle_root, from_paths.root ());
 
+        // several BUMPs at once.
+        std::vector<BUMP> bumps {from_bytes, BUMP {}, from_paths};
+        std::vector<digest> roots = BUMP::roots (bumps);
+        EXPECT_EQ (roots.size (), 3);
+        EXPECT_EQ (roots[0], expected_merkle_root);
+        EXPECT_EQ (roots[1], digest {});
+        EXPECT_EQ (roots[2], expected_merkle_root);
+
+    }
+
+    TEST (BUMPTest, TestServerProve) {
+        leaf_digests leaves {};
+
+        for (int width = 1; width <= 40; width++) {
+            leaves <<= Bitcoin::Hash256 (std::to_string (width - 1));
+            server Server {leaves};
+            std::vector<digest> all {};
+            for (const digest &d : leaves) all.push_back (d);
+
+            for (int step : {1, 2, 3, 7, width}) {
+                // every step-th leaf and the last one.
+                std::vector<digest> chosen {};
+                for (int i = 0; i < width; i += step) chosen.push_back (all[i]);
+                chosen.push_back (all[width - 1]);
+
+                BUMP proofs = Server.prove (800000, chosen);
+                EXPECT_TRUE (proofs.valid ());
+                EXPECT_TRUE (proofs.validate (Server.root ())) << "width " << width << " step " << step;
+
+                map expected {};
+                uint64 separate = 0;
+                for (const digest &d : chosen) if (!expected.contains (d)) {
+                    proof p = Server[d];
+                    expected = expected.insert (d, path (p.Branch));
+                    separate += BUMP {800000, p.Branch}.serialized_size ();
+                }
+
+                EXPECT_EQ (proofs.paths (), expected) << "width " << width << " step " << step;
+                EXPECT_LE (proofs.serialized_size (), separate);
+            }
+
+            EXPECT_FALSE (Server.prove (800000, std::vector<digest> {Bitcoin::Hash256 (std::string {"Z"})}).valid ());
+        }
+
+        // txids that share their first bytes, as if they had been ground to
+        // collide in the hash table, can all still be found.
+        leaf_digests ground {};
+        std::vector<digest> ground_vector {};
+        for (uint32 i = 0; i < (1 << 14); i++) {
+            digest d {};
+            for (int k = 0; k < 4; k++) d.data ()[8 + k] = byte (i >> (8 * k));
+            ground <<= d;
+            ground_vector.push_back (d);
+        }
+
+        server Ground {ground};
+        for (uint32 i = 0; i < ground_vector.size (); i += 97) {
+            proof p = Ground[ground_vector[i]];
+            EXPECT_TRUE (p.valid ());
+            EXPECT_EQ (p.Branch.Leaf.Index, i);
+        }
+
+        EXPECT_TRUE (Ground.prove (800000, ground_vector).validate (Ground.root ()));
+
+        // with one transaction, the BUMP has one level with only the client transaction.
+        server One {leaf_digests {Bitcoin::Hash256 (std::string {"0"})}};
+        BUMP single = One.prove (800000, std::vector<digest> {Bitcoin::Hash256 (std::string {"0"})});
+        EXPECT_EQ (single, (BUMP {800000, BUMP::nodes {ordst<BUMP::node> {
+            BUMP::node {0, BUMP::flag::client, Bitcoin::Hash256 (std::string {"0"})}}}}));
+        EXPECT_EQ (single.root (), One.root ());
+        EXPECT_EQ (BUMP {bytes (single)}, single);
     }
 
 }
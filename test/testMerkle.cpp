@@ -5,6 +5,7 @@
 #include <gigamonkey/merkle/dual.hpp>
 #include <gigamonkey/merkle/server.hpp>
 #include <gigamonkey/merkle/serialize.hpp>
+#include <gigamonkey/merkle/flat.hpp>
 #include "gtest/gtest.h"
 
 namespace Gigamonkey::Merkle {
@@ -97,6 +98,189 @@ namespace Gigamonkey::Merkle {
         }
     }
     
+    namespace {
+        // the levels of a Merkle tree hashed one pair at a time, to
+        // check the batched and threaded construction in the library.
+        std::vector<std::vector<digest>> reference_levels (const std::vector<digest> &leaves) {
+            std::vector<std::vector<digest>> levels {leaves};
+            while (levels.back ().size () > 1) {
+                const std::vector<digest> &last = levels.back ();
+                std::vector<digest> next {};
+                for (size_t i = 0; i < last.size (); i += 2) {
+                    const digest &right = i + 1 < last.size () ? last[i + 1] : last[i];
+                    bytes pair (64);
+                    std::copy (last[i].begin (), last[i].end (), pair.begin ());
+                    std::copy (right.begin (), right.end (), pair.begin () + 32);
+                    next.push_back (Bitcoin::Hash256 (pair));
+                }
+
+                levels.push_back (std::move (next));
+            }
+
+            return levels;
+        }
+
+        // the path of leaf i must list its sibling at each level of the reference.
+        void expect_reference_path (const std::vector<std::vector<digest>> &levels, const Merkle::path &p, size_t i) {
+            EXPECT_EQ (p.Index, i);
+            digests d = p.Digests;
+            for (size_t h = 0; h + 1 < levels.size (); h++, i >>= 1) {
+                ASSERT_GT (d.size (), 0u);
+                size_t sibling = i & 1 ? i - 1 : i + 1 < levels[h].size () ? i + 1 : i;
+                EXPECT_EQ (bool (first (d)) ? *first (d) : levels[h][i], levels[h][sibling]);
+                d = rest (d);
+            }
+
+            EXPECT_EQ (d.size (), 0u);
+        }
+    }
+
+    TEST (MerkleTest, TestFlatTree) {
+        EXPECT_FALSE (flat_tree {}.valid ());
+        EXPECT_EQ (flat_tree {leaf_digests {}}, flat_tree {});
+
+        leaf_digests leaves {};
+        std::vector<digest> leaf_vector {};
+        for (int i = 1; i <= 40; i++) {
+            leaves <<= Bitcoin::Hash256 (std::to_string (i));
+            leaf_vector.push_back (Bitcoin::Hash256 (std::to_string (i)));
+
+            auto reference = reference_levels (leaf_vector);
+
+            flat_tree Flat {leaves};
+            EXPECT_TRUE (Flat.valid ());
+            EXPECT_EQ (Flat.width (), uint32 (i));
+            EXPECT_EQ (Flat.Levels, reference);
+            EXPECT_EQ (Flat.root (), reference.back ()[0]);
+            EXPECT_EQ (root (leaves), reference.back ()[0]);
+            for (uint32 j = 0; j < i; j++) expect_reference_path (reference, Flat.path (j), j);
+
+            tree Tree {leaves};
+            server Server {leaves};
+            dual Dual {Tree};
+
+            EXPECT_EQ (Flat.height (), Tree.Height);
+            EXPECT_EQ (Flat.proofs (), Tree.proofs ());
+            for (uint32 j = 0; j < i; j++) EXPECT_EQ (Flat[j], Server[Flat.Levels[0][j]]);
+            EXPECT_FALSE (Flat[i].valid ());
+
+            EXPECT_EQ (tree (Flat), Tree);
+            EXPECT_EQ (server (Flat), Server);
+            EXPECT_EQ (dual (Flat), Dual);
+
+            EXPECT_EQ (flat_tree {Tree}, Flat);
+            EXPECT_EQ (flat_tree {Server}, Flat);
+            EXPECT_EQ (flat_tree {Dual}, Flat);
+
+            flat_tree Broken = Flat;
+            Broken.Levels[0][i / 2] = Bitcoin::Hash256 ("Z");
+            EXPECT_FALSE (Broken.valid ());
+        }
+
+        // a dual without every leaf.
+        dual Partial {flat_tree {leaves}[3]};
+        EXPECT_EQ (flat_tree {Partial}, flat_tree {});
+
+        // big enough that the levels are split up among threads.
+        std::vector<digest> many {};
+        leaf_digests many_list {};
+        for (int i = 0; i < 20000; i++) {
+            many.push_back (Bitcoin::Hash256 (std::to_string (i)));
+            many_list <<= many.back ();
+        }
+
+        auto many_reference = reference_levels (many);
+
+        flat_tree OneThread {many, 1};
+        flat_tree FourThreads {many, 4};
+        EXPECT_EQ (OneThread.Levels, many_reference);
+        EXPECT_EQ (FourThreads.Levels, many_reference);
+        EXPECT_TRUE (FourThreads.valid ());
+        EXPECT_EQ (root (many_list), many_reference.back ()[0]);
+        for (uint32 j : {0, 4095, 4096, 12345, 19999}) expect_reference_path (many_reference, FourThreads.path (j), j);
+    }
+
+    // a tree that is changed one leaf at a time is the same as one built all at once.
+    TEST (MerkleTest, TestFlatTreeIncremental) {
+        flat_tree Incremental {};
+        std::vector<digest> leaves {};
+
+        EXPECT_THROW (Incremental.remove_last (), std::out_of_range);
+        EXPECT_THROW (Incremental.replace (0, digest {}), std::out_of_range);
+        EXPECT_THROW (Incremental.path (0), std::out_of_range);
+
+        auto check = [&] () {
+            flat_tree Built {leaves, 1};
+            EXPECT_EQ (Incremental, Built);
+            if (leaves.size () == 0) return;
+
+            // the coinbase path with the root that it derives.
+            Merkle::path coinbase = Incremental.path (0);
+            EXPECT_EQ (coinbase.Index, 0u);
+            EXPECT_EQ (coinbase.derive_root (leaves[0]), Built.root ());
+
+            // the path is the same whatever the coinbase is.
+            std::vector<digest> other = leaves;
+            other[0] = Bitcoin::Hash256 ("coinbase");
+            EXPECT_EQ (coinbase.derive_root (other[0]), flat_tree {other, 1}.root ());
+        };
+
+        for (int i = 0; i < 40; i++) {
+            leaves.push_back (Bitcoin::Hash256 (std::to_string (i)));
+            Incremental.append (leaves.back ());
+            check ();
+        }
+
+        EXPECT_THROW (Incremental.path (40), std::out_of_range);
+        EXPECT_NO_THROW (Incremental.path (39));
+
+        for (uint32 i : {0, 7, 39, 16}) {
+            leaves[i] = Bitcoin::Hash256 ("replaced " + std::to_string (i));
+            Incremental.replace (i, leaves[i]);
+            check ();
+        }
+
+        EXPECT_THROW (Incremental.replace (40, digest {}), std::out_of_range);
+
+        while (leaves.size () > 0) {
+            leaves.pop_back ();
+            Incremental.remove_last ();
+            check ();
+        }
+
+        EXPECT_EQ (Incremental, flat_tree {});
+    }
+
+    // branches that go through the same nodes are checked together.
+    TEST (MerkleTest, TestFailed) {
+        EXPECT_EQ (failed (std::vector<branch> {}, digest {}).size (), 0);
+
+        leaf_digests leaves {};
+        for (int i = 1; i <= 40; i++) {
+            leaves <<= Bitcoin::Hash256 (std::to_string (i));
+            flat_tree Flat {leaves};
+
+            std::vector<branch> branches {};
+            for (uint32 j = 0; j < i; j++) branches.push_back (Flat[j].Branch);
+            // the same branch twice.
+            branches.push_back (Flat[0].Branch);
+
+            EXPECT_EQ (failed (branches, Flat.root ()).size (), 0);
+            EXPECT_EQ (failed (branches, Bitcoin::Hash256 ("Z")).size (), branches.size ());
+
+            branches[i / 2].Leaf.Digest = Bitcoin::Hash256 ("Z");
+            branches[i].Leaf.Digest = Bitcoin::Hash256 ("Y");
+            list<uint32> expected {};
+            expected <<= uint32 (i / 2);
+            expected <<= uint32 (i);
+            EXPECT_EQ (failed (branches, Flat.root ()), expected);
+
+            // the proofs in a dual are checked the same way.
+            EXPECT_TRUE (dual (Flat).valid ());
+            EXPECT_FALSE (dual (dual (Flat).Paths, Bitcoin::Hash256 ("Z")).valid ());
+        }
+    }
+
     // This test comes from 
     // https://tsc.bitcoinassociation.net/standards/merkle-proof-standardised-format/
     // and is not very good but it's better than nothing. 
@@ -628,5 +628,30 @@ namespace Gigamonkey::Bitcoin {
         EXPECT_EQ (integer {-10} % integer {-3}, integer {-1});
     }
 
-}
+    TEST (Number, Int64) {
+        std::array<byte, 9> buffer;
+        for (int64 i : {int64 (0), int64 (1), int64 (-1), int64 (127), int64 (-127), int64 (128), int64 (-128),
+            int64 (255), int64 (-255), int64 (256), int64 (32767), int64 (-32768), int64 (2147483647), int64 (-2147483648),
+            int64 (9223372036854775807), -int64 (9223372036854775807), std::numeric_limits<int64>::min ()}) {
+            integer n {i};
+            EXPECT_EQ (bytes (write_int64 (i, buffer)), bytes (n)) << i;
+            EXPECT_TRUE (is_minimal_number (write_int64 (i, buffer))) << i;
+
+            int64 x;
+            if (n.size () <= 8) {
+                EXPECT_TRUE (read_int64 (n, x)) << i;
+                EXPECT_EQ (x, i);
+            } else EXPECT_FALSE (read_int64 (n, x)) << i;
+        }
 
+        // numbers that are not minimal can still be read.
+        int64 x;
+        EXPECT_TRUE (read_int64 (bytes {0x01, 0x00}, x));
+        EXPECT_EQ (x, 1);
+        EXPECT_TRUE (read_int64 (bytes {0x01, 0x80}, x));
+        EXPECT_EQ (x, -1);
+        EXPECT_TRUE (read_int64 (bytes {0x80}, x));
+        EXPECT_EQ (x, 0);
+    }
+
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2024 Daniel Krawisz
+// Distributed under the Open BSV software license, see the accompanying file LICENSE.
+
+#include <gigamonkey/hash.hpp>
+#include <data/encoding/hex.hpp>
+#include "gtest/gtest.h"
+#include <random>
+
+namespace Gigamonkey {
+
+    const std::vector<sha256::implementation> &sha256_implementations () {
+        static std::vector<sha256::implementation> x {
+            sha256::implementation::reference,
+            sha256::implementation::x86_shani,
+            sha256::implementation::arm_shani};
+        return x;
+    }
+
+    TEST (SHA256Test, TestVectors) {
+        std::vector<std::pair<std::string, std::string>> vectors {
+            {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+            {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+                "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"}};
+
+        std::string million (1000000, 'a');
+
+        for (sha256::implementation x : sha256_implementations ()) {
+            if (!sha256::available (x)) continue;
+            sha256::select (x);
+            EXPECT_EQ (sha256::active (), x);
+
+            for (const auto &[in, out] : vectors)
+                EXPECT_EQ (bytes (slice<const byte> (SHA2_256 (in))), *encoding::hex::read (out)) << "with " << x;
+
+            EXPECT_EQ (bytes (slice<const byte> (SHA2_256 (million))),
+                *encoding::hex::read ("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0")) << "with " << x;
+        }
+
+        sha256::reset ();
+    }
+
+    // every implementation gives the same result as crypto++ for
+    // every length of input and however the input is divided up.
+    TEST (SHA256Test, TestImplementations) {
+        EXPECT_TRUE (sha256::available (sha256::implementation::reference));
+
+        std::default_random_engine engine {5};
+        std::uniform_int_distribution<int> random_byte {0, 255};
+
+        for (sha256::implementation x : sha256_implementations ()) {
+            if (!sha256::available (x)) {
+                EXPECT_THROW (sha256::select (x), std::invalid_argument);
+                continue;
+            }
+
+            sha256::select (x);
+            for (size_t size = 0; size < 300; size++) {
+                bytes b (size);
+                for (byte &z : b) z = byte (random_byte (engine));
+
+                digest256 expected = crypto::SHA2_256 (b);
+                EXPECT_EQ (SHA2_256 (b), expected) << "size " << size << " with " << x;
+                EXPECT_EQ (double_SHA2_256 (b), crypto::SHA2_256 (expected)) << "size " << size << " with " << x;
+
+                sha256::state s {};
+                size_t written = 0;
+                while (written < size) {
+                    size_t next = std::min (size - written, size_t (random_byte (engine) % 70));
+                    s.update (slice<const byte> {b.data () + written, next});
+                    written += next;
+                }
+
+                EXPECT_EQ (s.complete (), expected) << "size " << size << " in pieces with " << x;
+            }
+        }
+
+        sha256::reset ();
+    }
+
+    // the kernels for Merkle nodes and block headers.
+    TEST (SHA256Test, TestFixedSizes) {
+        std::default_random_engine engine {11};
+        std::uniform_int_distribution<int> random_byte {0, 255};
+
+        for (sha256::implementation x : sha256_implementations ()) {
+            if (!sha256::available (x)) continue;
+            sha256::select (x);
+
+            for (int i = 0; i < 50; i++) {
+                bytes b (80);
+                for (byte &z : b) z = byte (random_byte (engine));
+
+                EXPECT_EQ (sha256::double_hash_64 (b.data ()), crypto::SHA2_256 (crypto::SHA2_256 (slice<const byte> {b.data (), 64}))) << "with " << x;
+                EXPECT_EQ (sha256::double_hash_80 (b.data ()), crypto::SHA2_256 (crypto::SHA2_256 (b))) << "with " << x;
+
+                // the midstate does not depend on the last 16 bytes.
+                std::array<uint32, 8> midstate = sha256::midstate_80 (b.data ());
+                b[76] ^= 1;
+                EXPECT_EQ (sha256::double_hash_80 (midstate, b.data () + 64), crypto::SHA2_256 (crypto::SHA2_256 (b))) << "with " << x;
+            }
+        }
+
+        sha256::reset ();
+    }
+
+    // batches give the same results as hashing one message at a
+    // time, whether or not the messages have the same length.
+    TEST (SHA256Test, TestBatch) {
+        std::default_random_engine engine {7};
+        std::uniform_int_distribution<int> random_byte {0, 255};
+
+        std::vector<sha256::implementation> batch_implementations {
+            sha256::implementation::reference,
+            sha256::implementation::x86_shani,
+            sha256::implementation::arm_shani,
+            sha256::implementation::x86_sse41,
+            sha256::implementation::x86_avx2,
+            sha256::implementation::x86_avx512};
+
+        for (sha256::implementation x : batch_implementations) {
+            if (!sha256::available (x)) {
+                EXPECT_THROW (sha256::select_batch (x), std::invalid_argument);
+                continue;
+            }
+
+            if (sha256::lanes (x) > 1) EXPECT_THROW (sha256::select (x), std::invalid_argument);
+
+            sha256::select_batch (x);
+            EXPECT_EQ (sha256::active_batch (), x);
+            EXPECT_EQ (sha256::lanes (), sha256::lanes (x));
+
+            for (size_t size : {0, 1, 32, 55, 56, 63, 64, 80, 119, 120, 200}) for (size_t count : {1, 3, 16, 37}) {
+                std::vector<bytes> messages {};
+                for (size_t i = 0; i < count; i++) {
+                    // some messages have a different length.
+                    bytes &b = messages.emplace_back (i % 5 == 4 ? size + i : size);
+                    for (byte &z : b) z = byte (random_byte (engine));
+                }
+
+                std::vector<slice<const byte>> in {};
+                for (const bytes &b : messages) in.push_back (slice<const byte> (b));
+
+                std::vector<digest256> single (count);
+                std::vector<digest256> twice (count);
+                SHA2_256_batch (in, single);
+                Bitcoin::Hash256_batch (in, twice);
+
+                for (size_t i = 0; i < count; i++) {
+                    digest256 expected = crypto::SHA2_256 (in[i]);
+                    EXPECT_EQ (single[i], expected) << "size " << in[i].size () << " with " << x;
+                    EXPECT_EQ (twice[i], crypto::SHA2_256 (expected)) << "size " << in[i].size () << " with " << x;
+                }
+            }
+
+            std::vector<digest256> wrong_size (2);
+            std::vector<slice<const byte>> in (3);
+            EXPECT_THROW (SHA2_256_batch (in, wrong_size), std::invalid_argument);
+        }
+
+        sha256::reset ();
+    }
+
+}
@@ -70,6 +70,13 @@ namespace Gigamonkey {
         // check SPV proof
         EXPECT_TRUE (proof->validate (d)) << "proof should be valid but is not";
 
+        // the second time, every script should be found in the cache.
+        Bitcoin::script_cache cache {};
+        EXPECT_TRUE (proof->validate (d, SPV::time_limit::negative_infinity (), &cache));
+        EXPECT_EQ (cache.hits (), 0);
+        EXPECT_TRUE (proof->validate (d, SPV::time_limit::negative_infinity (), &cache));
+        EXPECT_EQ (cache.hits (), cache.misses ());
+
         // make BEEF
         BEEF beef {*proof};
 
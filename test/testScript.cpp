@@ -3,12 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
+#include <gigamonkey/script/pattern/pay_to_script_hash.hpp>
+#include <gigamonkey/script/pattern/pay_to_pubkey.hpp>
+#include <gigamonkey/script/classifier.hpp>
+#include <gigamonkey/boost/boost.hpp>
 #include <gigamonkey/script/interpreter.hpp>
+#include <gigamonkey/script/standard.hpp>
+#include <gigamonkey/script/profile.hpp>
 #include <data/crypto/NIST_DRBG.hpp>
 #include <gigamonkey/address.hpp>
 #include <data/encoding/hex.hpp>
 #include "gtest/gtest.h"
 #include <iostream>
+#include <random>
 
 namespace Gigamonkey::Bitcoin {
 
@@ -21,8 +28,20 @@ namespace Gigamonkey::Bitcoin {
             program p;
             EXPECT_NO_THROW (p = decompile (b)) << explanation;
             EXPECT_EQ (compile (p), b);
+
+            flat_program f {b};
+            EXPECT_EQ (f.size (), p.size ());
+            EXPECT_EQ (compile (f), b);
+            EXPECT_EQ (program (f), p);
+            EXPECT_TRUE (flat_program {p} == f);
+            for (size_t i = 0; i < f.size (); i++) {
+                EXPECT_EQ (f[i], first (p));
+                EXPECT_EQ (f.drop (i)[0], first (p));
+                p = rest (p);
+            }
         } else {
             EXPECT_THROW (decompile (b), invalid_program) << explanation;
+            EXPECT_THROW (flat_program {b}, invalid_program) << explanation;
         }
     }
 
@@ -55,6 +74,73 @@ namespace Gigamonkey::Bitcoin {
         // op return with data
         test_program (bytes {OP_RETURN, OP_PUSHSIZE1}, false);
         test_program (bytes {OP_FALSE, OP_RETURN, OP_PUSHSIZE1}, false);
+
+        // pushes
+        test_program (compile (program {push_data (bytes (20)), push_data (bytes (100)), push_data (bytes (300)), OP_CAT}), true);
+
+        // a range of a flat program shares its script.
+        flat_program f {compile (program {OP_DUP, push_data (bytes {1, 2, 3}), OP_CODESEPARATOR, OP_EQUAL})};
+        flat_program r = f.range (1, 3);
+        EXPECT_EQ (r.size (), 2);
+        EXPECT_EQ (r.op_code (0), OP_PUSHSIZE3);
+        EXPECT_EQ (bytes (r.push_data (0)), (bytes {1, 2, 3}));
+        EXPECT_EQ (r.op_code (1), OP_CODESEPARATOR);
+        EXPECT_EQ (r.script ().data (), f.script ().data () + 1);
+        EXPECT_EQ (compile (r), compile (program {push_data (bytes {1, 2, 3}), OP_CODESEPARATOR}));
+        EXPECT_TRUE (f.range (2, 2).empty ());
+        EXPECT_EQ (compile (remove_after_last_code_separator (f.script ())), (bytes {OP_EQUAL}));
+    }
+
+    void test_bytecode (const bytes &unlock, const bytes &lock, bool p2sh) {
+        bytecode b = full (bytecode {unlock}, bytecode {lock}, p2sh);
+        EXPECT_EQ (b.Script, compile (full (decompile (unlock), decompile (lock), p2sh)));
+        EXPECT_EQ (decompile (b), full (decompile (unlock), decompile (lock), p2sh));
+        EXPECT_EQ (compile (full (flat_program {unlock}, flat_program {lock}, p2sh)), b.Script);
+
+        // every operation must be read from where it is written.
+        program p = decompile (b);
+        EXPECT_EQ (b.size (), p.size ());
+        for (const bytecode::operation &x : b.Operations) {
+            EXPECT_EQ (instruction::read (b.code (x)), first (p));
+            p = rest (p);
+        }
+    }
+
+    TEST (ScriptTest, TestBytecode) {
+        // same errors as decompile.
+        EXPECT_THROW ((bytecode {bytes {OP_RESERVED}}), invalid_program);
+        EXPECT_THROW ((bytecode {bytes {OP_PUSHSIZE2, 0x23}}), invalid_program);
+        EXPECT_THROW ((bytecode {bytes {OP_PUSHDATA2, 0x02, 0x00, 0x12}}), invalid_program);
+        EXPECT_THROW ((bytecode {bytes {OP_ENDIF}}), invalid_program);
+
+        bytes lock {OP_DUP, OP_PUSHSIZE2, 0xab, 0xcd, OP_EQUALVERIFY, OP_IF, OP_1, OP_ELSE, OP_2, OP_ENDIF};
+        bytes unlock {OP_PUSHDATA1, 0x01, 0x00, OP_16};
+
+        test_bytecode (unlock, lock, false);
+        test_bytecode (bytes {}, lock, false);
+        test_bytecode (unlock, bytes {}, false);
+
+        bytes redeem {OP_1, OP_IF, OP_CODESEPARATOR, OP_ENDIF};
+        bytes p2sh_lock = pay_to_script_hash::script (Hash160 (redeem));
+        bytes p2sh_unlock = compile (program {instruction {OP_2}, instruction::push (redeem)});
+        test_bytecode (p2sh_unlock, p2sh_lock, true);
+
+        // jump targets of conditionals.
+        bytecode b {bytes {OP_IF, OP_IF, OP_ELSE, OP_ENDIF, OP_ELSE, OP_NOP, OP_ENDIF, OP_NOP}};
+        EXPECT_EQ (b.Operations[0].Jump, 4);
+        EXPECT_EQ (b.Operations[1].Jump, 2);
+        EXPECT_EQ (b.Operations[2].Jump, 3);
+        EXPECT_EQ (b.Operations[4].Jump, 6);
+        EXPECT_EQ (b.Operations[5].Jump, 6);
+
+        bytecode c {bytes {OP_NOP, OP_CODESEPARATOR, OP_1}};
+        bytecode::counter n {c};
+        ++n;
+        EXPECT_EQ (decompile (n.unread ()), decompile (bytes {OP_CODESEPARATOR, OP_1}));
+        ++n;
+        ++n;
+        EXPECT_TRUE (n.done ());
+        EXPECT_EQ (n.unread ().size (), 0);
     }
 
     void success (result r, string explanation = "") {
@@ -204,6 +290,70 @@ namespace Gigamonkey::Bitcoin {
         error (evaluate (bytes {OP_PUSHDATA4, 0x01, 0x00, 0x00, 0x00}, bytes {}, flag {}), "PUSHDATA4 invalid push");
     }
 
+    TEST (ScriptTest, TestScriptChecks) {
+        std::vector<bytes> scripts {
+            bytes {},
+            bytes {OP_TRUE},
+            bytes {OP_FALSE, OP_RETURN},
+            bytes {OP_RETURN},
+            bytes {OP_FALSE, OP_RETURN, OP_PUSHSIZE2, 0x01, 0x02},
+            bytes {OP_PUSHSIZE1, 0x05, OP_PUSHDATA1, 0x01, 0x01},
+            bytes {OP_PUSHDATA2, 0x02, 0x00, 0x00, 0x01},
+            bytes {OP_PUSHSIZE2, 0x01},
+            bytes {OP_PUSHDATA1, 0x02, 0x01},
+            bytes {OP_DUP, OP_HASH160, OP_RESERVED},
+            bytes {OP_1, OP_INVALIDOPCODE},
+            bytes {OP_IF, OP_1, OP_ELSE, OP_2, OP_ENDIF},
+            bytes {OP_NOTIF, OP_IF, OP_ENDIF, OP_ENDIF, OP_CHECKSIG},
+            bytes {OP_IF, OP_1},
+            bytes {OP_ENDIF},
+            bytes {OP_ELSE, OP_ENDIF},
+            bytes {OP_IF, OP_ELSE, OP_ELSE, OP_ENDIF},
+            bytes {OP_IF, OP_RETURN, OP_ENDIF},
+            bytes {OP_PUSHDATA1, 0x01, 0x01, OP_IF},
+            bytes {OP_IF, OP_ENDIF, OP_PUSHSIZE2, 0x01},
+            bytes {OP_1, OP_RETURN, OP_CHECKMULTISIG},
+            compile (program {OP_2, push_data (bytes (33)), push_data (bytes (33)), OP_2, OP_CHECKMULTISIGVERIFY}),
+            pay_to_address::script (digest160 {})};
+
+        std::vector<flag> flags {flag {}, flag::VERIFY_MINIMALDATA, flag::VERIFY_MINIMALDATA | flag::SAFE_RETURN_DATA};
+
+        for (const bytes &b : scripts) {
+            maybe<program> p;
+            ScriptError err = SCRIPT_ERR_OK;
+            try {
+                p = decompile (b);
+            } catch (const invalid_program &x) {
+                err = x.Error;
+            }
+
+            EXPECT_EQ (verify_script (b), err) << "script " << b;
+            EXPECT_EQ (well_formed (b), bool (p)) << "script " << b;
+
+            for (const flag &f : flags)
+                EXPECT_EQ (pre_verify (b, f), bool (p) ? pre_verify (*p, f) : err) << "script " << b << " with flags " << uint32 (f);
+
+            if (bool (p)) {
+                bool minimal = true;
+                for (const instruction &i : *p) minimal = minimal && is_minimal_instruction (i);
+
+                EXPECT_EQ (is_push (b), is_push (*p)) << "script " << b;
+                EXPECT_EQ (is_minimal_script (b), minimal) << "script " << b;
+            } else {
+                EXPECT_FALSE (is_push (b)) << "script " << b;
+                EXPECT_FALSE (is_minimal_script (b)) << "script " << b;
+            }
+        }
+
+        EXPECT_EQ (sigops (bytes {}), 0);
+        EXPECT_EQ (sigops (pay_to_address::script (digest160 {})), 1);
+        EXPECT_EQ (sigops (bytes {OP_1, OP_RETURN, OP_CHECKMULTISIG}), 20);
+        EXPECT_EQ (sigops (bytes {OP_CHECKSIGVERIFY, OP_CHECKMULTISIGVERIFY, OP_CHECKSIG}), 22);
+        // data that looks like OP_CHECKSIG is not counted.
+        EXPECT_EQ (sigops (bytes {OP_PUSHSIZE1, OP_CHECKSIG}), 0);
+        EXPECT_EQ (sigops (bytes {OP_CHECKSIG, OP_PUSHSIZE2, OP_CHECKSIG}), 1);
+    }
+
     TEST (ScriptTest, TestUnlockPushOnly) {
 
         success (evaluate (bytes {}, bytes {OP_TRUE}, flag {}));
@@ -486,6 +636,108 @@ namespace Gigamonkey::Bitcoin {
 
     auto test_stack_op = &test_op<int>;
 
+    // memory usage is part of consensus, so it must not depend on how elements are stored.
+    TEST (ScriptTest, TestStackMemoryUsage) {
+        limited_two_stack<true> stack {1000};
+        auto usage = [&stack] () -> uint64 {
+            uint64 u = 0;
+            for (const auto &x : stack) u += x.size () + limited_two_stack<true>::ELEMENT_OVERHEAD;
+            return u;
+        };
+
+        stack.push_back (bytes (100));
+        stack.push_back (bytes (3));
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+        stack.copy_back (-2);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+        stack.roll (-3);
+        EXPECT_EQ (stack.top ().size (), 100);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+        stack.pop_back ();
+        stack.pop_back ();
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // reuses the buffer of a larger element.
+        stack.push_back (bytes (1));
+        EXPECT_EQ (stack.top ().size (), 1);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+        stack.modify_top ([] (bytes &b) {
+            b = bytes (50);
+        });
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // too big.
+        EXPECT_THROW (stack.push_back (bytes (1000)), script_exception);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // the buffer of a large element is not given to a small one, since
+        // memory usage counts sizes and not the memory that is allocated.
+        limited_two_stack<true> big {100000};
+        for (int i = 0; i < 10; i++) {
+            big.push_back (bytes (5000));
+            big.pop_back ();
+            big.push_back (bytes (1));
+            EXPECT_LT (big.top ().capacity (), element::LARGE_ELEMENT_SIZE);
+        }
+    }
+
+    // large elements share buffers rather than copying, which
+    // must not change their contents or the memory accounting.
+    TEST (ScriptTest, TestLargeElements) {
+        bytes a (3000);
+        bytes b (2000);
+        for (size_t i = 0; i < a.size (); i++) a[i] = byte (i);
+        for (size_t i = 0; i < b.size (); i++) b[i] = byte (i * 7);
+
+        bytes ab = a;
+        ab.insert (ab.end (), b.begin (), b.end ());
+
+        limited_two_stack<true> stack {100000};
+        auto usage = [&stack] () -> uint64 {
+            uint64 u = 0;
+            for (const auto &x : stack) u += x.size () + limited_two_stack<true>::ELEMENT_OVERHEAD;
+            return u;
+        };
+
+        stack.push_back (a);
+        stack.push_back (b);
+        stack.cat ();
+        EXPECT_EQ (stack.size (), 1);
+        EXPECT_EQ (stack.top_size (), ab.size ());
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        stack.copy_back (-1);
+        stack.split (3000);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+        EXPECT_EQ (stack.top (), b);
+        EXPECT_EQ (stack.top (-2), a);
+        EXPECT_EQ (stack.top (-3), ab);
+
+        // a small part of a large element.
+        stack.pop_back ();
+        stack.substring (10, 20);
+        EXPECT_EQ (stack.top (), bytes (a.begin () + 10, a.begin () + 30));
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // a large part of a large element.
+        stack.pop_back ();
+        stack.substring (1000, 3000);
+        EXPECT_EQ (stack.top (), bytes (ab.begin () + 1000, ab.begin () + 4000));
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // a small element joined to a large one.
+        stack.push_back (bytes {1, 2, 3});
+        stack.cat ();
+        EXPECT_EQ (stack.top_size (), 3003);
+        EXPECT_EQ (stack.MemoryUsage, usage ());
+
+        // the same when the elements are pushed from a script.
+        success (evaluate (compile (program {instruction::push (a), instruction::push (b)}),
+            compile (program {OP_CAT, OP_SIZE, instruction::push (integer {5000}), OP_EQUALVERIFY,
+                instruction::push (integer {3000}), OP_SPLIT, instruction::push (b), OP_EQUALVERIFY,
+                instruction::push (a), OP_EQUAL}), script_config {}), "large cat and split");
+    }
+
     TEST (ScriptTest, TestStackOps) {
 
         test_stack_op (OP_DROP, {3}, {}, "DROP");
@@ -894,6 +1146,22 @@ namespace Gigamonkey::Bitcoin {
         test_stack_op (OP_DIV, {19, 5}, {3}, "OP_DIV");
         test_stack_op (OP_MOD, {19, 5}, {4}, "OP_MOD");
 
+
+        // results that do not fit in 64 bits.
+        auto test_big = [] (op Op, bytes a, bytes b, bytes expected, string explanation) {
+            success (evaluate (compile (program {instruction::push (a), instruction::push (b)}),
+                compile (program {Op, instruction::push (expected), OP_EQUAL}), script_config {}), explanation);
+        };
+
+        bytes max_int64 {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f};
+        bytes min_int64 {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+        bytes two_32 {0x00, 0x00, 0x00, 0x00, 0x01};
+
+        test_big (OP_ADD, max_int64, {0x01}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00}, "add overflow");
+        test_big (OP_SUB, min_int64, {0x01}, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80}, "subtract to the smallest int64");
+        test_big (OP_MUL, two_32, two_32, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01}, "multiply overflow");
+        test_big (OP_ADD, max_int64, {0x81}, {0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f}, "add no overflow");
+        test_big (OP_LESSTHAN, min_int64, max_int64, {0x01}, "less than");
     }
 /*
     // TODO
@@ -1003,6 +1271,386 @@ namespace Gigamonkey::Bitcoin {
         // TODO test that signatures that fail should be null for certain flags. 
         
     }
+
+    // verify_standard must give the same results as evaluate
+    // for spends that are valid, invalid and malformed.
+    TEST (ScriptTest, TestStandardScripts) {
+        incomplete::transaction tx {
+            {incomplete::input {
+                outpoint {
+                    digest256 {uint256 {"0xaa00000000000000000000000000000000000000000000555555550707070707"}}, 0xcdcdcdcd},
+                    0xfedcba09}}, {
+                output {1, pay_to_address::script (digest160 {uint160 {"0xbb00000000000000000000000000006565656575"}})},
+                output {2, pay_to_address::script (digest160 {uint160 {"0xcc00000000000000000000000000002929292985"}})}},
+            5};
+
+        redemption_document doc {tx, 0, satoshi {0xfeee}};
+
+        std::vector<secp256k1::secret> keys {
+            secp256k1::secret (uint256 {123456}), secp256k1::secret (uint256 {789012}),
+            secp256k1::secret (uint256 {345678}), secp256k1::secret (uint256 {901234})};
+
+        std::vector<flag> flags {
+            flag {},
+            flag::ENABLE_SIGHASH_FORKID,
+            flag::ENABLE_SIGHASH_FORKID | flag::VERIFY_STRICTENC | flag::VERIFY_LOW_S | flag::VERIFY_NULLFAIL |
+                flag::VERIFY_NULLDUMMY | flag::VERIFY_CLEANSTACK | flag::VERIFY_P2SH | flag::VERIFY_MINIMALDATA |
+                flag::VERIFY_SIGPUSHONLY,
+            genesis_profile ()};
+
+        std::vector<sighash::directive> directives {
+            directive (sighash::all), directive (sighash::all, false, false),
+            directive (sighash::none, true), directive (sighash::single)};
+
+        std::mt19937 random {7};
+        auto pick = [&random] (size_t n) -> size_t {
+            return std::uniform_int_distribution<size_t> (0, n - 1) (random);
+        };
+
+        // usually the right key, sometimes another.
+        auto signer = [&] (size_t right) -> const secp256k1::secret & {
+            return keys[pick (4) == 0 ? pick (keys.size ()) : right];
+        };
+
+        int recognized = 0;
+        for (int i = 0; i < 300; i++) {
+            sighash::directive d = directives[pick (directives.size ())];
+            bool compressed = pick (4) != 0;
+
+            bytes lock;
+            program unlock;
+            auto sign = [&] (const secp256k1::secret &k) -> bytes {
+                return signature::sign (k, d, sighash::document {tx, 0, satoshi {0xfeee}, decompile (lock)});
+            };
+
+            switch (pick (3)) {
+                case 0: {
+                    size_t k = pick (keys.size ());
+                    lock = pay_to_address::script (Hash160 (keys[k].to_public (compressed)));
+                    unlock = program {push_data (sign (signer (k))), push_data (signer (k).to_public (compressed))};
+                } break;
+                case 1: {
+                    size_t k = pick (keys.size ());
+                    lock = compile (program {push_data (keys[k].to_public (compressed)), OP_CHECKSIG});
+                    unlock = program {push_data (sign (signer (k)))};
+                } break;
+                default: {
+                    size_t n = 1 + pick (3);
+                    size_t m = 1 + pick (n);
+                    program mp {push_data (m)};
+                    for (size_t k = 0; k < n; k++) mp <<= push_data (keys[k].to_public (compressed));
+                    mp <<= push_data (n);
+                    mp <<= OP_CHECKMULTISIG;
+                    lock = compile (mp);
+
+                    unlock = program {OP_0};
+                    // signatures in the order of the keys, but sometimes out of order.
+                    size_t k = pick (n - m + 1);
+                    for (size_t j = 0; j < m; j++) unlock <<= push_data (sign (signer (k + j)));
+                }
+            }
+
+            bytes unlock_script = compile (unlock);
+
+            switch (pick (5)) {
+                case 0: unlock_script[pick (unlock_script.size ())] ^= byte (1 << pick (8)); break;
+                case 1: lock[pick (lock.size ())] ^= byte (1 << pick (8)); break;
+                case 2: unlock_script.resize (pick (unlock_script.size ())); break;
+                default: break;
+            }
+
+            for (flag f : flags) {
+                script_config conf {f};
+                result expected = evaluate (unlock_script, lock, doc, conf);
+                maybe<result> fast = verify_standard (unlock_script, lock, doc, conf);
+                if (bool (fast)) {
+                    recognized++;
+                    EXPECT_EQ (*fast, expected) << "unlock " << unlock_script << "; lock " << lock << "; flags " << f;
+                }
+
+                EXPECT_EQ (evaluate_standard (unlock_script, lock, doc, conf), expected);
+            }
+        }
+
+        EXPECT_GT (recognized, 300);
+
+        // multisig with the most keys that can be given with OP_n and
+        // with one more, where the last key is followed by OP_NOP.
+        std::vector<secp256k1::secret> many;
+        for (uint32 k = 0; k < 17; k++) many.push_back (secp256k1::secret (uint256 {1000 + k}));
+
+        for (size_t n : {16, 17}) {
+            program mp {OP_1};
+            for (size_t k = 0; k < n; k++) mp <<= push_data (many[k].to_public ());
+            mp <<= (n == 16 ? instruction {OP_16} : instruction {OP_NOP});
+            mp <<= OP_CHECKMULTISIG;
+            bytes lock = compile (mp);
+
+            bytes unlock_script = compile (program {OP_0, push_data (signature::sign (many[0], directive (sighash::all),
+                sighash::document {tx, 0, satoshi {0xfeee}, decompile (lock)}))});
+
+            for (flag f : flags) {
+                script_config conf {f};
+                result expected = evaluate (unlock_script, lock, doc, conf);
+                maybe<result> fast = verify_standard (unlock_script, lock, doc, conf);
+
+                if (n == 16) {
+                    EXPECT_TRUE (bool (fast)) << "flags " << f;
+                    if (bool (fast)) EXPECT_EQ (*fast, expected) << "flags " << f;
+                    if (f == genesis_profile ()) EXPECT_TRUE (expected.verify ()) << expected;
+                } else {
+                    EXPECT_FALSE (expected.verify ()) << "flags " << f;
+                    EXPECT_FALSE (bool (fast)) << "flags " << f;
+                }
+
+                EXPECT_EQ (evaluate_standard (unlock_script, lock, doc, conf), expected);
+            }
+        }
+    }
+
+    TEST (ScriptTest, TestBatchEvaluation) {
+        incomplete::transaction tx {
+            {incomplete::input {
+                outpoint {digest256 {uint256 {"0xaa00000000000000000000000000000000000000000000555555550707070707"}}, 3}, 0xffffffff}},
+            {output {1, pay_to_address::script (digest160 {uint160 {"0xbb00000000000000000000000000006565656575"}})}}, 0};
+
+        redemption_document doc {tx, 0, satoshi {0xfeee}};
+
+        auto key = secp256k1::secret (uint256 {123456});
+        auto pub = key.to_public ();
+        bytes p2pkh = pay_to_address::script (Hash160 (pub));
+        bytes sig = signature::sign (key, directive (sighash::all), sighash::document {tx, 0, satoshi {0xfeee}, decompile (p2pkh)});
+        bytes bad_sig = sig;
+        bad_sig[10] ^= 1;
+
+        bytes large (2000);
+        for (size_t i = 0; i < large.size (); i++) large[i] = byte (i);
+        bytes preimage {1, 2, 3};
+        bytes puzzle = compile (program {OP_SHA256, push_data (crypto::SHA2_256 (preimage)), OP_EQUALVERIFY,
+            OP_SIZE, push_data (2000), OP_EQUAL});
+
+        std::vector<bytes> locks {p2pkh, puzzle,
+            bytes {OP_IF, OP_1},
+            bytes {OP_DUP, OP_PUSHDATA1, 10},
+            pay_to_script_hash::script (Hash160 (bytes {OP_1}))};
+
+        std::vector<bytes> unlocks {
+            compile (program {push_data (sig), push_data (pub)}),
+            compile (program {push_data (bad_sig), push_data (pub)}),
+            compile (program {push_data (sig), push_data (pub), OP_NOP}),
+            compile (program {push_data (large), push_data (preimage)}),
+            compile (program {push_data (large), push_data (bytes {1, 2, 4})}),
+            // a push that is not minimal.
+            bytes {OP_PUSHDATA1, 1, 7},
+            bytes {OP_PUSHDATA1, 10},
+            compile (program {push_data (bytes {OP_1})}),
+            bytes {}};
+
+        std::vector<script_config> configs {
+            script_config {flag {}},
+            script_config {flag::VERIFY_MINIMALDATA | flag::VERIFY_SIGPUSHONLY | flag::VERIFY_P2SH},
+            script_config {genesis_profile ()},
+            script_config {genesis_profile () | flag::VERIFY_MINIMALDATA}};
+
+        script_config deferred {genesis_profile ()};
+        deferred.DeferSignatures = true;
+        configs.push_back (deferred);
+
+        for (const bytes &lock : locks) {
+            // checked with a config that is not used below.
+            lock_script l {lock, script_config {flag::VERIFY_MINIMALDATA}};
+            for (const script_config &conf : configs) {
+                std::vector<result> batch = evaluate_batch (unlocks, l, doc, conf);
+                std::vector<result> no_doc = evaluate_batch (unlocks, l, conf);
+                ASSERT_EQ (batch.size (), unlocks.size ());
+                for (size_t i = 0; i < unlocks.size (); i++) {
+                    EXPECT_EQ (batch[i], evaluate (unlocks[i], lock, doc, conf)) << "unlock " << unlocks[i] << "; lock " << lock;
+                    EXPECT_EQ (no_doc[i], evaluate (unlocks[i], lock, conf)) << "unlock " << unlocks[i] << "; lock " << lock;
+                }
+
+                // the first two unlock scripts begin with the same push.
+                std::vector<bytes> shared {unlocks[3], unlocks[4], unlocks[3]};
+                std::vector<result> shared_results = evaluate_batch (shared, l, doc, conf);
+                for (size_t i = 0; i < shared.size (); i++)
+                    EXPECT_EQ (shared_results[i], evaluate (shared[i], lock, doc, conf));
+            }
+        }
+
+        // a snapshot does not change when the machine it was taken from does.
+        machine<true> m {{}, script_config {}};
+        m.Stack.push_back (large);
+        m.Stack.push_back (preimage);
+        machine<true> s = m.snapshot ();
+        m.Stack.cat ();
+        EXPECT_EQ (m.Stack.size (), 1);
+        ASSERT_EQ (s.Stack.size (), 2);
+        EXPECT_EQ (s.Stack.top (-2), large);
+        EXPECT_EQ (s.Stack.top (), preimage);
+        s.Stack.pop_back ();
+        EXPECT_EQ (m.Stack.top ().size (), large.size () + preimage.size ());
+    }
+
+    TEST (ScriptTest, TestClassifier) {
+        const script_classifier &standard = script_classifier::standard ();
+
+        auto key = secp256k1::secret (uint256 {123456});
+        digest160 address = Hash160 (key.to_public ());
+
+        auto p2pkh = standard.classify (pay_to_address::script (address));
+        EXPECT_EQ (p2pkh.Template, script_classifier::pay_to_address);
+        EXPECT_EQ (bytes (p2pkh.Fields[0]), bytes (slice<const byte> (address)));
+
+        auto p2sh = standard.classify (pay_to_script_hash::script (address));
+        EXPECT_EQ (p2sh.Template, script_classifier::pay_to_script_hash);
+        EXPECT_EQ (bytes (p2sh.Fields[0]), bytes (slice<const byte> (address)));
+
+        for (bool compressed : {true, false}) {
+            secp256k1::pubkey pub = key.to_public (compressed);
+            auto p2pk = standard.classify (pay_to_pubkey::script (pub));
+            EXPECT_EQ (p2pk.Template, script_classifier::pay_to_pubkey);
+            EXPECT_EQ (bytes (p2pk.Fields[0]), bytes (pub));
+        }
+
+        program keys {};
+        for (int i = 1; i <= 3; i++) keys <<= push_data (secp256k1::secret (uint256 (i)).to_public ());
+        program mp {OP_2};
+        for (const instruction &k : keys) mp <<= k;
+        mp <<= OP_3;
+        mp <<= OP_CHECKMULTISIG;
+        bytes multisig = compile (mp);
+        auto ms = standard.classify (multisig);
+        EXPECT_EQ (ms.Template, script_classifier::multisig);
+        EXPECT_EQ (bytes (ms.Fields[0]), bytes {OP_2});
+        EXPECT_EQ (bytes (ms.Fields[1]), compile (keys));
+        EXPECT_EQ (bytes (ms.Fields[2]), bytes {OP_3});
+
+        for (bool safe : {true, false}) {
+            bytes data {1, 2, 3, 4, 5};
+            bytes x = compile (safe ? program {OP_FALSE, OP_RETURN, push_data (data)} : program {OP_RETURN, push_data (data)});
+            auto r = standard.classify (x);
+            EXPECT_EQ (r.Template, script_classifier::op_return);
+            EXPECT_EQ (bytes (r.Fields[0]), bytes (slice<const byte> (x).drop (safe ? 2 : 1)));
+        }
+
+        // anything can come after OP_RETURN, even an invalid program.
+        EXPECT_EQ (standard.classify (bytes {OP_RETURN, OP_PUSHDATA1, 10}).Template, script_classifier::op_return);
+
+        for (bool use_general_purpose_bits : {false, true}) for (bool contract : {false, true}) {
+            uint256 content {"0x0101010101010101010101010101010101010101010101010101010101010101"};
+            bytes tag {0x61, 0x62};
+            bytes data {0x63, 0x64, 0x65};
+            Boost::output_script boost = contract ?
+                Boost::output_script::contract (2, content, work::compact {uint32 (0x1d00ffff)}, tag, 7, data, address, use_general_purpose_bits) :
+                Boost::output_script::bounty (2, content, work::compact {uint32 (0x1d00ffff)}, tag, 7, data, use_general_purpose_bits);
+
+            auto b = standard.classify (boost.write ());
+            EXPECT_EQ (b.Template, use_general_purpose_bits ? script_classifier::boost_pow_asicboost : script_classifier::boost_pow);
+            EXPECT_EQ (bytes (b.Fields[0]), contract ? bytes (slice<const byte> (address)) : bytes {});
+            EXPECT_EQ (b.Fields[2].size (), 32);
+            EXPECT_EQ (bytes (b.Fields[4]), tag);
+            EXPECT_EQ (bytes (b.Fields[6]), data);
+        }
+
+        EXPECT_FALSE (standard.classify (bytes {}));
+        EXPECT_FALSE (standard.classify (bytes {OP_1, OP_CHECKSIG}));
+        // truncated push.
+        EXPECT_FALSE (standard.classify (bytes {OP_DUP, OP_HASH160, 20, 1, 2, 3}));
+        // too many instructions.
+        EXPECT_FALSE (standard.classify (compile (program {OP_HASH160, push_data (address), OP_EQUAL, OP_NOP})));
+
+        // ambiguous templates cannot be compiled.
+        using token = script_classifier::token;
+        EXPECT_THROW (script_classifier (std::vector<script_classifier::script_template> {{token::push ().optional (), token::push_size (4)}}), std::invalid_argument);
+        EXPECT_THROW (script_classifier (std::vector<script_classifier::script_template> {{token::pubkey ().repeated (), token::push_size (33)}}), std::invalid_argument);
+
+        // agrees with patterns on random changes to scripts.
+        std::vector<bytes> scripts {pay_to_address::script (address), pay_to_script_hash::script (address), multisig};
+        std::mt19937 random {11};
+        for (int i = 0; i < 1000; i++) {
+            bytes x = scripts[random () % scripts.size ()];
+            x[random () % x.size ()] ^= byte (1 << (random () % 8));
+
+            bytes read {};
+            auto r = standard.classify (x);
+            EXPECT_EQ (r.Template == script_classifier::pay_to_address, pay_to_address::pattern (read).match (x));
+            EXPECT_EQ (r.Template == script_classifier::pay_to_script_hash, pay_to_script_hash::pattern (read).match (x));
+        }
+    }
+
+    TEST (ScriptTest, TestConditionals) {
+        bytes if_else {OP_IF, OP_1, OP_ELSE, OP_0, OP_ENDIF};
+        success (evaluate (bytes {OP_1}, if_else, flag {}), "IF 1");
+        failure (evaluate (bytes {OP_0}, if_else, flag {}), "IF 0");
+
+        bytes notif_else {OP_NOTIF, OP_1, OP_ELSE, OP_0, OP_ENDIF};
+        success (evaluate (bytes {OP_0}, notif_else, flag {}), "NOTIF 0");
+        failure (evaluate (bytes {OP_1}, notif_else, flag {}), "NOTIF 1");
+
+        // nested conditionals in a branch that is not executed.
+        bytes nested {OP_IF, OP_IF, OP_0, OP_ELSE, OP_0, OP_ENDIF, OP_0, OP_ELSE, OP_1, OP_ENDIF};
+        success (evaluate (bytes {OP_0}, nested, flag {}), "nested 0");
+        failure (evaluate (bytes {OP_1, OP_1}, nested, flag {}), "nested 1");
+        success (evaluate (bytes {OP_1, OP_1}, bytes {OP_IF, OP_IF, OP_1, OP_ENDIF, OP_ENDIF}, flag {}), "nested 1 1");
+
+        // before genesis, multiple ELSE alternate.
+        bytes else_else {OP_IF, OP_0, OP_ELSE, OP_1, OP_ELSE, OP_0, OP_ENDIF};
+        success (evaluate (bytes {OP_0}, else_else, flag {}), "ELSE ELSE");
+
+        // OP_VERIF is an error before genesis even when it is not executed.
+        bytes verif {OP_IF, OP_VERIF, OP_ENDIF, OP_1};
+        error (evaluate (bytes {OP_0}, verif, flag {}), "VERIF not executed before genesis");
+        success (evaluate (bytes {OP_0}, verif, flag::ENABLE_GENESIS_OPCODES), "VERIF not executed after genesis");
+        error (evaluate (bytes {OP_1}, verif, flag::ENABLE_GENESIS_OPCODES), "VERIF executed after genesis");
+
+        // ops in branches that are not executed still count toward the limit.
+        program many_ops {OP_IF};
+        for (int i = 0; i < 501; i++) many_ops <<= OP_NOP;
+        many_ops <<= OP_ENDIF;
+        many_ops <<= OP_1;
+        auto r = evaluate (bytes {OP_0}, compile (many_ops), flag {});
+        EXPECT_EQ (r.Error, SCRIPT_ERR_OP_COUNT) << r;
+    }
+    TEST (ScriptTest, TestProfile) {
+        profile::reset ();
+
+        script_config conf {};
+        conf.Profile = true;
+        success (evaluate (bytes {OP_1, OP_2}, bytes {OP_ADD, OP_3, OP_EQUAL}, conf), "profile");
+
+        // nothing is recorded without profiling.
+        success (evaluate (bytes {OP_1, OP_2}, bytes {OP_ADD, OP_3, OP_EQUAL}, script_config {}), "no profile");
+
+        profile p = profile::local ();
+        EXPECT_EQ (p, profile::total ());
+
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+        EXPECT_EQ (p.Scripts, 1);
+        for (op o : {OP_1, OP_2, OP_CODESEPARATOR, OP_ADD, OP_3, OP_EQUAL}) EXPECT_EQ (p.Opcodes[o].Count, 1) << o;
+        EXPECT_EQ (p.Opcodes[OP_DUP].Count, 0);
+        EXPECT_EQ (p.MaxStackElements, 2);
+        EXPECT_EQ (p.SigOps, 0);
+        EXPECT_EQ (p.Skipped, 0);
+        EXPECT_EQ (p.report ()["opcodes"].size (), 6);
+#else
+        EXPECT_EQ (p, profile {});
+#endif
+
+        // ops in a branch that is not taken are only counted as skipped.
+        profile::reset ();
+        success (evaluate (bytes {OP_0}, bytes {OP_IF, OP_DUP, OP_DROP, OP_ELSE, OP_1, OP_ENDIF}, conf), "profile branch");
+        p = profile::local ();
+
+#ifdef GIGAMONKEY_SCRIPT_PROFILE
+        EXPECT_EQ (p.Opcodes[OP_DUP].Count, 0);
+        EXPECT_EQ (p.Opcodes[OP_DROP].Count, 0);
+        EXPECT_EQ (p.Opcodes[OP_IF].Count, 1);
+        EXPECT_EQ (p.Opcodes[OP_1].Count, 1);
+        EXPECT_EQ (p.Opcodes[OP_ENDIF].Count, 1);
+        EXPECT_EQ (p.Skipped, 3);
+#else
+        EXPECT_EQ (p, profile {});
+#endif
+    }
 /*
     TEST (ScriptTest, TestVerify) {
 
@@ -6,6 +6,9 @@
 #include <gigamonkey/script/pattern/pay_to_address.hpp>
 #include <gigamonkey/wif.hpp>
 #include <gigamonkey/script/machine.hpp>
+#include <gigamonkey/signature_cache.hpp>
+#include <gigamonkey/script/signature_batch.hpp>
+#include <gigamonkey/script/standard.hpp>
 #include "gtest/gtest.h"
 
 namespace Gigamonkey::Bitcoin {
@@ -89,6 +92,9 @@ namespace Gigamonkey::Bitcoin {
         sighash::document doc_changed_value = change_value (doc);
         sighash::document doc_added_code_separator = add_code_separator (doc);
         sighash::document doc_added_input {txi_added_input, input_index, redeemed_value, scriptx};
+
+        sighash::precomputed pre {txi};
+        sighash::document doc_precomputed {txi, input_index, redeemed_value, scriptx, &pre};
         
         for (sighash::directive directive : list<sighash::directive> {
             directive (sighash::all, false, false),
@@ -127,6 +133,7 @@ namespace Gigamonkey::Bitcoin {
             else EXPECT_NE (written, added_input) << "expect \n\t" << written << " to not equal \n\t" << added_input;
             
             EXPECT_EQ (written, sighash::write (doc, directive));
+            EXPECT_EQ (written, sighash::write (doc_precomputed, directive));
             EXPECT_EQ (mutate_same_output, sighash::write (doc_mutate_same_output, directive));
             EXPECT_EQ (mutate_different_output, sighash::write (doc_mutate_different_output, directive));
             EXPECT_EQ (changed_value, sighash::write (doc_changed_value, directive));
@@ -142,6 +149,87 @@ namespace Gigamonkey::Bitcoin {
         
     }
     
+    namespace {
+    // the original signature hash, following the legacy algorithm in Bitcoin Core:
+    // copy the transaction, modify the copy according to the directive, and
+    // serialize it followed by the directive. Kept independent of sighash.cpp.
+    bytes reference_original_preimage (
+        const std::vector<outpoint> &prevouts, const std::vector<uint32> &sequences,
+        const std::vector<output> &outs, uint32 locktime,
+        index input_index, const script &script_code, sighash::directive d) {
+
+        std::vector<input> ins;
+        for (index i = 0; i < prevouts.size (); i++)
+            ins.push_back (input {prevouts[i], i == input_index ? script_code : script {}, sequences[i]});
+
+        std::vector<output> os = outs;
+
+        int base = d & 0x1f;
+        if (base == sighash::none) {
+            os.clear ();
+            for (index i = 0; i < ins.size (); i++) if (i != input_index) ins[i].Sequence = 0;
+        } else if (base == sighash::single) {
+            os.resize (input_index + 1);
+            for (index i = 0; i < input_index; i++) os[i] = output {satoshi {-1}, script {}};
+            for (index i = 0; i < ins.size (); i++) if (i != input_index) ins[i].Sequence = 0;
+        }
+
+        if (d & sighash::anyone_can_pay) ins = std::vector<input> {ins[input_index]};
+
+        list<input> li;
+        for (const input &in : ins) li <<= in;
+        list<output> lo;
+        for (const output &o : os) lo <<= o;
+
+        data::lazy_bytes_writer w;
+        w << bytes (transaction {int32_little {transaction::LatestVersion}, li, lo, locktime}) << uint32_little {d};
+        return bytes (w);
+    }
+    }
+
+    TEST (SignatureTest, TestOriginalSighash) {
+        auto scriptx = decompile (pay_to_address::script (digest160 {uint160 {"0xdddddddddd000000000000000000006767676791"}}));
+        program script_code = scriptx << OP_CODESEPARATOR << OP_DROP;
+
+        // the script code with OP_CODESEPARATOR removed, as it is signed.
+        script signed_code = compile (scriptx << OP_DROP);
+
+        std::vector<outpoint> prevouts;
+        std::vector<uint32> sequences;
+        std::vector<output> outs;
+
+        list<incomplete::input> inputs;
+        list<output> outputs;
+        for (uint32 i = 0; i < 4; i++) {
+            prevouts.push_back (outpoint {digest256 {uint256 {i + 11}}, i});
+            sequences.push_back (0xfedcba00 + i);
+            outs.push_back (output {satoshi {int64 (i + 1)}, pay_to_address::script (digest160 {uint160 {i + 21}})});
+
+            inputs <<= incomplete::input {prevouts[i], sequences[i]};
+            outputs <<= outs[i];
+        }
+
+        incomplete::transaction txi {inputs, outputs, 5};
+
+        for (index input_index = 0; input_index < 4; input_index++) {
+            sighash::document doc {txi, input_index, satoshi {0xfeee}, script_code};
+            for (byte b : {0, 1, 2, 3, 4})
+                for (bool anyone_can_pay : {false, true}) {
+                    sighash::directive d = b | (anyone_can_pay ? sighash::anyone_can_pay : 0);
+
+                    bytes expected = reference_original_preimage (prevouts, sequences, outs, 5, input_index, signed_code, d);
+
+                    EXPECT_EQ (sighash::write_original (doc, d), expected) << "input " << input_index << "; directive " << int (d);
+                    EXPECT_EQ (signature::hash (doc, d), Hash256 (expected));
+
+                    // the reconstructed transaction agrees with the reference too.
+                    data::lazy_bytes_writer reconstructed;
+                    reconstructed << sighash::reconstruct (doc, d) << uint32_little {d};
+                    EXPECT_EQ (bytes (reconstructed), expected) << "input " << input_index << "; directive " << int (d);
+                }
+        }
+    }
+
     TEST (SignatureTest, TestFindAndDelete) {
         
         auto p1 = secp256k1::point (uint256 {123}, uint256 {456});
@@ -163,9 +251,219 @@ namespace Gigamonkey::Bitcoin {
         EXPECT_TRUE (find_and_delete (t1_2, push_sig1) == t1);
         EXPECT_TRUE (find_and_delete (t1_3, push_sig1) == t1);
         EXPECT_TRUE (find_and_delete (t1_4, push_sig1) == t1);
+
+        EXPECT_TRUE (find_and_delete (flat_program {t1_1}, push_sig1) == flat_program {t1});
+        EXPECT_TRUE (find_and_delete (flat_program {t1_4}, push_sig1) == flat_program {t1});
+        EXPECT_TRUE (find_and_delete (flat_program {t1_4}, push_sig2) == flat_program {t1_4});
         
     }
 
+    TEST (SignatureTest, TestSignatureCache) {
+        // a cache small enough that entries will be evicted.
+        signature_cache cache {1};
+        EXPECT_GT (cache.capacity (), 0);
+
+        digest256 d {uint256 {"0xaa00000000000000000000000000000000000000000000555555550707070707"}};
+        bytes pub {0x02, 0x03};
+        bytes sig {0x30, 0x01};
+
+        EXPECT_FALSE (cache.contains (d, pub, sig));
+        cache.insert (d, pub, sig);
+        EXPECT_TRUE (cache.contains (d, pub, sig));
+        EXPECT_FALSE (cache.contains (d, pub, bytes {0x30, 0x02}));
+        EXPECT_FALSE (cache.contains (digest256 {uint256 {1}}, pub, sig));
+        EXPECT_EQ (cache.hits (), 1);
+        EXPECT_EQ (cache.misses (), 3);
+
+        // more entries than the cache can hold.
+        for (uint32 i = 0; i < 4 * cache.capacity (); i++) cache.insert (digest256 {uint256 {i + 2}}, pub, sig);
+        uint32 found = 0;
+        for (uint32 i = 0; i < 4 * cache.capacity (); i++) if (cache.contains (digest256 {uint256 {i + 2}}, pub, sig)) found++;
+        EXPECT_LE (found, cache.capacity ());
+        EXPECT_GT (found, 0);
+
+        cache.clear ();
+        EXPECT_FALSE (cache.contains (d, pub, sig));
+
+        // the same bytes split differently between the key and the signature.
+        bytes joined {0x02, 0x03, 0x30, 0x01, 0x05};
+        cache.insert (d, slice<const byte> {joined.data (), 2}, slice<const byte> {joined.data () + 2, 3});
+        EXPECT_TRUE (cache.contains (d, slice<const byte> {joined.data (), 2}, slice<const byte> {joined.data () + 2, 3}));
+        for (size_t split : {0, 1, 3, 4, 5})
+            EXPECT_FALSE (cache.contains (d, slice<const byte> {joined.data (), split},
+                slice<const byte> {joined.data () + split, joined.size () - split})) << "split at " << split;
+        cache.clear ();
+
+        // signatures checked by the script interpreter.
+        secp256k1::secret key {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}};
+        incomplete::transaction txi {
+            {incomplete::input {outpoint {d, 0}, 0xfedcba09}},
+            {output {1, pay_to_address::script (Hash160 (key.to_public ()))}}, 5};
+        sighash::document doc {txi, 0, satoshi {0xfeee}, decompile (pay_to_address::script (Hash160 (key.to_public ())))};
+        signature x = signature::sign (key, directive (sighash::all), doc);
+
+        signature_cache verified {};
+        EXPECT_EQ (verify_signature (x, key.to_public (), doc, flag::ENABLE_SIGHASH_FORKID, &verified), result {true});
+        EXPECT_EQ (verified.misses (), 1);
+        EXPECT_EQ (verify_signature (x, key.to_public (), doc, flag::ENABLE_SIGHASH_FORKID, &verified), result {true});
+        EXPECT_EQ (verified.hits (), 1);
+
+        // invalid signatures are not stored.
+        sighash::document changed = change_value (doc);
+        EXPECT_EQ (verify_signature (x, key.to_public (), changed, flag::ENABLE_SIGHASH_FORKID, &verified), result {false});
+        EXPECT_EQ (verify_signature (x, key.to_public (), changed, flag::ENABLE_SIGHASH_FORKID, &verified), result {false});
+        EXPECT_EQ (verified.hits (), 1);
+        EXPECT_EQ (verified.misses (), 3);
+    }
+
+    TEST (SignatureTest, TestDeferredSignatures) {
+        secp256k1::secret key {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}};
+        secp256k1::secret other {uint256 {"0x00000000000000000000000000000000000000000000000000000000000201b3"}};
+        pubkey pub = key.to_public ();
+
+        incomplete::transaction txi {
+            {incomplete::input {outpoint {digest256 {uint256 {7}}, 0}, 0xfedcba09}},
+            {output {1, pay_to_address::script (Hash160 (pub))}}, 5};
+
+        // a batch with an invalid signature among many valid ones.
+        std::vector<digest256> digests;
+        std::vector<bytes> sigs;
+        for (uint32 i = 0; i < 100; i++) {
+            digests.push_back (digest256 {uint256 {i + 1}});
+            sigs.push_back (bytes (key.sign (digests.back ())));
+        }
+
+        std::vector<secp256k1::pubkey::verification> batch;
+        for (uint32 i = 0; i < 100; i++) batch.push_back ({pub, digests[i], sigs[i]});
+
+        EXPECT_EQ (secp256k1::pubkey::verify_batch (batch), 100);
+        EXPECT_EQ (secp256k1::pubkey::verify_batch (batch, 1), 100);
+        EXPECT_EQ (secp256k1::pubkey::verify_batch ({}), 0);
+
+        batch[71].Digest = digest256 {uint256 {1000}};
+        batch[93].Digest = digest256 {uint256 {1001}};
+        EXPECT_EQ (secp256k1::pubkey::verify_batch (batch), 71);
+        EXPECT_EQ (secp256k1::pubkey::verify_batch (batch, 4), 71);
+        EXPECT_EQ (secp256k1::pubkey::verify_batch (batch, 1), 71);
+
+        // scripts give the same result whether signatures are deferred or not.
+        redemption_document doc {txi, 0, satoshi {0xfeee}};
+        bytes lock = pay_to_address::script (Hash160 (pub));
+        sighash::document signed_doc {txi, 0, satoshi {0xfeee}, decompile (lock)};
+        signature valid = signature::sign (key, directive (sighash::all), signed_doc);
+        signature invalid = signature::sign (other, directive (sighash::all), signed_doc);
+
+        bytes lock_verify = compile (program {instruction::push (pub), OP_CHECKSIGVERIFY});
+        sighash::document signed_verify_doc {txi, 0, satoshi {0xfeee}, decompile (lock_verify)};
+        signature valid_verify = signature::sign (key, directive (sighash::all), signed_verify_doc);
+
+        struct test_case {
+            bytes Unlock;
+            bytes Lock;
+        };
+
+        std::vector<test_case> cases {
+            {pay_to_address::redeem (valid, pub), lock},
+            {pay_to_address::redeem (invalid, pub), lock},
+            {compile (program {instruction::push (valid_verify)}), lock_verify},
+            {compile (program {instruction::push (invalid)}), lock_verify},
+            {compile (program {instruction::push (bytes {})}), lock_verify},
+            // an extra element fails the clean stack rule either way.
+            {compile (program {OP_1, instruction::push (valid), instruction::push (pub)}), lock},
+            {compile (program {OP_1, instruction::push (invalid), instruction::push (pub)}), lock}};
+
+        for (flag f : {flag::ENABLE_SIGHASH_FORKID,
+            flag::ENABLE_SIGHASH_FORKID | flag::VERIFY_NULLFAIL,
+            flag::ENABLE_SIGHASH_FORKID | flag::VERIFY_CLEANSTACK | flag::VERIFY_P2SH}) {
+            script_config now {f};
+            script_config later {f};
+            later.DeferSignatures = true;
+
+            for (const test_case &tc : cases) {
+                result expected = evaluate (tc.Unlock, tc.Lock, doc, now);
+                EXPECT_EQ (evaluate (tc.Unlock, tc.Lock, doc, later), expected) << "expected " << expected;
+            }
+        }
+
+        EXPECT_TRUE (evaluate (pay_to_address::redeem (valid, pub), lock, doc, script_config {flag::ENABLE_SIGHASH_FORKID}));
+
+        // valid deferred signatures are added to the cache.
+        signature_cache cache {};
+        script_config cached {flag::ENABLE_SIGHASH_FORKID};
+        cached.DeferSignatures = true;
+        cached.SignatureCache = &cache;
+        EXPECT_TRUE (evaluate (pay_to_address::redeem (valid, pub), lock, doc, cached));
+        EXPECT_TRUE (evaluate (pay_to_address::redeem (valid, pub), lock, doc, cached));
+        EXPECT_EQ (cache.hits (), 1);
+    }
+
+    // the signatures from the scripts of all the inputs of a transaction are checked together.
+    TEST (SignatureTest, TestSignatureBatch) {
+        secp256k1::secret key {uint256 {"0x00000000000000000000000000000000000000000000000000000000000101a7"}};
+        secp256k1::secret other {uint256 {"0x00000000000000000000000000000000000000000000000000000000000201b3"}};
+        pubkey pub = key.to_public ();
+
+        std::vector<bytes> locks {
+            pay_to_address::script (Hash160 (pub)),
+            compile (program {instruction::push (pub), OP_CHECKSIGVERIFY, OP_1}),
+            compile (program {instruction::push (pub), OP_CHECKSIGVERIFY, instruction::push (pub), OP_CHECKSIG})};
+
+        constexpr uint32 inputs = 12;
+        list<incomplete::input> ins;
+        for (uint32 i = 0; i < inputs; i++) ins <<= incomplete::input {outpoint {digest256 {uint256 {i + 1}}, 0}};
+        incomplete::transaction txi {ins, {output {1, locks[0]}}, 0};
+
+        // input 5 has invalid signatures.
+        std::vector<bytes> unlocks;
+        for (uint32 i = 0; i < inputs; i++) {
+            const bytes &lock = locks[i % 3];
+            sighash::document doc {txi, i, satoshi {1000 + i}, decompile (lock)};
+            signature sig = signature::sign (i == 5 ? other : key, directive (sighash::all), doc);
+            unlocks.push_back (i % 3 == 0 ? pay_to_address::redeem (sig, pub) :
+                i % 3 == 1 ? compile (program {instruction::push (sig)}) :
+                compile (program {instruction::push (sig), instruction::push (sig)}));
+        }
+
+        signature_batch batch {};
+        script_config conf {flag::ENABLE_SIGHASH_FORKID};
+        conf.DeferSignatures = true;
+        conf.SignatureBatch = &batch;
+
+        auto evaluate_all = [&] (uint32 skip) {
+            for (uint32 i = 0; i < inputs; i++) if (i != skip)
+                EXPECT_TRUE (evaluate_standard (unlocks[i], locks[i % 3], redemption_document {txi, i, satoshi {1000 + i}}, conf));
+        };
+
+        // every script succeeds until the signatures are checked.
+        evaluate_all (inputs);
+        EXPECT_EQ (batch.size (), 16);
+
+        maybe<signature_batch::job> failure = batch.check ();
+        EXPECT_TRUE (bool (failure));
+        EXPECT_TRUE (batch.empty ());
+        EXPECT_EQ (failure->InputIndex, 5);
+        EXPECT_EQ (failure->Failure, evaluate (unlocks[5], locks[2],
+            redemption_document {txi, 5, satoshi {1005}}, script_config {flag::ENABLE_SIGHASH_FORKID}));
+
+        evaluate_all (5);
+        EXPECT_EQ (batch.size (), 14);
+        EXPECT_FALSE (bool (batch.check ()));
+
+        // a signature in the cache is not added to the batch.
+        signature_cache cache {};
+        conf.SignatureCache = &cache;
+        evaluate_all (5);
+        EXPECT_FALSE (bool (batch.check (&cache)));
+        evaluate_all (5);
+        EXPECT_EQ (batch.size (), 0);
+
+        // the script goes on after OP_CHECKSIGVERIFY.
+        bytes lock_false = compile (program {instruction::push (pub), OP_CHECKSIGVERIFY, OP_0});
+        signature sig = signature::sign (key, directive (sighash::all), sighash::document {txi, 0, satoshi {1000}, decompile (lock_false)});
+        EXPECT_EQ (evaluate (compile (program {instruction::push (sig)}), lock_false,
+            redemption_document {txi, 0, satoshi {1000}}, script_config {flag::ENABLE_SIGHASH_FORKID}), result {false});
+    }
+
     TEST (SignatureTest, TestFlags) {
         // compressed pubkey
         // strict encoding